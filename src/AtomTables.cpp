@@ -0,0 +1,404 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "AtomTables.h"
+
+// the hash tables are built at compile time by constexpr functions with loops and local variables,
+// which need C++14 (CONFIG += c++14 with qmake); MSVC reports the standard in _MSVC_LANG
+#if (defined(_MSVC_LANG) ? _MSVC_LANG : __cplusplus) < 201402L
+#error "AtomTables.cpp requires C++14"
+#endif
+
+namespace
+{
+	struct Element
+	{
+		char name[3];
+		float radius;
+		quint32 color; // 0xRRGGBB
+	};
+
+	struct Residue
+	{
+		char name[5];
+		AtomTables::ResidueType type;
+		quint32 color;
+	};
+
+	// Van der Waals radii of the Blue Obelisk data repository (Bondi, Mantina et al., 2.0 where unknown),
+	// colors of Jmol. C, H, N, O, P and S keep the radii and the RasMol CPK colors used so far.
+	constexpr Element ELEMENTS[] =
+	{
+		{ "A", 1.5f, 0xFF00FF }, // 0 unknown
+		{ "H", 1.100f, 0xFFFFFF }, // 1
+		{ "He", 1.40f, 0xD9FFFF }, // 2
+		{ "Li", 1.81f, 0xCC80FF }, // 3
+		{ "Be", 1.53f, 0xC2FF00 }, // 4
+		{ "B", 1.92f, 0xFFB5B5 }, // 5
+		{ "C", 1.548f, 0xC8C8C8 }, // 6
+		{ "N", 1.400f, 0x8F8FFF }, // 7
+		{ "O", 1.348f, 0xF00000 }, // 8
+		{ "F", 1.47f, 0x90E050 }, // 9
+		{ "Ne", 1.54f, 0xB3E3F5 }, // 10
+		{ "Na", 2.27f, 0xAB5CF2 }, // 11
+		{ "Mg", 1.73f, 0x8AFF00 }, // 12
+		{ "Al", 1.84f, 0xBFA6A6 }, // 13
+		{ "Si", 2.10f, 0xF0C8A0 }, // 14
+		{ "P", 1.880f, 0xFFA500 }, // 15
+		{ "S", 1.808f, 0xFFC832 }, // 16
+		{ "Cl", 1.75f, 0x1FF01F }, // 17
+		{ "Ar", 1.88f, 0x80D1E3 }, // 18
+		{ "K", 2.75f, 0x8F40D4 }, // 19
+		{ "Ca", 2.31f, 0x3DFF00 }, // 20
+		{ "Sc", 2.30f, 0xE6E6E6 }, // 21
+		{ "Ti", 2.15f, 0xBFC2C7 }, // 22
+		{ "V", 2.05f, 0xA6A6AB }, // 23
+		{ "Cr", 2.05f, 0x8A99C7 }, // 24
+		{ "Mn", 2.05f, 0x9C7AC7 }, // 25
+		{ "Fe", 2.05f, 0xE06633 }, // 26
+		{ "Co", 2.00f, 0xF090A0 }, // 27
+		{ "Ni", 2.00f, 0x50D050 }, // 28
+		{ "Cu", 2.00f, 0xC88033 }, // 29
+		{ "Zn", 2.10f, 0x7D80B0 }, // 30
+		{ "Ga", 1.87f, 0xC28F8F }, // 31
+		{ "Ge", 2.11f, 0x668F8F }, // 32
+		{ "As", 1.85f, 0xBD80E3 }, // 33
+		{ "Se", 1.90f, 0xFFA100 }, // 34
+		{ "Br", 1.83f, 0xA62929 }, // 35
+		{ "Kr", 2.02f, 0x5CB8D1 }, // 36
+		{ "Rb", 3.03f, 0x702EB0 }, // 37
+		{ "Sr", 2.49f, 0x00FF00 }, // 38
+		{ "Y", 2.40f, 0x94FFFF }, // 39
+		{ "Zr", 2.30f, 0x94E0E0 }, // 40
+		{ "Nb", 2.15f, 0x73C2C9 }, // 41
+		{ "Mo", 2.10f, 0x54B5B5 }, // 42
+		{ "Tc", 2.05f, 0x3B9E9E }, // 43
+		{ "Ru", 2.05f, 0x248F8F }, // 44
+		{ "Rh", 2.00f, 0x0A7D8C }, // 45
+		{ "Pd", 2.05f, 0x006985 }, // 46
+		{ "Ag", 2.10f, 0xC0C0C0 }, // 47
+		{ "Cd", 2.20f, 0xFFD98F }, // 48
+		{ "In", 2.20f, 0xA67573 }, // 49
+		{ "Sn", 1.93f, 0x668080 }, // 50
+		{ "Sb", 2.06f, 0x9E63B5 }, // 51
+		{ "Te", 2.06f, 0xD47A00 }, // 52
+		{ "I", 1.98f, 0x940094 }, // 53
+		{ "Xe", 2.16f, 0x429EB0 }, // 54
+		{ "Cs", 3.43f, 0x57178F }, // 55
+		{ "Ba", 2.68f, 0x00C900 }, // 56
+		{ "La", 2.50f, 0x70D4FF }, // 57
+		{ "Ce", 2.48f, 0xFFFFC7 }, // 58
+		{ "Pr", 2.47f, 0xD9FFC7 }, // 59
+		{ "Nd", 2.45f, 0xC7FFC7 }, // 60
+		{ "Pm", 2.43f, 0xA3FFC7 }, // 61
+		{ "Sm", 2.42f, 0x8FFFC7 }, // 62
+		{ "Eu", 2.40f, 0x61FFC7 }, // 63
+		{ "Gd", 2.38f, 0x45FFC7 }, // 64
+		{ "Tb", 2.37f, 0x30FFC7 }, // 65
+		{ "Dy", 2.35f, 0x1FFFC7 }, // 66
+		{ "Ho", 2.33f, 0x00FF9C }, // 67
+		{ "Er", 2.32f, 0x00E675 }, // 68
+		{ "Tm", 2.30f, 0x00D452 }, // 69
+		{ "Yb", 2.28f, 0x00BF38 }, // 70
+		{ "Lu", 2.27f, 0x00AB24 }, // 71
+		{ "Hf", 2.25f, 0x4DC2FF }, // 72
+		{ "Ta", 2.20f, 0x4DA6FF }, // 73
+		{ "W", 2.10f, 0x2194D6 }, // 74
+		{ "Re", 2.05f, 0x267DAB }, // 75
+		{ "Os", 2.00f, 0x266696 }, // 76
+		{ "Ir", 2.00f, 0x175487 }, // 77
+		{ "Pt", 2.05f, 0xD0D0E0 }, // 78
+		{ "Au", 2.10f, 0xFFD123 }, // 79
+		{ "Hg", 2.05f, 0xB8B8D0 }, // 80
+		{ "Tl", 1.96f, 0xA6544D }, // 81
+		{ "Pb", 2.02f, 0x575961 }, // 82
+		{ "Bi", 2.07f, 0x9E4FB5 }, // 83
+		{ "Po", 1.97f, 0xAB5C00 }, // 84
+		{ "At", 2.02f, 0x754F45 }, // 85
+		{ "Rn", 2.20f, 0x428296 }, // 86
+		{ "Fr", 3.48f, 0x420066 }, // 87
+		{ "Ra", 2.83f, 0x007D00 }, // 88
+		{ "Ac", 2.00f, 0x70ABFA }, // 89
+		{ "Th", 2.40f, 0x00BAFF }, // 90
+		{ "Pa", 2.00f, 0x00A1FF }, // 91
+		{ "U", 1.86f, 0x008FFF }, // 92
+		{ "Np", 2.00f, 0x0080FF }, // 93
+		{ "Pu", 2.00f, 0x006BFF }, // 94
+		{ "Am", 2.00f, 0x545CF2 }, // 95
+		{ "Cm", 2.00f, 0x785CE3 }, // 96
+		{ "Bk", 2.00f, 0x8A4FE3 }, // 97
+		{ "Cf", 2.00f, 0xA136D4 }, // 98
+		{ "Es", 2.00f, 0xB31FD4 }, // 99
+		{ "Fm", 2.00f, 0xB31FBA }, // 100
+		{ "Md", 2.00f, 0xB30DA6 }, // 101
+		{ "No", 2.00f, 0xBD0D87 }, // 102
+		{ "Lr", 2.00f, 0xC70066 }, // 103
+		{ "Rf", 2.00f, 0xCC0059 }, // 104
+		{ "Db", 2.00f, 0xD1004F }, // 105
+		{ "Sg", 2.00f, 0xD90045 }, // 106
+		{ "Bh", 2.00f, 0xE00038 }, // 107
+		{ "Hs", 2.00f, 0xE6002E }, // 108
+		{ "Mt", 2.00f, 0xEB0026 }, // 109
+		{ "Ds", 2.00f, 0xFF00FF }, // 110
+		{ "Rg", 2.00f, 0xFF00FF }, // 111
+		{ "Cn", 2.00f, 0xFF00FF }, // 112
+		{ "Nh", 2.00f, 0xFF00FF }, // 113
+		{ "Fl", 2.00f, 0xFF00FF }, // 114
+		{ "Mc", 2.00f, 0xFF00FF }, // 115
+		{ "Lv", 2.00f, 0xFF00FF }, // 116
+		{ "Ts", 2.00f, 0xFF00FF }, // 117
+		{ "Og", 2.00f, 0xFF00FF }, // 118
+	};
+
+	const AtomTables::ResidueType AMINO = AtomTables::AMINO_ACID;
+	const AtomTables::ResidueType NUCLEOTIDE = AtomTables::NUCLEOTIDE;
+	const AtomTables::ResidueType WATER = AtomTables::WATER;
+	const AtomTables::ResidueType LIGAND = AtomTables::LIGAND;
+
+	// amino acid colors taken from http://life.nthu.edu.tw/~fmhsu/rasframe/COLORS.HTM,
+	// nucleotides in shapely colors; the first 23 residues keep their previous ids
+	constexpr Residue RESIDUES[] =
+	{
+		{ "ALA", AMINO, 0xC8C8C8 }, // dark grey
+		{ "ARG", AMINO, 0x145AFF }, // blue
+		{ "ASN", AMINO, 0x00DCDC }, // cyan
+		{ "ASP", AMINO, 0xE60A0A }, // bright red
+		{ "CYS", AMINO, 0xFFC832 }, // yellow
+		{ "GLN", AMINO, 0x00DCDC }, // cyan
+		{ "GLU", AMINO, 0xE60A0A }, // bright red
+		{ "GLY", AMINO, 0xEBEBEB }, // light grey
+		{ "HID", AMINO, 0x8282D2 }, // pale blue
+		{ "HIE", AMINO, 0x8282D2 }, // pale blue
+		{ "HIP", AMINO, 0x8282D2 }, // pale blue
+		{ "HIS", AMINO, 0x8282D2 }, // pale blue
+		{ "ILE", AMINO, 0x0F820F }, // green
+		{ "LEU", AMINO, 0x0F820F }, // green
+		{ "LYS", AMINO, 0x145AFF }, // blue
+		{ "MET", AMINO, 0xFFC832 }, // yellow
+		{ "PHE", AMINO, 0x3232AA }, // mid blue
+		{ "PRO", AMINO, 0xDC9682 }, // flesh
+		{ "SER", AMINO, 0xFA9600 }, // orange
+		{ "THR", AMINO, 0xFA9600 }, // orange
+		{ "TRP", AMINO, 0xB45AB4 }, // pink
+		{ "TYR", AMINO, 0x3232AA }, // mid blue
+		{ "VAL", AMINO, 0x0F820F }, // green
+
+		// protonation states (AMBER, CHARMM) and modified amino acids
+		{ "ASH", AMINO, 0xE60A0A },
+		{ "GLH", AMINO, 0xE60A0A },
+		{ "CYX", AMINO, 0xFFC832 },
+		{ "CYM", AMINO, 0xFFC832 },
+		{ "LYN", AMINO, 0x145AFF },
+		{ "HSD", AMINO, 0x8282D2 },
+		{ "HSE", AMINO, 0x8282D2 },
+		{ "HSP", AMINO, 0x8282D2 },
+		{ "MSE", AMINO, 0xFFC832 },
+		{ "SEC", AMINO, 0xFFC832 },
+		{ "PYL", AMINO, 0x145AFF },
+		{ "ACE", AMINO, 0xBEA06E }, // caps, tan
+		{ "NME", AMINO, 0xBEA06E },
+
+		// ribo- and deoxyribonucleotides
+		{ "A", NUCLEOTIDE, 0xA0A0FF },
+		{ "C", NUCLEOTIDE, 0xFF8C4B },
+		{ "G", NUCLEOTIDE, 0xFF7070 },
+		{ "U", NUCLEOTIDE, 0xFF8080 },
+		{ "I", NUCLEOTIDE, 0x80FFFF },
+		{ "DA", NUCLEOTIDE, 0xA0A0FF },
+		{ "DC", NUCLEOTIDE, 0xFF8C4B },
+		{ "DG", NUCLEOTIDE, 0xFF7070 },
+		{ "DT", NUCLEOTIDE, 0xA0FFA0 },
+		{ "DU", NUCLEOTIDE, 0xFF8080 },
+		{ "DI", NUCLEOTIDE, 0x80FFFF },
+
+		{ "HOH", WATER, 0xFF0000 },
+		{ "WAT", WATER, 0xFF0000 },
+		{ "DOD", WATER, 0xFF0000 },
+		{ "TIP3", WATER, 0xFF0000 },
+		{ "SOL", WATER, 0xFF0000 },
+
+		// common ligands and ions, tan
+		{ "HEM", LIGAND, 0xBEA06E },
+		{ "HEC", LIGAND, 0xBEA06E },
+		{ "ATP", LIGAND, 0xBEA06E },
+		{ "ADP", LIGAND, 0xBEA06E },
+		{ "AMP", LIGAND, 0xBEA06E },
+		{ "GTP", LIGAND, 0xBEA06E },
+		{ "GDP", LIGAND, 0xBEA06E },
+		{ "NAD", LIGAND, 0xBEA06E },
+		{ "NAP", LIGAND, 0xBEA06E },
+		{ "FAD", LIGAND, 0xBEA06E },
+		{ "FMN", LIGAND, 0xBEA06E },
+		{ "SAM", LIGAND, 0xBEA06E },
+		{ "COA", LIGAND, 0xBEA06E },
+		{ "GOL", LIGAND, 0xBEA06E },
+		{ "EDO", LIGAND, 0xBEA06E },
+		{ "PEG", LIGAND, 0xBEA06E },
+		{ "ACT", LIGAND, 0xBEA06E },
+		{ "SO4", LIGAND, 0xBEA06E },
+		{ "PO4", LIGAND, 0xBEA06E },
+		{ "NAG", LIGAND, 0xBEA06E },
+		{ "MAN", LIGAND, 0xBEA06E },
+		{ "BMA", LIGAND, 0xBEA06E },
+		{ "GAL", LIGAND, 0xBEA06E },
+		{ "GLC", LIGAND, 0xBEA06E },
+		{ "FUC", LIGAND, 0xBEA06E },
+		{ "NA", LIGAND, 0xBEA06E },
+		{ "K", LIGAND, 0xBEA06E },
+		{ "CL", LIGAND, 0xBEA06E },
+		{ "MG", LIGAND, 0xBEA06E },
+		{ "CA", LIGAND, 0xBEA06E },
+		{ "ZN", LIGAND, 0xBEA06E },
+		{ "FE", LIGAND, 0xBEA06E },
+		{ "MN", LIGAND, 0xBEA06E },
+		{ "CU", LIGAND, 0xBEA06E },
+		{ "CO", LIGAND, 0xBEA06E },
+		{ "NI", LIGAND, 0xBEA06E },
+		{ "CD", LIGAND, 0xBEA06E },
+		{ "IOD", LIGAND, 0xBEA06E },
+		{ "BR", LIGAND, 0xBEA06E }
+	};
+
+	const int NR_ELEMENTS = int(sizeof(ELEMENTS) / sizeof(ELEMENTS[0]));
+	const int NR_RESIDUES = int(sizeof(RESIDUES) / sizeof(RESIDUES[0]));
+
+	// PERFECT HASHING: a field of up to 4 characters is packed into a 32 bit key,
+	// the slot is the upper HASH_BITS bits of key * multiplier. The multipliers were
+	// searched for the tables above, the static_asserts below fail if a table is changed
+	// so that two keys share a slot; search a new multiplier then.
+
+	const int HASH_BITS = 10;
+	const int HASH_SLOTS = 1 << HASH_BITS;
+	const quint32 ELEMENT_MULTIPLIER = 0x6b0d549bu;
+	const quint32 RESIDUE_MULTIPLIER = 0xf29d0da9u;
+
+	// skips leading blanks, stops at the next blank or after 4 characters, upper case
+	constexpr quint32 packKey(const char *field, int width)
+	{
+		int i = 0;
+		while (i < width && field[i] == ' ') {
+			i++;
+		}
+		quint32 key = 0;
+		for (int shift = 0; i < width && shift < 32 && field[i] != ' ' && field[i] != '\0'; i++, shift += 8) {
+			const char c = field[i] >= 'a' && field[i] <= 'z' ? char(field[i] - 'a' + 'A') : field[i];
+			key |= quint32(quint8(c)) << shift;
+		}
+		return key;
+	}
+
+	constexpr int hashSlot(quint32 key, quint32 multiplier)
+	{
+		return int(quint32(key * multiplier) >> (32 - HASH_BITS));
+	}
+
+	struct HashTable
+	{
+		quint32 keys[HASH_SLOTS];
+		qint16 ids[HASH_SLOTS]; // -1 for empty slots
+	};
+
+	template <class Entry, int N>
+	constexpr HashTable buildTable(const Entry (&entries)[N], quint32 multiplier, int first)
+	{
+		HashTable table{};
+		for (int i = 0; i < HASH_SLOTS; i++) {
+			table.ids[i] = -1;
+		}
+		for (int i = first; i < N; i++) {
+			const quint32 key = packKey(entries[i].name, int(sizeof(entries[i].name)));
+			const int slot = hashSlot(key, multiplier);
+			table.keys[slot] = key;
+			table.ids[slot] = qint16(i);
+		}
+		return table;
+	}
+
+	// every entry owns its slot
+	template <class Entry, int N>
+	constexpr bool isPerfect(const HashTable &table, const Entry (&entries)[N], quint32 multiplier, int first)
+	{
+		for (int i = first; i < N; i++) {
+			const quint32 key = packKey(entries[i].name, int(sizeof(entries[i].name)));
+			if (key == 0 || table.ids[hashSlot(key, multiplier)] != i) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// element 0 (unknown) is not hashed
+	constexpr HashTable ELEMENT_TABLE = buildTable(ELEMENTS, ELEMENT_MULTIPLIER, 1);
+	constexpr HashTable RESIDUE_TABLE = buildTable(RESIDUES, RESIDUE_MULTIPLIER, 0);
+
+	static_assert(isPerfect(ELEMENT_TABLE, ELEMENTS, ELEMENT_MULTIPLIER, 1), "element symbols collide, change ELEMENT_MULTIPLIER");
+	static_assert(isPerfect(RESIDUE_TABLE, RESIDUES, RESIDUE_MULTIPLIER, 0), "residue names collide, change RESIDUE_MULTIPLIER");
+	static_assert(NR_ELEMENTS == 119, "elements are indexed by atomic number");
+
+	// id of the entry, -1 if the field is not in the table
+	inline int lookup(const HashTable &table, quint32 multiplier, const char *field, int width)
+	{
+		const quint32 key = packKey(field, width);
+		const int slot = hashSlot(key, multiplier);
+		return table.ids[slot] >= 0 && table.keys[slot] == key ? table.ids[slot] : -1;
+	}
+
+	inline glm::vec3 toColor(quint32 rgb)
+	{
+		return glm::vec3(float((rgb >> 16) & 0xFF), float((rgb >> 8) & 0xFF), float(rgb & 0xFF)) / 255.0f;
+	}
+}
+
+int AtomTables::elementId(const char *field, int width)
+{
+	const int id = lookup(ELEMENT_TABLE, ELEMENT_MULTIPLIER, field, width);
+	return id < 0 ? UNKNOWN_ELEMENT : id;
+}
+
+int AtomTables::residueId(const char *field, int width)
+{
+	return lookup(RESIDUE_TABLE, RESIDUE_MULTIPLIER, field, width);
+}
+
+int AtomTables::nrElements()
+{
+	return NR_ELEMENTS;
+}
+
+int AtomTables::nrResidues()
+{
+	return NR_RESIDUES;
+}
+
+QString AtomTables::elementSymbol(int elementId)
+{
+	return QString::fromLatin1(ELEMENTS[elementId].name);
+}
+
+float AtomTables::elementRadius(int elementId)
+{
+	return ELEMENTS[elementId].radius;
+}
+
+glm::vec3 AtomTables::elementColor(int elementId)
+{
+	return toColor(ELEMENTS[elementId].color);
+}
+
+QString AtomTables::residueName(int residueId)
+{
+	return residueId < 0 ? QString() : QString::fromLatin1(RESIDUES[residueId].name);
+}
+
+AtomTables::ResidueType AtomTables::residueType(int residueId)
+{
+	return residueId < 0 ? LIGAND : RESIDUES[residueId].type;
+}
+
+glm::vec3 AtomTables::residueColor(int residueId)
+{
+	return toColor(residueId < 0 ? 0xBEA06E : RESIDUES[residueId].color);
+}
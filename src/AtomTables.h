@@ -0,0 +1,45 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <QString>
+
+// Element and residue tables. Element ids are atomic numbers (0 for unknown elements),
+// residue ids index the residue table (-1 for unknown residues). The tables and their
+// perfect hashes are built at compile time, a lookup of a raw fixed column field hashes
+// its (at most 4) bytes once and compares a single key.
+class AtomTables
+{
+public:
+
+	enum ResidueType
+	{
+		AMINO_ACID,
+		NUCLEOTIDE,
+		WATER,
+		LIGAND // including ions
+	};
+
+	static const int UNKNOWN_ELEMENT = 0;
+	static const int HYDROGEN = 1;
+
+	// field of width bytes, blank padded on either side and case insensitive (e.g. " C", "Cl", "FE")
+	static int elementId(const char *field, int width);
+	static int residueId(const char *field, int width);
+
+	static int nrElements();
+	static int nrResidues();
+
+	static QString elementSymbol(int elementId);
+	static float elementRadius(int elementId); // van der Waals radius in Angstrom
+	static glm::vec3 elementColor(int elementId); // CPK
+
+	static QString residueName(int residueId);
+	static ResidueType residueType(int residueId);
+	static glm::vec3 residueColor(int residueId);
+};
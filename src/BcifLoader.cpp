@@ -0,0 +1,615 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "BcifLoader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QtEndian>
+
+#include "CifParser.h"
+#include "GzipDevice.h"
+#include "MessagePack.h"
+#include "PdbLoader.h"
+#include "SimdKernels.h"
+
+namespace
+{
+	typedef MessagePackReader::Bytes Bytes;
+
+	// initial buffer of inflated files
+	const qint64 INFLATE_BYTES = 1 << 22;
+
+	// rows of _atom_site, far beyond the largest structures; larger counts are corrupt data whose
+	// columns would be allocated before their decoding fails
+	const size_t MAX_ROWS = size_t(1) << 28;
+
+	enum EncodingKind
+	{
+		BYTE_ARRAY,
+		FIXED_POINT,
+		INTERVAL_QUANTIZATION,
+		RUN_LENGTH,
+		DELTA,
+		INTEGER_PACKING,
+		STRING_ARRAY
+	};
+
+	// element types of ByteArray
+	enum DataType
+	{
+		INT8 = 1,
+		INT16 = 2,
+		INT32 = 3,
+		UINT8 = 4,
+		UINT16 = 5,
+		UINT32 = 6,
+		FLOAT32 = 32,
+		FLOAT64 = 33
+	};
+
+	struct Encoding
+	{
+		EncodingKind kind = BYTE_ARRAY;
+		int type = 0; // ByteArray
+		double factor = 1.0; // FixedPoint
+		double min = 0.0; // IntervalQuantization
+		double max = 0.0;
+		int nrSteps = 0;
+		int origin = 0; // Delta
+		int byteCount = 4; // IntegerPacking
+		bool isUnsigned = false;
+		size_t srcSize = 0; // RunLength, IntegerPacking
+
+		// StringArray: the data are indices of the strings, which end at the following offset
+		std::vector<Encoding> dataEncoding;
+		std::vector<Encoding> offsetEncoding;
+		Bytes stringData = { nullptr, 0 };
+		Bytes offsets = { nullptr, 0 };
+	};
+
+	// decoded values of a column
+	struct Column
+	{
+		enum Type
+		{
+			INTS,
+			FLOATS,
+			STRINGS // ints are indices of the strings
+		};
+
+		Type type = INTS;
+		std::vector<int32_t> ints;
+		std::vector<float> floats;
+		Bytes strings = { nullptr, 0 };
+		std::vector<int32_t> offsets;
+		std::vector<int32_t> mask; // empty if all values are present, 0 for present values
+
+		size_t size() const { return type == FLOATS ? floats.size() : ints.size(); }
+		bool isNull(size_t i) const { return !mask.empty() && mask[i] != 0; }
+
+		// text of a string, null for numbers
+		CifParser::Value text(size_t i) const
+		{
+			CifParser::Value value = { nullptr, 0 };
+			if (type != STRINGS || isNull(i)) {
+				return value;
+			}
+			const int32_t string = ints[i];
+			if (string >= 0 && size_t(string) + 1 < offsets.size()) {
+				const int32_t first = offsets[string];
+				const int32_t last = offsets[string + 1];
+				if (first >= 0 && first <= last && size_t(last) <= strings.size) {
+					value.text = strings.data + first;
+					value.length = int(last - first);
+				}
+			}
+			return value;
+		}
+
+		// false for null values and text that is no number
+		bool number(size_t i, float &value) const
+		{
+			if (isNull(i)) {
+				return false;
+			}
+			if (type == FLOATS) {
+				value = floats[i];
+				return true;
+			}
+			if (type == INTS) {
+				value = float(ints[i]);
+				return true;
+			}
+			const CifParser::Value t = text(i);
+			return t.text && PdbParser::parseFloat(t.text, t.text + t.length, value);
+		}
+	};
+
+	// reads the map header and the keys up to key, the reader is left at its value
+	bool findKey(MessagePackReader &reader, const char *key)
+	{
+		const size_t nrPairs = reader.readMap();
+		for (size_t i = 0; i < nrPairs && reader.ok(); i++) {
+			if (reader.readString() == key) {
+				return true;
+			}
+			reader.skip();
+		}
+		return false;
+	}
+
+	bool readEncodings(MessagePackReader &reader, std::vector<Encoding> &encodings)
+	{
+		const size_t nrEncodings = reader.readArray();
+		encodings.resize(nrEncodings);
+		for (size_t e = 0; e < nrEncodings && reader.ok(); e++) {
+			Encoding &encoding = encodings[e];
+			bool hasKind = false;
+
+			const size_t nrPairs = reader.readMap();
+			for (size_t i = 0; i < nrPairs && reader.ok(); i++) {
+				const Bytes key = reader.readString();
+				if (key == "kind") {
+					const Bytes kind = reader.readString();
+					hasKind = true;
+					if (kind == "ByteArray") encoding.kind = BYTE_ARRAY;
+					else if (kind == "FixedPoint") encoding.kind = FIXED_POINT;
+					else if (kind == "IntervalQuantization") encoding.kind = INTERVAL_QUANTIZATION;
+					else if (kind == "RunLength") encoding.kind = RUN_LENGTH;
+					else if (kind == "Delta") encoding.kind = DELTA;
+					else if (kind == "IntegerPacking") encoding.kind = INTEGER_PACKING;
+					else if (kind == "StringArray") encoding.kind = STRING_ARRAY;
+					else {
+						qCritical() << "Unknown BinaryCIF encoding" << QString::fromLatin1(kind.data, int(kind.size));
+						return false;
+					}
+				}
+				else if (key == "type") encoding.type = int(reader.readInt());
+				else if (key == "factor") encoding.factor = reader.readDouble();
+				else if (key == "min") encoding.min = reader.readDouble();
+				else if (key == "max") encoding.max = reader.readDouble();
+				else if (key == "numSteps") encoding.nrSteps = int(reader.readInt());
+				else if (key == "origin") encoding.origin = int(reader.readInt());
+				else if (key == "byteCount") encoding.byteCount = int(reader.readInt());
+				else if (key == "isUnsigned") encoding.isUnsigned = reader.readBool();
+				else if (key == "srcSize") encoding.srcSize = size_t(reader.readInt());
+				else if (key == "dataEncoding") readEncodings(reader, encoding.dataEncoding);
+				else if (key == "offsetEncoding") readEncodings(reader, encoding.offsetEncoding);
+				else if (key == "stringData") encoding.stringData = reader.readString();
+				else if (key == "offsets") encoding.offsets = reader.readBinary();
+				else reader.skip(); // srcType
+			}
+			if (!hasKind) {
+				return false;
+			}
+		}
+		return reader.ok();
+	}
+
+	// at most maxSize values, sizes read from the file are checked before they are allocated
+	bool decode(Bytes data, const std::vector<Encoding> &encodings, size_t maxSize, Column &column)
+	{
+		// the encodings were applied in order and are undone in reverse
+		bool isDecoded = false;
+		for (auto e = encodings.rbegin(); e != encodings.rend(); ++e) {
+			if ((e->kind == BYTE_ARRAY || e->kind == STRING_ARRAY) == isDecoded) {
+				return false;
+			}
+
+			switch (e->kind) {
+			case BYTE_ARRAY: {
+				if (e->type == FLOAT32 || e->type == FLOAT64) {
+					const size_t width = e->type == FLOAT32 ? 4 : 8;
+					const size_t count = data.size / width;
+					column.type = Column::FLOATS;
+					column.floats.resize(count);
+					for (size_t i = 0; i < count; i++) {
+						if (width == 4) {
+							const quint32 bits = qFromLittleEndian<quint32>(data.data + i * 4);
+							std::memcpy(&column.floats[i], &bits, sizeof(float));
+						}
+						else {
+							const quint64 bits = qFromLittleEndian<quint64>(data.data + i * 8);
+							double value;
+							std::memcpy(&value, &bits, sizeof(double));
+							column.floats[i] = float(value);
+						}
+					}
+				}
+				else if (e->type >= INT8 && e->type <= UINT32) {
+					const bool isUnsigned = e->type >= UINT8;
+					const int width = 1 << ((e->type - 1) % 3);
+					const size_t count = data.size / width;
+					column.type = Column::INTS;
+					column.ints.resize(count);
+					SimdKernels::toInt32(data.data, width, isUnsigned, count, column.ints.data());
+				}
+				else {
+					return false;
+				}
+				isDecoded = true;
+				break;
+			}
+			case FIXED_POINT:
+			case INTERVAL_QUANTIZATION: {
+				if (column.type != Column::INTS) {
+					return false;
+				}
+				column.floats.resize(column.ints.size());
+				if (e->kind == FIXED_POINT) {
+					SimdKernels::fixedToFloat(column.ints.data(), column.ints.size(), float(e->factor), column.floats.data());
+				}
+				else {
+					const double step = e->nrSteps > 1 ? (e->max - e->min) / (e->nrSteps - 1) : 0.0;
+					for (size_t i = 0; i < column.ints.size(); i++) {
+						column.floats[i] = float(e->min + step * column.ints[i]);
+					}
+				}
+				column.type = Column::FLOATS;
+				column.ints.clear();
+				break;
+			}
+			case RUN_LENGTH: {
+				if (column.type != Column::INTS || e->srcSize > maxSize) {
+					return false;
+				}
+				std::vector<int32_t> values(e->srcSize);
+				values.resize(SimdKernels::expandRuns(column.ints.data(), column.ints.size() / 2, values.data(), values.size()));
+				column.ints.swap(values);
+				break;
+			}
+			case DELTA: {
+				if (column.type != Column::INTS) {
+					return false;
+				}
+				SimdKernels::prefixSum(column.ints.data(), column.ints.size(), e->origin);
+				break;
+			}
+			case INTEGER_PACKING: {
+				// every value takes at least one packed element
+				if (column.type != Column::INTS || e->srcSize > column.ints.size()) {
+					return false;
+				}
+				// values beyond the packed range are sums of limit values and a remainder
+				const int32_t upper = e->byteCount == 1 ? (e->isUnsigned ? 0xff : 0x7f) : (e->isUnsigned ? 0xffff : 0x7fff);
+				const int32_t lower = e->isUnsigned ? upper : -upper - 1;
+				std::vector<int32_t> values(e->srcSize);
+				const size_t j = SimdKernels::unpackIntegers(column.ints.data(), column.ints.size(), upper, lower,
+					values.data(), values.size());
+				values.resize(j);
+				column.ints.swap(values);
+				break;
+			}
+			case STRING_ARRAY: {
+				Column indices;
+				Column offsets;
+				// an offset per string and the end of the last one, the strings are unique so at most one is empty
+				if (!decode(data, e->dataEncoding, maxSize, indices)
+					|| !decode(e->offsets, e->offsetEncoding, e->stringData.size + 2, offsets)
+					|| indices.type != Column::INTS || offsets.type != Column::INTS) {
+					return false;
+				}
+				column.type = Column::STRINGS;
+				column.ints.swap(indices.ints);
+				column.offsets.swap(offsets.ints);
+				column.strings = e->stringData;
+				isDecoded = true;
+				break;
+			}
+			}
+		}
+		return isDecoded;
+	}
+
+	// a map of binary data and its encodings
+	bool decodeData(MessagePackReader reader, size_t maxSize, Column &column)
+	{
+		Bytes data = { nullptr, 0 };
+		std::vector<Encoding> encodings;
+		const size_t nrPairs = reader.readMap();
+		for (size_t i = 0; i < nrPairs && reader.ok(); i++) {
+			const Bytes key = reader.readString();
+			if (key == "data") {
+				data = reader.readBinary();
+			}
+			else if (key == "encoding") {
+				if (!readEncodings(reader, encodings)) {
+					return false;
+				}
+			}
+			else {
+				reader.skip();
+			}
+		}
+		return reader.ok() && data.data && decode(data, encodings, maxSize, column);
+	}
+
+	struct EncodedColumn
+	{
+		const char *data = nullptr; // position of the data and mask maps in the file
+		const char *mask = nullptr;
+	};
+
+	// a column of nrRows values
+	bool decodeColumn(const EncodedColumn &encoded, const char *end, size_t nrRows, Column &column)
+	{
+		if (!decodeData(MessagePackReader(encoded.data, end), nrRows, column)) {
+			return false;
+		}
+		if (encoded.mask) {
+			Column mask;
+			if (!decodeData(MessagePackReader(encoded.mask, end), nrRows, mask) || mask.type != Column::INTS
+				|| mask.ints.size() != column.size()) {
+				return false;
+			}
+			column.mask.swap(mask.ints);
+		}
+		return true;
+	}
+
+	// the preferred encoded _atom_site column of each field of CifParser
+	bool findAtomSite(MessagePackReader &reader, size_t &nrRows, EncodedColumn columns[CifParser::NR_FIELDS])
+	{
+		if (!findKey(reader, "dataBlocks") || reader.readArray() == 0 || !findKey(reader, "categories")) {
+			return false;
+		}
+
+		const size_t nrCategories = reader.readArray();
+		for (size_t c = 0; c < nrCategories && reader.ok(); c++) {
+			Bytes name = { nullptr, 0 };
+			const char *columnList = nullptr;
+			size_t rowCount = 0;
+
+			const size_t nrPairs = reader.readMap();
+			for (size_t i = 0; i < nrPairs && reader.ok(); i++) {
+				const Bytes key = reader.readString();
+				if (key == "name") {
+					name = reader.readString();
+				}
+				else if (key == "rowCount") {
+					rowCount = size_t(reader.readInt());
+				}
+				else {
+					if (key == "columns") {
+						columnList = reader.position();
+					}
+					reader.skip();
+				}
+			}
+			if (name.size > 0 && name.data[0] == '_') {
+				name.data++;
+				name.size--;
+			}
+			if (name != "atom_site" || !columnList) {
+				continue;
+			}
+
+			// the same column ranks as the tags of an mmCIF loop
+			int ranks[CifParser::NR_FIELDS];
+			std::fill(ranks, ranks + CifParser::NR_FIELDS, -1);
+			MessagePackReader list(columnList, reader.position());
+			const size_t nrColumns = list.readArray();
+			for (size_t k = 0; k < nrColumns && list.ok(); k++) {
+				Bytes columnName = { nullptr, 0 };
+				EncodedColumn column;
+				const size_t nrColumnPairs = list.readMap();
+				for (size_t i = 0; i < nrColumnPairs && list.ok(); i++) {
+					const Bytes key = list.readString();
+					if (key == "name") {
+						columnName = list.readString();
+					}
+					else if (key == "data") {
+						column.data = list.position();
+						list.skip();
+					}
+					else if (key == "mask" && list.type() != MessagePackReader::NIL) {
+						column.mask = list.position();
+						list.skip();
+					}
+					else {
+						list.skip();
+					}
+				}
+
+				const int rank = columnName.data ? CifParser::atomSiteColumn(columnName.data, columnName.data + columnName.size) : -1;
+				if (rank >= 0 && column.data) {
+					const int field = CifParser::columnField(rank);
+					if (ranks[field] < 0 || rank < ranks[field]) {
+						ranks[field] = rank;
+						columns[field] = column;
+					}
+				}
+			}
+
+			nrRows = rowCount;
+			return list.ok() && columns[CifParser::X].data && columns[CifParser::Y].data && columns[CifParser::Z].data;
+		}
+		return false;
+	}
+
+	// progress counts the columns and the stored rows as one more step
+	bool decodeAtoms(const QString &path, const char *begin, const char *end, PdbAtoms &atoms, LoadProgress *progress)
+	{
+		MessagePackReader reader(begin, end);
+
+		size_t nrRows = 0;
+		EncodedColumn encoded[CifParser::NR_FIELDS];
+		if (!findAtomSite(reader, nrRows, encoded)) {
+			qCritical() << "No _atom_site coordinates in BinaryCIF file: " << path;
+			return false;
+		}
+		if (nrRows > MAX_ROWS) {
+			qCritical() << "Invalid _atom_site row count in BinaryCIF file: " << path;
+			return false;
+		}
+
+		Column columns[CifParser::NR_FIELDS];
+		for (int field = 0; field < CifParser::NR_FIELDS; field++) {
+			if (progress && progress->canceled) {
+				return false;
+			}
+			if (encoded[field].data && (!decodeColumn(encoded[field], end, nrRows, columns[field]) || columns[field].size() != nrRows)) {
+				qCritical() << "Error decoding _atom_site column" << field << "of" << path;
+				return false;
+			}
+			if (progress) {
+				progress->done++;
+			}
+		}
+		if (progress && progress->canceled) {
+			return false;
+		}
+
+		// HETATM records are only read for 3irl
+		const bool includeHetatm = path.contains("3irl");
+		atoms.reserve(atoms.size() + nrRows);
+		CifParser::Value values[CifParser::NR_FIELDS];
+		for (size_t row = 0; row < nrRows; row++) {
+			float x, y, z;
+			if (!columns[CifParser::X].number(row, x) || !columns[CifParser::Y].number(row, y)
+				|| !columns[CifParser::Z].number(row, z)) {
+				atoms.malformedLines++;
+				continue;
+			}
+			float number;
+			const int residueNumber = columns[CifParser::RESIDUE_NUMBER].size() > 0
+				&& columns[CifParser::RESIDUE_NUMBER].number(row, number) ? int(number) : 0;
+
+			for (int field = 0; field < CifParser::NR_FIELDS; field++) {
+				values[field] = columns[field].size() > 0 ? columns[field].text(row) : CifParser::Value{ nullptr, 0 };
+			}
+			CifParser::storeAtom(values, residueNumber, x, y, z, includeHetatm, atoms);
+		}
+		if (progress) {
+			progress->done++;
+		}
+
+		if (atoms.unknownSymbols > 0) {
+			qDebug() << path << ":" << atoms.unknownSymbols << "atoms with unknown symbols";
+		}
+		if (atoms.malformedLines > 0) {
+			qWarning() << path << ":" << atoms.malformedLines << "_atom_site rows without coordinates skipped";
+		}
+		return true;
+	}
+
+	// the decoder needs the whole MessagePack document, a .bcif.gz file is inflated into memory;
+	// progress counts the blocks of the file on disk
+	bool inflateFile(const QString &path, std::vector<char> &content, LoadProgress *progress)
+	{
+		GzipDevice file(path);
+
+		if (!file.open(QIODevice::ReadOnly)) {
+			qCritical() << "Error loading file: " << file.errorString();
+			return false;
+		}
+
+		// BinaryCIF compresses to about half
+		content.resize(size_t(std::max(file.compressedSize() * 2, INFLATE_BYTES)));
+		size_t size = 0;
+		for (;;) {
+			if (progress && progress->canceled) {
+				return false;
+			}
+			if (size == content.size()) {
+				content.resize(content.size() * 2);
+			}
+			const qint64 read = file.read(content.data() + size, qint64(std::min(content.size() - size, size_t(INFLATE_BYTES))));
+			if (read < 0) {
+				qCritical() << "Error reading file: " << file.errorString();
+				return false;
+			}
+			if (progress) {
+				progress->done = size_t((file.compressedPos() + INFLATE_BYTES - 1) / INFLATE_BYTES);
+			}
+			if (read == 0) {
+				break;
+			}
+			size += size_t(read);
+		}
+		content.resize(size);
+		return true;
+	}
+
+	// progress counts the inflated blocks of a compressed file, then the decoding steps
+	bool parseFile(const QString &path, PdbAtoms &atoms, LoadProgress *progress)
+	{
+		QElapsedTimer timer;
+		timer.start();
+
+		const bool compressed = GzipDevice::isCompressed(path);
+		const size_t inflatedBlocks = compressed ? size_t((QFileInfo(path).size() + INFLATE_BYTES - 1) / INFLATE_BYTES) : 0;
+		if (progress) {
+			progress->total = inflatedBlocks + CifParser::NR_FIELDS + 1;
+		}
+
+		bool decoded;
+		if (compressed) {
+			std::vector<char> content;
+			if (!inflateFile(path, content, progress)) {
+				return false;
+			}
+			if (progress) {
+				progress->done = inflatedBlocks;
+			}
+			decoded = decodeAtoms(path, content.data(), content.data() + content.size(), atoms, progress);
+		}
+		else {
+			QFile file(path);
+
+			if (!file.open(QIODevice::ReadOnly)) {
+				qCritical() << "Error loading file: " << file.errorString();
+				return false;
+			}
+
+			const qint64 size = file.size();
+			const uchar *data = size > 0 ? file.map(0, size) : nullptr;
+			if (!data) {
+				qCritical() << "Error mapping file: " << path;
+				return false;
+			}
+
+			const char *begin = reinterpret_cast<const char *>(data);
+			decoded = decodeAtoms(path, begin, begin + size, atoms, progress);
+			file.unmap(const_cast<uchar *>(data));
+		}
+
+		if (decoded) {
+			qInfo() << "Decoded" << atoms.size() << "atoms of" << path << "in" << timer.elapsed() << "ms";
+		}
+		return decoded;
+	}
+}
+
+bool BcifLoader::readData(QString &path, Trajectory &trajectory, LoadProgress *progress)
+{
+	std::vector<PdbAtoms> blocks(1);
+	if (!parseFile(path, blocks[0], progress)) {
+		return false;
+	}
+
+	if (!PdbLoader::storeAtoms(blocks, trajectory)) {
+		qCritical() << "No atoms in file: " << path;
+		return false;
+	}
+	return true;
+}
+
+bool BcifLoader::readAtomData(QString &path, std::vector<Atom> &atoms, StringPool &strings)
+{
+	PdbAtoms parsed;
+	if (!parseFile(path, parsed, nullptr)) {
+		return false;
+	}
+
+	PdbLoader::storeAtoms(parsed, atoms, strings);
+	return true;
+}
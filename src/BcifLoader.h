@@ -0,0 +1,32 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <vector>
+#include <QString>
+
+#include "Commons.h"
+#include "LoadProgress.h"
+#include "StringPool.h"
+#include "Trajectory.h"
+
+// Loader of BinaryCIF structures: the mmCIF categories as MessagePack with every column
+// encoded on its own (ByteArray, FixedPoint, IntervalQuantization, RunLength, Delta,
+// IntegerPacking, StringArray). The file is mapped, only the _atom_site columns read by
+// CifParser are decoded into typed arrays, the atoms are filtered and stored like in mmCIF
+// files. The first data block is read.
+// https://github.com/molstar/BinaryCIF
+class BcifLoader
+{
+public:
+	// trajectory of one frame, see PdbLoader::readData; progress counts the inflated blocks and
+	// the decoded columns and may cancel the load
+	static bool readData(QString &path, Trajectory &trajectory, LoadProgress *progress = nullptr);
+
+	// appends the atoms of the file, their names are interned in strings
+	static bool readAtomData(QString &path, std::vector<Atom> &atoms, StringPool &strings);
+};
@@ -21,6 +21,7 @@ Camera::~Camera(void)
 void Camera::reset()
 {
 	mRadius = 2.0f;
+	mZoomStep = 1.0f;
 	mAzimuth = 0.0f;
 	mPolar = M_PI / 2.0f;
 
@@ -75,6 +76,7 @@ void Camera::zoom(float t)
 
     /*/
     // zoom by changing position
+    t *= mZoomStep;
     mRadius -= t;
     if (mRadius < 1.0f)
         mRadius = 1.0f;
@@ -85,6 +87,17 @@ void Camera::zoom(float t)
     //*/
 }
 
+void Camera::fitSphere(float radius)
+{
+	radius = glm::max(radius, 1.0f);
+	mRadius = radius / sinf(glm::radians(mFieldOfView) * 0.5f);
+	mZoomStep = glm::max(radius / 50.0f, 1.0f);
+	mNear = glm::max(radius * 0.001f, 0.01f);
+	mFar = glm::max(mRadius + radius * 2.0f, 1000.0f);
+	buildViewMatrix();
+	buildProjectionMatrix();
+}
+
 void Camera::rotateAzimuth(float t)
 {
 	mAzimuth += t;
@@ -42,6 +42,10 @@ public:
 
     void zoom(float t);
 
+    // moves the camera so that a sphere of the radius around the target fills the view,
+    // adapts the clipping planes and the zoom speed to its size
+    void fitSphere(float radius);
+
     glm::vec3 getUp() { return mUp; };
     void setUp(glm::vec3 &up) { mUp = up; };
     glm::vec3 getTarget() { return mTarget; };
@@ -69,6 +73,7 @@ private:
     glm::mat4 mProjectionMatrix;
 
     float mRadius;
+    float mZoomStep;
     float mAzimuth;
     float mPolar;
 
@@ -0,0 +1,125 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "CifLoader.h"
+
+#include <cstring>
+#include <memory>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include "CifParser.h"
+#include "GzipDevice.h"
+#include "PdbLoader.h"
+
+namespace
+{
+	// read buffer, only a row longer than a block makes it grow
+	const qint64 BLOCK_BYTES = 1 << 22;
+
+	// to estimate the number of atoms of a file, _atom_site rows take about 80 to 100 bytes
+	const qint64 ROW_BYTES = 80;
+
+	// gzip compresses mmCIF files to about a fifth
+	const qint64 COMPRESSION_RATIO = 5;
+
+	bool parseFile(const QString &path, PdbAtoms &atoms, LoadProgress *progress)
+	{
+		// .cif.gz files are inflated while parsing
+		GzipDevice *gzip = GzipDevice::isCompressed(path) ? new GzipDevice(path) : nullptr;
+		std::unique_ptr<QIODevice> file(gzip ? static_cast<QIODevice *>(gzip) : new QFile(path));
+
+		if (!file->open(QIODevice::ReadOnly)) {
+			qCritical() << "Error loading file: " << file->errorString();
+			return false;
+		}
+
+		QElapsedTimer timer;
+		timer.start();
+
+		// progress counts blocks of the file on disk, compressed or not
+		const qint64 size = QFileInfo(path).size();
+		if (progress) {
+			progress->total = size_t((size + BLOCK_BYTES - 1) / BLOCK_BYTES);
+		}
+		atoms.reserve(size_t((gzip ? size * COMPRESSION_RATIO : size) / ROW_BYTES) + 1);
+
+		// HETATM records are only read for 3irl
+		CifParser parser(path.contains("3irl"));
+		std::vector<char> buffer(BLOCK_BYTES);
+		size_t carried = 0;
+		qint64 parsed = 0;
+		for (bool last = false; !last; ) {
+			if (progress && progress->canceled) {
+				return false;
+			}
+
+			const qint64 read = file->read(buffer.data() + carried, qint64(buffer.size() - carried));
+			if (read < 0) {
+				qCritical() << "Error reading file: " << file->errorString();
+				return false;
+			}
+			last = read == 0; // errors of compressed files arrive with the read after the last data
+			parsed += read;
+
+			// the unfinished row at the end of the block is moved to the front of the buffer
+			const char *begin = buffer.data();
+			const char *end = begin + carried + size_t(read);
+			const char *rest = parser.parse(begin, end, last, atoms);
+			carried = size_t(end - rest);
+			std::memmove(buffer.data(), rest, carried);
+			if (carried == buffer.size()) {
+				buffer.resize(buffer.size() * 2);
+			}
+
+			if (progress) {
+				progress->done = size_t(((gzip ? gzip->compressedPos() : file->pos()) + BLOCK_BYTES - 1) / BLOCK_BYTES);
+			}
+		}
+
+		if (!parser.hasAtomSite()) {
+			qCritical() << "No _atom_site loop in file: " << path;
+			return false;
+		}
+		if (atoms.unknownSymbols > 0) {
+			qDebug() << path << ":" << atoms.unknownSymbols << "atoms with unknown symbols";
+		}
+		if (atoms.malformedLines > 0) {
+			qWarning() << path << ":" << atoms.malformedLines << "malformed _atom_site rows skipped";
+		}
+		const qint64 elapsed = timer.elapsed();
+		qInfo() << "Parsed" << atoms.size() << "atoms of" << path << "in" << elapsed << "ms,"
+			<< (elapsed > 0 ? parsed / 1000 / elapsed : 0) << "MB/s";
+		return true;
+	}
+}
+
+bool CifLoader::readData(QString &path, Trajectory &trajectory, LoadProgress *progress)
+{
+	std::vector<PdbAtoms> blocks(1);
+	if (!parseFile(path, blocks[0], progress)) {
+		return false;
+	}
+
+	if (!PdbLoader::storeAtoms(blocks, trajectory)) {
+		qCritical() << "No atoms in file: " << path;
+		return false;
+	}
+	return true;
+}
+
+bool CifLoader::readAtomData(QString &path, std::vector<Atom> &atoms, StringPool &strings)
+{
+	PdbAtoms parsed;
+	if (!parseFile(path, parsed, nullptr)) {
+		return false;
+	}
+
+	PdbLoader::storeAtoms(parsed, atoms, strings);
+	return true;
+}
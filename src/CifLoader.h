@@ -0,0 +1,28 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <vector>
+#include <QString>
+
+#include "Commons.h"
+#include "LoadProgress.h"
+#include "StringPool.h"
+#include "Trajectory.h"
+
+// Loader of mmCIF (PDBx) structures, the format of entries too large for PDB files.
+// The file is read once in blocks of fixed size through CifParser, the memory used besides
+// the atoms does not depend on the file size. The atoms are stored like PdbLoader does.
+class CifLoader
+{
+public:
+	// trajectory of one frame, progress counts the blocks read and may cancel the load
+	static bool readData(QString &path, Trajectory &trajectory, LoadProgress *progress = nullptr);
+
+	// appends the atoms of the file, their names are interned in strings
+	static bool readAtomData(QString &path, std::vector<Atom> &atoms, StringPool &strings);
+};
@@ -0,0 +1,377 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "CifParser.h"
+
+#include "AtomTables.h"
+#include "SimdKernels.h"
+
+#include <cstring>
+
+// CIF syntax as far as it is needed to skip everything but the _atom_site loop:
+//   tokens are separated by blanks, # starts a comment up to the end of the line
+//   values are bare, quoted with ' or " (the quote ends before a blank) or text fields
+//   from a line starting with ; up to the next line starting with ;
+//   . and ? are null values, loop_ is followed by tags (_category.column) and their values row by row
+
+const CifParser::Column CifParser::COLUMNS[] = {
+	{ "group_pdb", GROUP },
+	{ "type_symbol", SYMBOL },
+	{ "auth_atom_id", ATOM_NAME },
+	{ "label_atom_id", ATOM_NAME },
+	{ "auth_comp_id", RESIDUE_NAME },
+	{ "label_comp_id", RESIDUE_NAME },
+	{ "auth_asym_id", CHAIN },
+	{ "label_asym_id", CHAIN },
+	{ "auth_seq_id", RESIDUE_NUMBER },
+	{ "label_seq_id", RESIDUE_NUMBER },
+	{ "pdbx_pdb_ins_code", INSERTION_CODE },
+	{ "cartn_x", X },
+	{ "cartn_y", Y },
+	{ "cartn_z", Z }
+};
+
+namespace
+{
+	const int NR_COLUMNS = 14;
+	const char ATOM_SITE[] = "_atom_site.";
+
+	enum Scan
+	{
+		TOKEN,
+		NO_TOKEN, // only blanks and comments are left
+		INCOMPLETE // the token may continue in the next block
+	};
+
+	struct Token
+	{
+		const char *start; // first byte, including quote or semicolon
+		const char *begin; // value
+		const char *end;
+		bool quoted;
+	};
+
+	inline bool isBlank(char c)
+	{
+		return static_cast<unsigned char>(c) <= ' ';
+	}
+
+	inline char toLower(char c)
+	{
+		return c >= 'A' && c <= 'Z' ? char(c - 'A' + 'a') : c;
+	}
+
+	// case insensitive, prefix is lower case
+	inline bool startsWith(const char *begin, const char *end, const char *prefix)
+	{
+		for (; *prefix; prefix++, begin++) {
+			if (begin == end || toLower(*begin) != *prefix) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	inline bool equals(const char *begin, const char *end, const char *text)
+	{
+		return size_t(end - begin) == std::strlen(text) && startsWith(begin, end, text);
+	}
+
+	// tags and reserved words end a loop
+	inline bool isReserved(const Token &token)
+	{
+		return !token.quoted && (token.begin[0] == '_' || startsWith(token.begin, token.end, "loop_")
+			|| startsWith(token.begin, token.end, "data_") || startsWith(token.begin, token.end, "save_")
+			|| startsWith(token.begin, token.end, "global_") || startsWith(token.begin, token.end, "stop_"));
+	}
+
+	inline bool isNull(const Token &token)
+	{
+		return !token.quoted && token.end - token.begin == 1 && (token.begin[0] == '.' || token.begin[0] == '?');
+	}
+
+	// the token starting at or after p, p is advanced behind it; an unfinished token or comment
+	// at the end of a block that is not the last one is left to the next block
+	Scan nextToken(const char *&p, const char *begin, const char *end, bool beginsLine, bool last, Token &token)
+	{
+		for (;;) {
+			p = SimdKernels::skipBlanks(p, end);
+			if (p == end) {
+				return NO_TOKEN;
+			}
+			const bool lineStart = p == begin ? beginsLine : p[-1] == '\n';
+
+			if (*p == '#') {
+				const char *newline = static_cast<const char *>(std::memchr(p, '\n', end - p));
+				if (!newline && !last) {
+					return INCOMPLETE;
+				}
+				p = newline ? newline + 1 : end;
+				continue;
+			}
+
+			token.start = p;
+
+			if (*p == ';' && lineStart) {
+				for (const char *q = p + 1; ; ) {
+					const char *newline = static_cast<const char *>(std::memchr(q, '\n', end - q));
+					if (!newline || newline + 1 == end) {
+						if (!last) {
+							return INCOMPLETE;
+						}
+						// unterminated text field
+						token.begin = p + 1;
+						token.end = end;
+						token.quoted = true;
+						p = end;
+						return TOKEN;
+					}
+					if (newline[1] == ';') {
+						token.begin = p + 1;
+						token.end = newline > token.begin && newline[-1] == '\r' ? newline - 1 : newline;
+						token.quoted = true;
+						p = newline + 2;
+						return TOKEN;
+					}
+					q = newline + 1;
+				}
+			}
+
+			if (*p == '\'' || *p == '"') {
+				const char quote = *p;
+				const char *q = p + 1;
+				for (; q < end && *q != '\n'; q++) {
+					if (*q == quote && (q + 1 < end ? isBlank(q[1]) : last)) {
+						token.begin = p + 1;
+						token.end = q;
+						token.quoted = true;
+						p = q + 1;
+						return TOKEN;
+					}
+				}
+				if (q == end && !last) {
+					return INCOMPLETE;
+				}
+				// a quote without end is read as a bare value
+			}
+
+			const char *q = SimdKernels::findBlank(p, end);
+			if (q == end && !last) {
+				return INCOMPLETE;
+			}
+			token.begin = p;
+			token.end = q;
+			token.quoted = false;
+			p = q;
+			return TOKEN;
+		}
+	}
+
+	// copies the value into a field of width bytes, blank padded
+	inline void copyValue(const char *text, int length, char *dst, int width)
+	{
+		for (int i = 0; i < width; i++) {
+			dst[i] = text && i < length ? text[i] : ' ';
+		}
+	}
+}
+
+CifParser::CifParser(bool includeHetatm)
+	: m_includeHetatm(includeHetatm), m_hasAtomSite(false), m_beginsLine(true), m_state(OUTSIDE_LOOP),
+	m_nrTags(0), m_tag(0), m_rowStart(nullptr)
+{
+	static_assert(sizeof(COLUMNS) / sizeof(COLUMNS[0]) == NR_COLUMNS, "NR_COLUMNS does not match COLUMNS");
+}
+
+const char *CifParser::parse(const char *begin, const char *end, bool last, PdbAtoms &atoms)
+{
+	const char *p = begin;
+	const char *rest = end;
+
+	Token token;
+	for (;;) {
+		const Scan scan = nextToken(p, begin, end, m_beginsLine, last, token);
+		if (scan == NO_TOKEN) {
+			break;
+		}
+		if (scan == INCOMPLETE) {
+			rest = p;
+			break;
+		}
+
+		if (isReserved(token)) {
+			if (m_state == ATOM_ROWS && m_tag > 0) {
+				atoms.malformedLines++;
+				m_tag = 0;
+			}
+			if (m_state == LOOP_TAGS && token.begin[0] == '_') {
+				addTag(token.begin, token.end);
+			}
+			else if (startsWith(token.begin, token.end, "loop_")) {
+				beginLoop();
+			}
+			else {
+				// values of tags outside of loops are skipped as well
+				m_state = OUTSIDE_LOOP;
+			}
+			continue;
+		}
+
+		if (m_state == LOOP_TAGS) {
+			endTags();
+		}
+		if (m_state != ATOM_ROWS) {
+			continue;
+		}
+
+		if (m_tag == 0) {
+			m_rowStart = token.start;
+		}
+		const int field = m_tagFields[m_tag];
+		if (field >= 0) {
+			m_values[field].text = isNull(token) ? nullptr : token.begin;
+			m_values[field].length = int(token.end - token.begin);
+		}
+		if (++m_tag == m_nrTags) {
+			storeRow(atoms);
+			m_tag = 0;
+		}
+	}
+
+	// the values of an unfinished row point into this block, the row is read again from its first value
+	if (m_state == ATOM_ROWS && m_tag > 0) {
+		if (last) {
+			atoms.malformedLines++;
+		}
+		else {
+			rest = m_rowStart;
+		}
+		m_tag = 0;
+	}
+
+	m_beginsLine = rest == begin ? m_beginsLine : rest[-1] == '\n';
+	return rest;
+}
+
+void CifParser::beginLoop()
+{
+	m_state = LOOP_TAGS;
+	m_nrTags = 0;
+	m_tagFields.clear();
+	m_namedTags.assign(NR_COLUMNS, -1);
+}
+
+void CifParser::addTag(const char *begin, const char *end)
+{
+	const int tag = m_nrTags++;
+	m_tagFields.push_back(-1);
+
+	if (!startsWith(begin, end, ATOM_SITE)) {
+		return;
+	}
+	const int column = atomSiteColumn(begin + sizeof(ATOM_SITE) - 1, end);
+	if (column >= 0 && m_namedTags[column] < 0) {
+		m_namedTags[column] = tag;
+	}
+}
+
+void CifParser::endTags()
+{
+	// the first column present of each field is read
+	bool isRead[NR_FIELDS] = {};
+	for (int i = 0; i < NR_COLUMNS; i++) {
+		const Field field = COLUMNS[i].field;
+		if (m_namedTags[i] >= 0 && !isRead[field]) {
+			m_tagFields[m_namedTags[i]] = field;
+			isRead[field] = true;
+		}
+	}
+	for (int field = 0; field < NR_FIELDS; field++) {
+		m_values[field].text = nullptr;
+		m_values[field].length = 0;
+	}
+
+	const bool isAtomSite = isRead[X] && isRead[Y] && isRead[Z];
+	m_hasAtomSite = m_hasAtomSite || isAtomSite;
+	m_state = isAtomSite ? ATOM_ROWS : OTHER_ROWS;
+	m_tag = 0;
+}
+
+int CifParser::atomSiteColumn(const char *begin, const char *end)
+{
+	for (int i = 0; i < NR_COLUMNS; i++) {
+		if (equals(begin, end, COLUMNS[i].name)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+CifParser::Field CifParser::columnField(int column)
+{
+	return COLUMNS[column].field;
+}
+
+void CifParser::storeRow(PdbAtoms &atoms) const
+{
+	const Value &vx = m_values[X];
+	const Value &vy = m_values[Y];
+	const Value &vz = m_values[Z];
+	float x, y, z;
+	if (!vx.text || !vy.text || !vz.text || !PdbParser::parseFloat(vx.text, vx.text + vx.length, x) ||
+		!PdbParser::parseFloat(vy.text, vy.text + vy.length, y) || !PdbParser::parseFloat(vz.text, vz.text + vz.length, z)) {
+		atoms.malformedLines++;
+		return;
+	}
+
+	const Value &number = m_values[RESIDUE_NUMBER];
+	int residueNumber;
+	if (!number.text || !PdbParser::parseInt(number.text, number.text + number.length, residueNumber)) {
+		residueNumber = 0;
+	}
+
+	storeAtom(m_values, residueNumber, x, y, z, m_includeHetatm, atoms);
+}
+
+void CifParser::storeAtom(const Value values[NR_FIELDS], int residueNumber, float x, float y, float z,
+	bool includeHetatm, PdbAtoms &atoms)
+{
+	const Value &group = values[GROUP];
+	if (!includeHetatm && group.text && group.length == 6 && std::memcmp(group.text, "HETATM", 6) == 0) {
+		return;
+	}
+
+	// labels as in the fixed columns of a PDB file, element symbols are right justified
+	PdbAtoms::Labels labels;
+	copyValue(values[ATOM_NAME].text, values[ATOM_NAME].length, labels.name, 4);
+	copyValue(values[RESIDUE_NAME].text, values[RESIDUE_NAME].length, labels.residueName, 4);
+	copyValue(values[INSERTION_CODE].text, values[INSERTION_CODE].length, &labels.insertionCode, 1);
+	const Value &symbolValue = values[SYMBOL];
+	labels.symbol[0] = labels.symbol[1] = ' ';
+	if (symbolValue.text && symbolValue.length > 0 && symbolValue.length <= 2) {
+		copyValue(symbolValue.text, symbolValue.length, labels.symbol + 2 - symbolValue.length, symbolValue.length);
+	}
+
+	// residue names of 5 characters are not in the table
+	const Value &residueName = values[RESIDUE_NAME];
+	const int residue = residueName.text && residueName.length <= 4
+		? AtomTables::residueId(residueName.text, residueName.length) : -1;
+	const int symbol = PdbParser::elementId(labels, residue);
+
+	// skip hydrogen atoms and waters
+	if (symbol == AtomTables::HYDROGEN || AtomTables::residueType(residue) == AtomTables::WATER) {
+		return;
+	}
+
+	if (symbol == AtomTables::UNKNOWN_ELEMENT) {
+		atoms.unknownSymbols++;
+	}
+
+	// chain identifiers longer than 4 characters are truncated
+	const Value &chain = values[CHAIN];
+	atoms.addAtom(labels, symbol, residue, residueNumber, chain.text ? PdbAtoms::chainKey(chain.text, chain.length) : 0,
+		-x, y, z);
+}
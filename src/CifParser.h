@@ -0,0 +1,103 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "PdbParser.h"
+
+// Streaming reader of the _atom_site loop of mmCIF (PDBx) files. The file is fed in blocks of
+// any size, the tokens are scanned in place and only the fields of the current row are kept,
+// no CIF data structure is built. The columns of a loop are resolved once from its tags, author
+// fields (auth_*) are preferred over label fields as they match the numbering of PDB files.
+// Atoms are filtered and stored like PdbParser does: hydrogen atoms and waters are skipped,
+// HETATM rows are optional and x is mirrored.
+// PDBx/mmCIF Dictionary, category atom_site
+// http://mmcif.wwpdb.org/dictionaries/mmcif_pdbx_v50.dic/Categories/atom_site.html
+class CifParser
+{
+public:
+
+	explicit CifParser(bool includeHetatm = false);
+
+	// appends the atoms of the complete rows of [begin, end) and returns the start of the
+	// unfinished row or token, which is passed again in front of the following bytes of the
+	// file; last marks the end of the file, everything is consumed then
+	const char *parse(const char *begin, const char *end, bool last, PdbAtoms &atoms);
+
+	// true if an _atom_site loop with coordinates was found
+	bool hasAtomSite() const { return m_hasAtomSite; }
+
+	// fields of an atom, each read from the preferred column present in the loop
+	enum Field
+	{
+		GROUP,
+		SYMBOL,
+		ATOM_NAME,
+		RESIDUE_NAME,
+		CHAIN,
+		RESIDUE_NUMBER,
+		INSERTION_CODE,
+		X,
+		Y,
+		Z,
+		NR_FIELDS
+	};
+
+	struct Value
+	{
+		const char *text; // nullptr for the null values . and ?
+		int length;
+	};
+
+	// rank of an _atom_site column (name without category, case insensitive) that is read,
+	// the column of lowest rank of each field is preferred; -1 for other columns
+	static int atomSiteColumn(const char *begin, const char *end);
+	static Field columnField(int column);
+
+	// stores an atom of the text fields (GROUP to INSERTION_CODE) like PdbParser does:
+	// hydrogen atoms and waters are skipped, HETATM rows are optional and x is mirrored
+	static void storeAtom(const Value values[NR_FIELDS], int residueNumber, float x, float y, float z,
+		bool includeHetatm, PdbAtoms &atoms);
+
+private:
+
+	enum State
+	{
+		OUTSIDE_LOOP,
+		LOOP_TAGS,
+		ATOM_ROWS,
+		OTHER_ROWS
+	};
+
+	struct Column
+	{
+		const char *name; // lower case, without the category
+		Field field;
+	};
+
+	// known columns, author columns before the label columns of the same field
+	static const Column COLUMNS[];
+
+	void beginLoop();
+	void addTag(const char *begin, const char *end);
+	void endTags();
+	void storeRow(PdbAtoms &atoms) const;
+
+	bool m_includeHetatm;
+	bool m_hasAtomSite;
+	bool m_beginsLine; // the next block starts at the beginning of a line
+
+	State m_state;
+	int m_nrTags; // tags of the current loop
+	std::vector<int> m_tagFields; // field of each tag of the current loop, -1 if not read
+	std::vector<int> m_namedTags; // tag of each known column name, -1 if it is missing
+
+	int m_tag; // tag of the next value of the current row
+	const char *m_rowStart;
+	Value m_values[NR_FIELDS];
+};
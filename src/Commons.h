@@ -8,15 +8,11 @@
 #pragma once
 
 #include <glm/glm.hpp>
-#include <QString>
 
-class Atom
+// Atom record without heap data: strings are ids of the StringPool of the structure
+// (see PdbLoader::readAtomData), so atoms can be copied with memcpy, e.g. into GPU buffers.
+struct Atom
 {
-public:
-
-	Atom();
-	~Atom();
-
 	float radius;
 
     int chainId; // peptide chain this atom belongs to
@@ -24,20 +20,20 @@ public:
     int residueId; // residue (functional group) this atom belongs to
     int residueIndex;
 
-    // protein secondary structure (alpha helices and beta sheets)
-	QString helixName = "";
-	int helixIndex = -1;
-
-	QString sheetName = "";
-	int sheetIndex = -1;
+    // protein secondary structure (alpha helices and beta sheets), -1 if none
+	int helixIndex;
+	int sheetIndex;
 
-	int nbHelicesPerChain = -1;
-	int nbSheetsPerChain = -1;
+	int nbHelicesPerChain;
+	int nbSheetsPerChain;
 
-	QString name;
-	QString chain;
-	QString symbol;
-	QString residueName;
+	// StringPool ids, -1 if none
+	int nameId;
+	int chainNameId;
+	int symbolNameId;
+	int residueNameId;
+	int helixNameId;
+	int sheetNameId;
 
 	glm::vec3 position;
 	glm::vec3 color;
@@ -0,0 +1,155 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "CompressedFrameSource.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "SimdKernels.h"
+
+// std::min takes it by reference, it needs a definition
+const size_t CompressedFrameSource::BLOCK_SIZE;
+
+CompressedFrameSource::CompressedFrameSource(size_t nrFrames, size_t nrAtoms, float precision, size_t keyframeInterval)
+	: m_nrAtoms(nrAtoms), m_precision(precision), m_keyframeInterval(std::max<size_t>(keyframeInterval, 1)),
+	m_frames(nrFrames), m_groups((nrFrames + m_keyframeInterval - 1) / m_keyframeInterval),
+	m_values(nrAtoms * 3, 0), m_decodedFrame(-1)
+{
+}
+
+CompressedFrameSource::~CompressedFrameSource()
+{
+}
+
+static inline int deltaWidth(int32_t minDelta, int32_t maxDelta)
+{
+	if (minDelta >= INT8_MIN && maxDelta <= INT8_MAX) return 1;
+	if (minDelta >= INT16_MIN && maxDelta <= INT16_MAX) return 2;
+	return 4;
+}
+
+size_t CompressedFrameSource::encodeFrame(size_t frameNr, const float *positions, const glm::vec3 &origin,
+	std::vector<int32_t> &state)
+{
+	const size_t count = m_nrAtoms * 3;
+	const size_t nrBlocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+	// state holds the quantized previous frame followed by the current frame
+	state.resize(count * 2);
+	int32_t *previous = state.data();
+	int32_t *current = state.data() + count;
+
+	// quantize relative to the bounding box of the frame
+	Frame &frame = m_frames[frameNr];
+	frame.origin = origin;
+	SimdKernels::quantize(positions, count, &frame.origin.x, 1.0f / m_precision, current);
+
+	// keyframes are deltas to zero
+	if (frameNr % m_keyframeInterval == 0) {
+		std::fill(previous, previous + count, 0);
+	}
+
+	// block widths first, then the delta blocks
+	std::vector<uint8_t> &data = m_groups[frameNr / m_keyframeInterval];
+	const size_t start = data.size();
+	frame.offset = start;
+	data.resize(start + nrBlocks);
+
+	for (size_t b = 0; b < nrBlocks; b++) {
+		const size_t first = b * BLOCK_SIZE;
+		const size_t n = std::min(BLOCK_SIZE, count - first);
+
+		int32_t deltas[BLOCK_SIZE];
+		int32_t minDelta = 0, maxDelta = 0;
+		for (size_t i = 0; i < n; i++) {
+			deltas[i] = current[first + i] - previous[first + i];
+			minDelta = std::min(minDelta, deltas[i]);
+			maxDelta = std::max(maxDelta, deltas[i]);
+		}
+
+		const int width = deltaWidth(minDelta, maxDelta);
+		data[start + b] = uint8_t(width);
+
+		size_t offset = data.size();
+		data.resize(offset + n * width);
+		for (size_t i = 0; i < n; i++) {
+			if (width == 1) {
+				int8_t d = int8_t(deltas[i]);
+				std::memcpy(&data[offset + i], &d, 1);
+			}
+			else if (width == 2) {
+				int16_t d = int16_t(deltas[i]);
+				std::memcpy(&data[offset + i * 2], &d, 2);
+			}
+			else {
+				std::memcpy(&data[offset + i * 4], &deltas[i], 4);
+			}
+		}
+	}
+
+	std::swap_ranges(previous, previous + count, current);
+	return data.size() - start;
+}
+
+void CompressedFrameSource::applyFrame(size_t frameNr, bool reverse)
+{
+	const size_t count = m_nrAtoms * 3;
+	const size_t nrBlocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+	const uint8_t *widths = m_groups[frameNr / m_keyframeInterval].data() + m_frames[frameNr].offset;
+	const uint8_t *blocks = widths + nrBlocks;
+
+	for (size_t b = 0; b < nrBlocks; b++) {
+		const size_t n = std::min(BLOCK_SIZE, count - b * BLOCK_SIZE);
+		SimdKernels::addDeltas(blocks, widths[b], n, &m_values[b * BLOCK_SIZE], reverse);
+		blocks += n * widths[b];
+	}
+}
+
+bool CompressedFrameSource::readFrame(size_t frameNr, float *dst)
+{
+	if (frameNr >= m_frames.size()) {
+		return false;
+	}
+
+	const long long frame = (long long)frameNr;
+	const size_t key = frameNr - frameNr % m_keyframeInterval;
+	const bool sameGroup = m_decodedFrame >= 0 && size_t(m_decodedFrame) / m_keyframeInterval == frameNr / m_keyframeInterval;
+
+	if (m_decodedFrame == frame) {
+		// already decoded
+	}
+	else if (sameGroup && m_decodedFrame < frame) {
+		// forward within the group
+		for (size_t f = size_t(m_decodedFrame) + 1; f <= frameNr; f++) {
+			applyFrame(f, false);
+		}
+	}
+	else if (sameGroup && m_decodedFrame == frame + 1) {
+		// reverse playback undoes the delta of the following frame
+		applyFrame(size_t(m_decodedFrame), true);
+	}
+	else {
+		std::fill(m_values.begin(), m_values.end(), 0);
+		for (size_t f = key; f <= frameNr; f++) {
+			applyFrame(f, false);
+		}
+	}
+	m_decodedFrame = frame;
+
+	SimdKernels::dequantize(m_values.data(), m_values.size(), &m_frames[frameNr].origin.x, m_precision, dst);
+	return true;
+}
+
+size_t CompressedFrameSource::memoryUsage() const
+{
+	size_t bytes = m_frames.capacity() * sizeof(Frame) + m_values.capacity() * sizeof(int32_t);
+	for (size_t g = 0; g < m_groups.size(); g++) {
+		bytes += m_groups[g].capacity();
+	}
+	return bytes;
+}
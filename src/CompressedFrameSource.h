@@ -0,0 +1,68 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <QtGlobal>
+
+#include "FrameSource.h"
+
+// In-memory trajectory encoding. Coordinates are quantized to a fixed precision
+// relative to the minimum of each frame's bounding box and delta coded against
+// the previous frame, every keyframeInterval frames starts a group with a keyframe.
+// Deltas are stored in blocks of 32 values with 1, 2 or 4 bytes per value.
+// Seeking decodes at most one keyframe plus keyframeInterval - 1 deltas,
+// sequential playback in either direction applies a single delta per frame.
+class CompressedFrameSource : public FrameSource
+{
+public:
+
+	CompressedFrameSource(size_t nrFrames, size_t nrAtoms, float precision = 0.001f, size_t keyframeInterval = 32);
+	~CompressedFrameSource();
+
+	size_t nrFrames() const Q_DECL_OVERRIDE { return m_frames.size(); }
+	size_t nrAtoms() const Q_DECL_OVERRIDE { return m_nrAtoms; }
+
+	size_t keyframeInterval() const { return m_keyframeInterval; }
+	float precision() const { return m_precision; }
+
+	// encodes a frame, the frames of a group have to be encoded in order but different groups
+	// can be encoded in parallel; origin is the minimum of the positions (of the frame bounds
+	// computed while loading); state is scratch memory of the caller kept between the frames
+	// of a group; returns the number of bytes added
+	size_t encodeFrame(size_t frameNr, const float *positions, const glm::vec3 &origin, std::vector<int32_t> &state);
+
+	bool readFrame(size_t frameNr, float *dst) Q_DECL_OVERRIDE;
+
+	// encoded size in bytes
+	size_t memoryUsage() const;
+
+private:
+
+	void applyFrame(size_t frameNr, bool reverse);
+
+	static const size_t BLOCK_SIZE = 32;
+
+	struct Frame
+	{
+		glm::vec3 origin;
+		size_t offset; // into the data of the group, block widths followed by the blocks
+	};
+
+	size_t m_nrAtoms;
+	float m_precision;
+	size_t m_keyframeInterval;
+
+	std::vector<Frame> m_frames;
+	std::vector<std::vector<uint8_t> > m_groups;
+
+	// decoder state
+	std::vector<int32_t> m_values;
+	long long m_decodedFrame;
+};
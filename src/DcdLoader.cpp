@@ -0,0 +1,272 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "DcdLoader.h"
+
+#include <cstring>
+#include <QDebug>
+#include <QtEndian>
+
+#include "SimdKernels.h"
+#include "TrajectoryLoader.h"
+
+// DCD file layout (Fortran unformatted records, each framed by its byte length)
+//   84    "CORD" ICNTRL[20]    84      NSET, ..., NAMNF = ICNTRL[8], unit cell = ICNTRL[10],
+//                                      4D = ICNTRL[11], CHARMM version = ICNTRL[19]
+//   4+80n NTITLE TITLE[n][80]  4+80n
+//   4     NATOM                4
+// per frame
+//   48    unit cell (6 doubles) 48     CHARMM files with unit cell only
+//   4N    X[N]                 4N
+//   4N    Y[N]                 4N
+//   4N    Z[N]                 4N
+//   4N    W[N]                 4N      CHARMM 4D files only
+
+namespace
+{
+	const quint32 HEADER_RECORD = 84;
+	const quint32 UNIT_CELL_RECORD = 48;
+}
+
+DcdFrameSource::DcdFrameSource()
+	: m_data(nullptr), m_size(0), m_bigEndian(false), m_fileAtoms(0), m_nrFrames(0), m_nrAtoms(0),
+	m_begin(0), m_frameSize(0), m_coordsOffset(0)
+{
+}
+
+DcdFrameSource::~DcdFrameSource()
+{
+	close();
+}
+
+bool DcdFrameSource::isDcdFormat(const QString &path)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	uchar header[8];
+	if (file.read(reinterpret_cast<char *>(header), 8) != 8) {
+		return false;
+	}
+	return (qFromLittleEndian<quint32>(header) == HEADER_RECORD || qFromBigEndian<quint32>(header) == HEADER_RECORD)
+		&& std::memcmp(header + 4, "CORD", 4) == 0;
+}
+
+bool DcdFrameSource::open(const QString &path, const FrameSelection &selection)
+{
+	close();
+
+	m_file.setFileName(path);
+	if (!m_file.open(QIODevice::ReadOnly)) {
+		qCritical() << "Error loading file: " << m_file.errorString();
+		return false;
+	}
+
+	m_size = m_file.size();
+	m_data = m_file.map(0, m_size);
+	if (!m_data) {
+		qCritical() << "Error mapping file: " << m_file.errorString();
+		close();
+		return false;
+	}
+
+	if (!parseHeader()) {
+		qCritical() << "Not a supported DCD trajectory: " << path;
+		close();
+		return false;
+	}
+
+	// pages of unselected frames and atoms are never touched
+	m_selection = selection;
+	m_atomRuns = selection.atomRuns(m_fileAtoms);
+	m_nrFrames = selection.nrFrames(m_nrFrames);
+	m_nrAtoms = selection.nrAtoms(m_fileAtoms);
+
+	qInfo() << "Mapped" << path << ":" << m_nrFrames << "frames," << m_nrAtoms << "atoms";
+	return true;
+}
+
+void DcdFrameSource::close()
+{
+	if (m_data) {
+		m_file.unmap(m_data);
+	}
+	m_file.close();
+	m_data = nullptr;
+	m_size = 0;
+	m_bigEndian = false;
+	m_fileAtoms = m_nrFrames = m_nrAtoms = 0;
+	m_begin = m_frameSize = m_coordsOffset = 0;
+	m_selection = FrameSelection();
+	m_atomRuns.clear();
+}
+
+quint32 DcdFrameSource::readInt(quint64 offset) const
+{
+	if (offset + 4 > quint64(m_size)) {
+		return 0;
+	}
+	return m_bigEndian ? qFromBigEndian<quint32>(m_data + offset) : qFromLittleEndian<quint32>(m_data + offset);
+}
+
+bool DcdFrameSource::parseHeader()
+{
+	if (m_size < 8 || std::memcmp(m_data + 4, "CORD", 4) != 0) {
+		return false;
+	}
+
+	// the length of the first record tells the byte order
+	if (qFromLittleEndian<quint32>(m_data) == HEADER_RECORD) {
+		m_bigEndian = false;
+	}
+	else if (qFromBigEndian<quint32>(m_data) == HEADER_RECORD) {
+		m_bigEndian = true;
+	}
+	else {
+		return false; // 64-bit record markers are not supported
+	}
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+	if (!m_bigEndian) {
+		return false;
+	}
+#endif
+
+	if (readInt(4 + HEADER_RECORD) != HEADER_RECORD) {
+		return false;
+	}
+	quint32 icntrl[20];
+	for (int i = 0; i < 20; i++) {
+		icntrl[i] = readInt(8 + i * 4);
+	}
+	quint64 pos = HEADER_RECORD + 8;
+
+	// title
+	quint32 titleBytes = readInt(pos);
+	if (titleBytes < 4 || (titleBytes - 4) % 80 != 0 || readInt(pos + 4 + titleBytes) != titleBytes) {
+		return false;
+	}
+	pos += titleBytes + 8;
+
+	// atoms
+	if (readInt(pos) != 4 || readInt(pos + 8) != 4) {
+		return false;
+	}
+	m_fileAtoms = readInt(pos + 4);
+	pos += 12;
+
+	if (icntrl[8] != 0) {
+		qCritical() << "DCD files with fixed atoms are not supported";
+		return false;
+	}
+
+	const bool charmm = icntrl[19] != 0;
+	const bool hasUnitCell = charmm && icntrl[10] != 0;
+	const bool has4D = charmm && icntrl[11] != 0;
+
+	m_begin = pos;
+	m_coordsOffset = hasUnitCell ? UNIT_CELL_RECORD + 8 : 0;
+	m_frameSize = m_coordsOffset + (m_fileAtoms * 4 + 8) * (has4D ? 4 : 3);
+
+	// NSET is not updated by some writers and an interrupted simulation leaves a partial frame
+	m_nrFrames = size_t((quint64(m_size) - m_begin) / m_frameSize);
+	if (m_nrFrames != icntrl[0]) {
+		qWarning() << "DCD header announces" << icntrl[0] << "frames, the file contains" << m_nrFrames;
+	}
+
+	// frames have a fixed size, valid markers of the first and the last frame validate the layout
+	if (m_fileAtoms == 0 || m_nrFrames == 0) {
+		return m_fileAtoms > 0;
+	}
+	return checkFrame(0) && checkFrame(m_nrFrames - 1);
+}
+
+bool DcdFrameSource::checkFrame(size_t fileFrame) const
+{
+	const quint64 frame = m_begin + fileFrame * m_frameSize;
+	if (m_coordsOffset > 0 &&
+		(readInt(frame) != UNIT_CELL_RECORD || readInt(frame + UNIT_CELL_RECORD + 4) != UNIT_CELL_RECORD)) {
+		return false;
+	}
+
+	const quint32 recordBytes = quint32(m_fileAtoms * 4);
+	for (int axis = 0; axis < 3; axis++) {
+		const quint64 record = frame + m_coordsOffset + axis * (quint64(recordBytes) + 8);
+		if (readInt(record) != recordBytes || readInt(record + 4 + recordBytes) != recordBytes) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool DcdFrameSource::readFrame(size_t frameNr, float *dst)
+{
+	return convertFrame(frameNr, dst, nullptr);
+}
+
+bool DcdFrameSource::readFramesAndBounds(size_t first, size_t count, float *dst, FrameBounds *bounds)
+{
+	for (size_t i = 0; i < count; i++) {
+		if (!convertFrame(first + i, dst + i * m_nrAtoms * 3, &bounds[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool DcdFrameSource::convertFrame(size_t frameNr, float *dst, FrameBounds *bounds)
+{
+	if (!isOpen() || frameNr >= m_nrFrames) {
+		return false;
+	}
+
+	// X, Y and Z records follow each other, skip their leading markers
+	const quint64 recordSize = m_fileAtoms * 4 + 8;
+	const uchar *coords = m_data + frameOffset(frameNr) + m_coordsOffset + 4;
+	const float *x = reinterpret_cast<const float *>(coords);
+	const float *y = reinterpret_cast<const float *>(coords + recordSize);
+	const float *z = reinterpret_cast<const float *>(coords + recordSize * 2);
+
+	std::vector<float> swapped;
+	size_t atomOffset = 0;
+	for (size_t r = 0; r < m_atomRuns.size(); r++) {
+		const size_t first = m_atomRuns[r].first;
+		const size_t count = m_atomRuns[r].second;
+		const float *rx = x + first;
+		const float *ry = y + first;
+		const float *rz = z + first;
+		if (m_bigEndian) {
+			swapped.resize(count * 3);
+			SimdKernels::bigEndianToFloat(rx, &swapped[0], count);
+			SimdKernels::bigEndianToFloat(ry, &swapped[count], count);
+			SimdKernels::bigEndianToFloat(rz, &swapped[count * 2], count);
+			rx = &swapped[0];
+			ry = &swapped[count];
+			rz = &swapped[count * 2];
+		}
+		if (bounds) {
+			SimdKernels::interleaveXYZ(rx, ry, rz, count, dst + atomOffset * 3, &bounds->min.x, &bounds->max.x);
+		}
+		else {
+			SimdKernels::interleaveXYZ(rx, ry, rz, count, dst + atomOffset * 3);
+		}
+		atomOffset += count;
+	}
+	return true;
+}
+
+bool DcdLoader::readData(QString &path, Trajectory &trajectory, LoadProgress *progress, size_t memoryBudget,
+    const FrameSelection &selection)
+{
+	DcdFrameSource *source = new DcdFrameSource();
+	if (!source->open(path, selection)) {
+		delete source;
+		return false;
+	}
+
+	// the mapped file is read as fast as a cache would be, no cache is written next to it
+	return TrajectoryLoader::load(path, source, trajectory, progress, memoryBudget, selection, false);
+}
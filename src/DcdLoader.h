@@ -0,0 +1,92 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <utility>
+#include <vector>
+#include <QFile>
+#include <QString>
+
+#include "FrameSelection.h"
+#include "FrameSource.h"
+#include "LoadProgress.h"
+#include "Trajectory.h"
+
+// Zero-copy reader for CHARMM/NAMD/OpenMM DCD trajectories. The file is memory mapped,
+// the Fortran record markers of the header are validated once when opening and every frame
+// is a fixed size record block, so frame offsets are computed and seeking is O(1).
+// Each frame stores separate X, Y and Z arrays which are interleaved into the x, y, z layout
+// of the renderer (SimdKernels::interleaveXYZ). Files with fixed atoms are not supported.
+class DcdFrameSource : public FrameSource
+{
+public:
+
+	DcdFrameSource();
+	~DcdFrameSource();
+
+	// true if the file starts with a DCD header record (either byte order)
+	static bool isDcdFormat(const QString &path);
+
+	bool open(const QString &path, const FrameSelection &selection = FrameSelection());
+	void close();
+
+	bool isOpen() const { return m_data != nullptr; }
+
+	size_t nrFrames() const Q_DECL_OVERRIDE { return m_nrFrames; }
+	size_t nrAtoms() const Q_DECL_OVERRIDE { return m_nrAtoms; }
+
+	bool isReentrant() const Q_DECL_OVERRIDE { return true; }
+
+	// file offset of a selected frame
+	inline quint64 frameOffset(size_t frameNr) const
+	{
+		return m_begin + m_selection.fileFrame(frameNr) * m_frameSize;
+	}
+
+	// interleaves the selected atoms of the frame into dst, may be called from several threads at once
+	bool readFrame(size_t frameNr, float *dst) Q_DECL_OVERRIDE;
+
+	// the bounds are reduced while interleaving
+	bool readFramesAndBounds(size_t first, size_t count, float *dst, FrameBounds *bounds) Q_DECL_OVERRIDE;
+
+private:
+
+	// readFrame, also extends bounds unless it is null
+	bool convertFrame(size_t frameNr, float *dst, FrameBounds *bounds);
+
+	bool parseHeader();
+
+	quint32 readInt(quint64 offset) const;
+
+	// true if the X, Y and Z records of a file frame have valid markers
+	bool checkFrame(size_t fileFrame) const;
+
+	QFile m_file;
+	uchar *m_data;
+	qint64 m_size;
+	bool m_bigEndian;
+
+	size_t m_fileAtoms;
+	size_t m_nrFrames; // selected frames and atoms
+	size_t m_nrAtoms;
+
+	FrameSelection m_selection;
+	std::vector<std::pair<size_t, size_t> > m_atomRuns;
+
+	quint64 m_begin;     // file offset of the first frame
+	quint64 m_frameSize; // bytes of one frame including all record markers
+	quint64 m_coordsOffset; // of the X record inside a frame (after the optional unit cell)
+};
+
+class DcdLoader
+{
+	public:
+
+        // same storage modes as NetCDFLoader::readData, DCD files contain no topology
+        static bool readData(QString &path, Trajectory &trajectory, LoadProgress *progress = nullptr, size_t memoryBudget = 0,
+            const FrameSelection &selection = FrameSelection());
+};
@@ -0,0 +1,161 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "FramePrefetcher.h"
+
+#include <algorithm>
+#include <QDebug>
+#include <QtConcurrent>
+
+FramePrefetcher::FramePrefetcher(FrameSource *source, size_t depth)
+	: m_source(source), m_slots(depth), m_ready(depth), m_free(depth),
+	m_playhead(0), m_direction(1), m_generation(0), m_stop(false),
+	m_current(-1), m_hits(0), m_misses(0)
+{
+	for (size_t i = 0; i < depth; i++) {
+		m_slots[i].frameNr = -1;
+		m_slots[i].generation = 0;
+		m_slots[i].positions.resize(source->nrAtoms() * 3);
+		m_free.push(int(i));
+	}
+}
+
+FramePrefetcher::~FramePrefetcher()
+{
+	stop();
+}
+
+void FramePrefetcher::stop()
+{
+	m_stop.store(true);
+	wait();
+}
+
+void FramePrefetcher::seek(int frameNr, int direction)
+{
+	m_playhead.store(frameNr);
+	m_direction.store(direction < 0 ? -1 : 1);
+	m_generation.fetch_add(1, std::memory_order_release);
+}
+
+const float *FramePrefetcher::acquire(int frameNr)
+{
+	const unsigned generation = m_generation.load(std::memory_order_relaxed);
+	const int direction = m_direction.load(std::memory_order_relaxed);
+
+	int slot;
+	while (m_ready.peek(slot)) {
+		const Slot &s = m_slots[slot];
+
+		// frames of an old playhead or behind the requested one are recycled
+		if (s.generation != generation || (s.frameNr - frameNr) * direction < 0) {
+			m_ready.pop(slot);
+			m_free.push(slot);
+			continue;
+		}
+		if (s.frameNr != frameNr) {
+			break;
+		}
+
+		m_ready.pop(slot);
+		if (m_current >= 0) {
+			m_free.push(m_current);
+		}
+		m_current = slot;
+		m_hits++;
+		return s.positions.data();
+	}
+
+	m_misses++;
+	return nullptr;
+}
+
+void FramePrefetcher::run()
+{
+	const int nrFrames = int(m_source->nrFrames());
+	const size_t batchSize = m_source->isReentrant() ? size_t(std::max(QThread::idealThreadCount(), 1)) : 1;
+
+	unsigned generation = m_generation.load(std::memory_order_acquire) - 1;
+	int next = 0;
+	int direction = 1;
+	int slot = -1;
+	std::vector<int> batch;
+
+	while (!m_stop.load(std::memory_order_relaxed)) {
+
+		unsigned current = m_generation.load(std::memory_order_acquire);
+		if (current != generation) {
+			generation = current;
+			next = m_playhead.load();
+			direction = m_direction.load();
+		}
+
+		if (next < 0 || next >= nrFrames) {
+			QThread::msleep(1); // reached the end, wait for the next seek
+			continue;
+		}
+
+		if (batchSize > 1) {
+			// consecutive frames in playback direction, one free slot each
+			while (batch.size() < batchSize && m_free.pop(slot)) {
+				const int frameNr = next + int(batch.size()) * direction;
+				m_slots[slot].frameNr = frameNr;
+				m_slots[slot].generation = generation;
+				batch.push_back(slot);
+				if (frameNr + direction < 0 || frameNr + direction >= nrFrames) {
+					break;
+				}
+			}
+			if (batch.empty()) {
+				QThread::msleep(1); // all slots are filled, wait for the renderer
+				continue;
+			}
+
+			std::atomic<bool> failed(false);
+			QtConcurrent::blockingMap(batch, [&](int i) {
+				if (!m_source->readFrame(size_t(m_slots[i].frameNr), m_slots[i].positions.data())) {
+					failed = true;
+				}
+			});
+			if (failed) {
+				qWarning() << "Prefetching frames" << next << "to" << next + int(batch.size() - 1) * direction << "failed";
+				for (size_t i = 0; i < batch.size(); i++) {
+					m_free.push(batch[i]);
+				}
+				batch.clear();
+				slot = -1;
+				next = -1;
+				continue;
+			}
+
+			for (size_t i = 0; i < batch.size(); i++) {
+				m_ready.push(batch[i]);
+			}
+			next += int(batch.size()) * direction;
+			batch.clear();
+			slot = -1;
+			continue;
+		}
+
+		if (slot < 0 && !m_free.pop(slot)) {
+			QThread::msleep(1); // all slots are filled, wait for the renderer
+			continue;
+		}
+
+		Slot &s = m_slots[slot];
+		if (!m_source->readFrame(size_t(next), s.positions.data())) {
+			qWarning() << "Prefetching frame" << next << "failed";
+			next = -1;
+			continue;
+		}
+		s.frameNr = next;
+		s.generation = generation;
+
+		m_ready.push(slot);
+		slot = -1;
+		next += direction;
+	}
+}
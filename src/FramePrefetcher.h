@@ -0,0 +1,68 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <QThread>
+
+#include "FrameSource.h"
+#include "SpscQueue.h"
+
+// Reads the frames ahead of the playhead on a worker thread and hands them
+// to the renderer through lock-free queues. The worker runs in the current
+// playback direction and stays at most depth frames ahead of the renderer.
+// Reentrant sources (e.g. XTC decoding) read a batch of frames in parallel on the global thread pool.
+class FramePrefetcher : public QThread
+{
+public:
+
+	FramePrefetcher(FrameSource *source, size_t depth = 16);
+	~FramePrefetcher();
+
+	void stop();
+
+	// restarts prefetching at frameNr, direction is +1 (forward) or -1 (reverse),
+	// frames prefetched for an earlier playhead are dropped
+	void seek(int frameNr, int direction);
+
+	// positions of frameNr if it has been prefetched, nullptr otherwise (never blocks);
+	// the pointer stays valid until the next successful acquire
+	const float *acquire(int frameNr);
+
+	// renderer side statistics
+	size_t hits() const { return m_hits; }
+	size_t misses() const { return m_misses; }
+
+protected:
+
+	void run() Q_DECL_OVERRIDE;
+
+private:
+
+	struct Slot
+	{
+		int frameNr;
+		unsigned generation;
+		std::vector<float> positions;
+	};
+
+	FrameSource *m_source;
+	std::vector<Slot> m_slots;
+
+	SpscQueue<int> m_ready; // filled slots, worker -> renderer
+	SpscQueue<int> m_free;  // consumed slots, renderer -> worker
+
+	std::atomic<int> m_playhead;
+	std::atomic<int> m_direction;
+	std::atomic<unsigned> m_generation;
+	std::atomic<bool> m_stop;
+
+	int m_current; // slot held by the renderer
+	size_t m_hits;
+	size_t m_misses;
+};
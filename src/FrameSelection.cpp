@@ -0,0 +1,119 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "FrameSelection.h"
+
+#include <algorithm>
+#include <QStringList>
+
+FrameSelection::FrameSelection()
+	: firstFrame(0), endFrame(0), frameStride(1)
+{
+}
+
+bool FrameSelection::isAll() const
+{
+	return firstFrame == 0 && endFrame == 0 && frameStride == 1 && atomRanges.empty();
+}
+
+size_t FrameSelection::nrFrames(size_t fileFrames) const
+{
+	size_t end = (endFrame == 0) ? fileFrames : std::min(endFrame, fileFrames);
+	if (firstFrame >= end) {
+		return 0;
+	}
+	return (end - firstFrame + frameStride - 1) / frameStride;
+}
+
+size_t FrameSelection::nrAtoms(size_t fileAtoms) const
+{
+	const std::vector<std::pair<size_t, size_t> > runs = atomRuns(fileAtoms);
+	size_t count = 0;
+	for (size_t r = 0; r < runs.size(); r++) {
+		count += runs[r].second;
+	}
+	return count;
+}
+
+std::vector<std::pair<size_t, size_t> > FrameSelection::atomRuns(size_t fileAtoms) const
+{
+	std::vector<std::pair<size_t, size_t> > runs;
+	if (atomRanges.empty()) {
+		runs.push_back(std::make_pair(size_t(0), fileAtoms));
+		return runs;
+	}
+
+	for (size_t r = 0; r < atomRanges.size() && atomRanges[r].first < fileAtoms; r++) {
+		const size_t last = std::min(atomRanges[r].second, fileAtoms - 1);
+		runs.push_back(std::make_pair(atomRanges[r].first, last - atomRanges[r].first + 1));
+	}
+	return runs;
+}
+
+bool FrameSelection::parse(const QString &spec, FrameSelection &selection)
+{
+	selection = FrameSelection();
+
+	QStringList parts = spec.simplified().split(' ', QString::SkipEmptyParts);
+	if (parts.size() > 2) {
+		return false;
+	}
+
+	bool ok = true;
+
+	// FRAMES first:end:stride
+	if (parts.size() > 0) {
+		QStringList frames = parts[0].split(':');
+		if (frames.size() > 3) {
+			return false;
+		}
+		if (frames.size() > 0 && !frames[0].isEmpty()) {
+			selection.firstFrame = frames[0].toULongLong(&ok);
+			if (!ok) return false;
+		}
+		if (frames.size() > 1 && !frames[1].isEmpty()) {
+			selection.endFrame = frames[1].toULongLong(&ok);
+			if (!ok) return false;
+		}
+		if (frames.size() > 2 && !frames[2].isEmpty()) {
+			selection.frameStride = frames[2].toULongLong(&ok);
+			if (!ok || selection.frameStride == 0) return false;
+		}
+	}
+
+	// ATOMS comma separated indices and ranges, kept as ranges since the number of atoms is not known yet
+	if (parts.size() > 1) {
+		std::vector<std::pair<size_t, size_t> > ranges;
+		foreach (const QString &item, parts[1].split(',', QString::SkipEmptyParts)) {
+			QStringList range = item.split('-');
+			size_t first = range[0].toULongLong(&ok);
+			if (!ok) return false;
+			size_t last = first;
+			if (range.size() == 2) {
+				last = range[1].toULongLong(&ok);
+				if (!ok || last < first) return false;
+			}
+			else if (range.size() > 2) {
+				return false;
+			}
+			ranges.push_back(std::make_pair(first, last));
+		}
+
+		// overlapping and adjacent ranges are merged
+		std::sort(ranges.begin(), ranges.end());
+		for (size_t r = 0; r < ranges.size(); r++) {
+			std::vector<std::pair<size_t, size_t> > &merged = selection.atomRanges;
+			if (!merged.empty() && (ranges[r].first == 0 || ranges[r].first - 1 <= merged.back().second)) {
+				merged.back().second = std::max(merged.back().second, ranges[r].second);
+			}
+			else {
+				merged.push_back(ranges[r]);
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,46 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <utility>
+#include <vector>
+#include <QString>
+
+// Frame range, frame stride and atom subset of a trajectory to load,
+// the frame sources read only the selected frames and atoms.
+class FrameSelection
+{
+public:
+
+	FrameSelection();
+
+	size_t firstFrame;
+	size_t endFrame;    // exclusive, 0 selects up to the last frame
+	size_t frameStride;
+	// sorted, disjoint ranges of atom indices as (first, last), both inclusive; empty selects all atoms.
+	// Ranges may reach beyond the atoms of the file, they are clipped when the file is opened
+	std::vector<std::pair<size_t, size_t> > atomRanges;
+
+	bool isAll() const;
+
+	// frames and atoms selected from a file with the given dimensions
+	size_t nrFrames(size_t fileFrames) const;
+	size_t nrAtoms(size_t fileAtoms) const;
+
+	// file frame of the selected frame
+	inline size_t fileFrame(size_t frameNr) const
+	{
+		return firstFrame + frameNr * frameStride;
+	}
+
+	// consecutive selected atoms of the file as (first atom, count)
+	std::vector<std::pair<size_t, size_t> > atomRuns(size_t fileAtoms) const;
+
+	// parses "first:end:stride atoms", e.g. "0:5000:10 0-120,300,512-600",
+	// every part is optional and an empty string selects everything
+	static bool parse(const QString &spec, FrameSelection &selection);
+};
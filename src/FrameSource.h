@@ -0,0 +1,63 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#include "SimdKernels.h"
+
+// axis-aligned bounding box of the atoms of a frame (Trajectory::Bounds)
+struct FrameBounds
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+// Random access to the atom positions of a trajectory that is not held in memory.
+// Implementations are not thread-safe unless isReentrant() says so,
+// each source is used by one thread at a time.
+class FrameSource
+{
+public:
+
+	virtual ~FrameSource() {}
+
+	virtual size_t nrFrames() const = 0;
+	virtual size_t nrAtoms() const = 0;
+
+	// true if readFrame and readFrames may be called from several threads at once
+	virtual bool isReentrant() const { return false; }
+
+	// copies the nrAtoms * 3 coordinates (x, y, z) of a frame into dst
+	virtual bool readFrame(size_t frameNr, float *dst) = 0;
+
+	// copies count consecutive frames into dst (count * nrAtoms * 3 floats)
+	virtual bool readFrames(size_t first, size_t count, float *dst)
+	{
+		for (size_t i = 0; i < count; i++) {
+			if (!readFrame(first + i, dst + i * nrAtoms() * 3)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// as readFrames, also extends the bounds of each frame (count bounds initialized by the caller,
+	// see Trajectory::emptyBounds); sources that convert the coordinates override it to reduce them
+	// in the same pass, others take a second pass over the frames
+	virtual bool readFramesAndBounds(size_t first, size_t count, float *dst, FrameBounds *bounds)
+	{
+		if (!readFrames(first, count, dst)) {
+			return false;
+		}
+		for (size_t i = 0; i < count; i++) {
+			SimdKernels::bounds(dst + i * nrAtoms() * 3, nrAtoms(), &bounds[i].min.x, &bounds[i].max.x);
+		}
+		return true;
+	}
+};
@@ -8,8 +8,10 @@
 #include "GLWidget.h"
 
 #include <qopenglwidget.h>
+#include <algorithm>
 #include <QMouseEvent>
 #include <QDir>
+#include <QOpenGLExtraFunctions>
 #ifdef __linux__
 #include <GL/glut.h>
 #elif _WIN32
@@ -21,8 +23,10 @@
 #include <glm/gtc/type_ptr.hpp>
 #include "glsw.h"
 #include "MainWindow.h"
+#include "SimdKernels.h"
 
 const float msPerFrame = 50.0f;
+const size_t fillBytesPerFrame = 16 * 1024 * 1024; // of the frame cache, per drawn frame
 
 #define GL_GPU_MEM_INFO_TOTAL_AVAILABLE_MEM_NVX 0x9048
 #define GL_GPU_MEM_INFO_CURRENT_AVAILABLE_MEM_NVX 0x9049
@@ -78,7 +82,25 @@ GLWidget::GLWidget(QWidget *parent, MainWindow *mainWindow)
 	isImposerRendering = true;
 
     m_currentFrame = 0;
+    m_uploadedFrame = -1;
+    m_isPlaying = false;
     m_nrAtoms = 0;
+    m_maxRadius = 0.0f;
+    m_trajectory = nullptr;
+    m_prefetcher = nullptr;
+    m_framePositions = nullptr;
+    m_positionBuffer = 0;
+    m_positionOffset = 0;
+    m_frameCacheBudget = 0;
+    m_frameCacheFill = 0;
+    m_quantizePositions = false;
+    m_quantized = false;
+    m_positionQuantization = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    m_quantizationError = 0.0f;
+    m_frameTimeReport = REPORT_NONE;
+    m_drawQueryPending = false;
+    m_drawTimeNs = 0;
+    m_drawSamples = 0;
 
 	ambientFactor = 0.05f;
 	diffuseFactor = 0.5f;
@@ -88,6 +110,7 @@ GLWidget::GLWidget(QWidget *parent, MainWindow *mainWindow)
 
 GLWidget::~GLWidget()
 {
+	delete m_prefetcher;
     delete logger;
 	glswShutdown();
 }
@@ -107,6 +130,10 @@ void GLWidget::cleanup()
 	// makes the widget's rendering context the current OpenGL rendering context
 	makeCurrent();
 	//m_vao.destroy
+	m_drawQuery.destroy();
+	m_drawQueryPending = false;
+	m_positionStream.destroy();
+	m_frameCache.destroy();
 	m_program_molecules = 0;
 	doneCurrent();
 }
@@ -132,6 +159,9 @@ void GLWidget::initializeGL()
 	if (!m_vao_molecules.create()) {
 		qDebug() << "error creating vao";
 	}
+	if (!m_drawQuery.create()) {
+		qDebug() << "GPU timer queries not supported, draw times are not reported";
+	}
 
 	m_program_molecules = new QOpenGLShaderProgram();
 	m_vertexShader = new QOpenGLShader(QOpenGLShader::Vertex);
@@ -163,13 +193,30 @@ void GLWidget::initializeGL()
 
 
 
-void GLWidget::initMoleculeRenderMode(std::vector<std::vector<Atom> > *animation)
+void GLWidget::initMoleculeRenderMode(Trajectory *trajectory, RenderMode mode)
 {
 	// makes the widget's rendering context the current OpenGL rendering context
 	makeCurrent();
 
-	m_animation = animation;
-	renderMode = RenderMode::NETCDF;
+	releaseTrajectory();
+	m_trajectory = trajectory;
+	renderMode = mode;
+
+	// the rotation, zoom and planes fitted to the previous data set are dropped in every mode,
+	// the view is fitted to the first uploaded frame
+	m_camera.reset();
+	m_camera.setAspect(float(width()) / std::max(height(), 1));
+
+	m_maxRadius = m_trajectory->radii.empty() ? 0.0f : *std::max_element(m_trajectory->radii.begin(), m_trajectory->radii.end());
+	if (!m_trajectory->instances.empty()) {
+		qInfo() << "Drawing" << m_trajectory->instances.size() << "instances of" << m_trajectory->nrAtoms() << "atoms";
+	}
+
+	if (m_trajectory->isStreamed()) {
+		m_prefetcher = new FramePrefetcher(m_trajectory->source());
+		m_prefetcher->seek(0, 1);
+		m_prefetcher->start();
+	}
 
     // TODO: uncomment after shader is correctly loaded
     m_program_molecules->bind();
@@ -187,98 +234,286 @@ void GLWidget::initMoleculeRenderMode(std::vector<std::vector<Atom> > *animation
     // TODO: uncomment after shader is correctly loaded
    m_program_molecules->release();
 
-	allocateGPUBuffer(0);
+	initGPUBuffers();
+	uploadFrame(0);
 }
 
-void GLWidget::allocateGPUBuffer(int frameNr)
+void GLWidget::releaseTrajectory()
 {
-	// makes the widget's rendering context the current OpenGL rendering context
-	makeCurrent();
+	// the prefetch thread reads from the trajectory source, stop it first
+	delete m_prefetcher;
+	m_prefetcher = nullptr;
 
-    // load atoms for current frame
-    m_nrAtoms = (*m_animation)[frameNr].size();
-    m_pos.clear();
-	m_radii.clear();
-	m_colors.clear();
-    m_ambOcc.clear();
+	m_trajectory = nullptr;
+	m_framePositions = nullptr;
+	m_isPlaying = false;
+	m_currentFrame = 0;
+	m_uploadedFrame = -1;
+	m_nrAtoms = 0;
+	m_frameTimeReport = REPORT_NONE;
+	renderMode = RenderMode::NONE;
+}
 
-    for (size_t i = 0; i < m_nrAtoms; i++) {
-		Atom atom = (*m_animation)[frameNr][i];
-		m_pos.push_back(atom.position);
-		m_radii.push_back(atom.radius);
-		m_colors.push_back(atom.color);
-	}
+void GLWidget::initGPUBuffers()
+{
+	m_uploadTimer.start();
+	m_nrAtoms = m_trajectory->nrAtoms();
+
+	// structures are uploaded once, quantization only pays off for the frames of trajectories
+	m_quantized = m_quantizePositions && m_trajectory->nrFrames() > 1;
+	m_frameQuantization.assign(m_quantized ? m_trajectory->nrFrames() : 0, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	m_positionQuantization = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	m_quantizationError = 0.0f;
 
     QOpenGLVertexArrayObject::Binder vaoBinder(&m_vao_molecules); // destructor unbinds (i.e. when out of scope)
-	QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
 
 	if (!m_program_molecules->bind()) {
-		qDebug() << "Error binding shader in allocateGPUBuffer";
+		qDebug() << "Error binding shader in initGPUBuffers";
 	}
 
-    // TODO: allocate data to buffers (positions, radii, colors) and bind buffers to shaders
-	// POSITION
-	if (!m_vbo_pos.create()) {
-		qDebug() << "Error creating vbo_pos";
+	// POSITION, written per frame into a ring of three frames
+	if (!m_positionStream.create(positionBytes())) {
+		qDebug() << "Error creating position stream";
 	}
-	m_vbo_pos.setUsagePattern(QOpenGLBuffer::StaticDraw);
-	if (!m_vbo_pos.bind()) {
-		qDebug() << "Error binding vbo_pos";
+	m_positionBuffer = m_positionStream.bufferId();
+	m_positionOffset = 0;
+	qInfo() << "Streaming positions through" << (m_positionStream.isPersistent() ? "a persistently mapped" : "an orphaned")
+		<< "buffer of" << m_positionStream.size() / (1024 * 1024) << "MB" << (m_quantized ? "as 16-bit integers" : "");
+
+	// FRAME CACHE, frames that fit into the budget stay on the GPU once shown, a structure needs none
+	m_frameCache.destroy();
+	m_frameCacheFill = 0;
+	if (m_trajectory->nrFrames() > 1) {
+		size_t budget = m_frameCacheBudget;
+		glGetIntegerv(GL_GPU_MEM_INFO_CURRENT_AVAILABLE_MEM_NVX, &cur_avail_mem_kb);
+		if (cur_avail_mem_kb > 0) {
+			budget = std::min(budget, size_t(cur_avail_mem_kb) * 1024 / 2);
+		}
+		if (m_frameCache.create(m_trajectory->nrFrames(), positionBytes(), budget)) {
+			qInfo() << "Caching" << m_frameCache.nrSlots() << "of" << m_trajectory->nrFrames() << "frames on the GPU ("
+				<< m_frameCache.size() / (1024 * 1024) << "MB)";
+		}
 	}
 
-	float * flat_array_pos = &m_pos[0].x;
-	m_vbo_pos.allocate(flat_array_pos, 3*m_nrAtoms * sizeof(float));
-
-	m_program_molecules->setAttributeBuffer("atomPos", GL_FLOAT, 0, 3);
-	m_program_molecules->enableAttributeArray("atomPos");
-
-	m_vbo_pos.release();
-
-	// COLOR
+	// COLOR, uploaded once per trajectory
 	if (!m_vbo_colors.create()) {
-		qDebug() << "Error creating vbo_pos";
+		qDebug() << "Error creating vbo_colors";
 	}
 	m_vbo_colors.setUsagePattern(QOpenGLBuffer::StaticDraw);
 	if (!m_vbo_colors.bind()) {
-		qDebug() << "Error binding vbo_pos";
+		qDebug() << "Error binding vbo_colors";
 	}
 
-	float * flat_array_color = &m_colors[0].x;
+	const float * flat_array_color = &m_trajectory->colors[0].x;
 	m_vbo_colors.allocate(flat_array_color, 3 * m_nrAtoms * sizeof(float));
 
-
-	m_program_molecules->setAttributeBuffer("inputColor", GL_FLOAT, 0, 3);
-	m_program_molecules->enableAttributeArray("inputColor");
-
 	m_vbo_colors.release();
 
-	// RADIUS
+	// RADIUS, uploaded once per trajectory
 	if (!m_vbo_radii.create()) {
-		qDebug() << "Error creating vbo_pos";
+		qDebug() << "Error creating vbo_radii";
 	}
 	m_vbo_radii.setUsagePattern(QOpenGLBuffer::StaticDraw);
 	if (!m_vbo_radii.bind()) {
-		qDebug() << "Error binding vbo_pos";
+		qDebug() << "Error binding vbo_radii";
 	}
 
-	float * flat_array_radii = &m_radii[0];
+	const float * flat_array_radii = &m_trajectory->radii[0];
 	m_vbo_radii.allocate(flat_array_radii, m_nrAtoms * sizeof(float));
 
-	m_program_molecules->setAttributeBuffer("inputRadius", GL_FLOAT, 0, 1);
-	m_program_molecules->enableAttributeArray("inputRadius");
-
 	m_vbo_radii.release();
 
+	// INSTANCES, the transforms of the visible copies of an assembly are written per frame
+	if (!m_vbo_instances.create()) {
+		qDebug() << "Error creating vbo_instances";
+	}
+	m_vbo_instances.setUsagePattern(QOpenGLBuffer::StreamDraw);
+	if (!m_vbo_instances.bind()) {
+		qDebug() << "Error binding vbo_instances";
+	}
+
+	const glm::mat4 identity(1.0f);
+	m_vbo_instances.allocate(glm::value_ptr(identity), int(sizeof(glm::mat4)));
 
+	m_vbo_instances.release();
 
 	m_program_molecules->release();
 
+	bindAttributes();
+
     // display memory usage
     glGetIntegerv(GL_GPU_MEM_INFO_TOTAL_AVAILABLE_MEM_NVX, &total_mem_kb);
     glGetIntegerv(GL_GPU_MEM_INFO_CURRENT_AVAILABLE_MEM_NVX, &cur_avail_mem_kb);
     m_MainWindow->displayUsedGPUMemory(float(total_mem_kb - cur_avail_mem_kb) / 1024.0f);
 }
 
+void GLWidget::bindAttributes()
+{
+	QOpenGLVertexArrayObject::Binder vaoBinder(&m_vao_molecules); // destructor unbinds (i.e. when out of scope)
+
+	bindPositions();
+	m_program_molecules->enableAttributeArray("atomPos");
+
+	m_vbo_colors.bind();
+	m_program_molecules->setAttributeBuffer("inputColor", GL_FLOAT, 0, 3);
+	m_program_molecules->enableAttributeArray("inputColor");
+	m_vbo_colors.release();
+
+	m_vbo_radii.bind();
+	m_program_molecules->setAttributeBuffer("inputRadius", GL_FLOAT, 0, 1);
+	m_program_molecules->enableAttributeArray("inputRadius");
+	m_vbo_radii.release();
+
+	// a mat4 attribute takes four vec4 locations, advanced once per instance
+	m_vbo_instances.bind();
+	const int instanceLocation = m_program_molecules->attributeLocation("instanceMatrix");
+	if (instanceLocation >= 0) {
+		QOpenGLExtraFunctions *ef = QOpenGLContext::currentContext()->extraFunctions();
+		for (int column = 0; column < 4; column++) {
+			m_program_molecules->setAttributeBuffer(instanceLocation + column, GL_FLOAT, column * int(sizeof(glm::vec4)), 4,
+				int(sizeof(glm::mat4)));
+			m_program_molecules->enableAttributeArray(instanceLocation + column);
+			ef->glVertexAttribDivisor(GLuint(instanceLocation + column), 1);
+		}
+	}
+	m_vbo_instances.release();
+}
+
+void GLWidget::bindPositions()
+{
+	// the VAO records the buffer with the attribute pointer
+	glBindBuffer(GL_ARRAY_BUFFER, m_positionBuffer);
+	const int positionLocation = m_program_molecules->attributeLocation("atomPos");
+	if (positionLocation >= 0) {
+		glVertexAttribPointer(GLuint(positionLocation), 3, m_quantized ? GL_SHORT : GL_FLOAT, m_quantized ? GL_TRUE : GL_FALSE, 0,
+			reinterpret_cast<const void *>(m_positionOffset));
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+size_t GLWidget::positionBytes() const
+{
+	return 3 * m_nrAtoms * (m_quantized ? sizeof(int16_t) : sizeof(float));
+}
+
+const int16_t *GLWidget::quantizePositions(int frameNr, const float *positions)
+{
+	// the bounding box of the frame maps to [-1, 1], the largest half extent to 32767; the loader
+	// computed the bounds of loaded frames, those of streamed frames are computed here
+	const std::vector<Trajectory::Bounds> &frameBounds = m_trajectory->frameBounds;
+	const Trajectory::Bounds bounds = size_t(frameNr) < frameBounds.size() ? frameBounds[frameNr]
+		: Trajectory::computeBounds(positions, m_nrAtoms);
+	const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+	const glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+	const float scale = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-3f));
+
+	m_quantizedPositions.resize(3 * m_nrAtoms);
+	SimdKernels::quantize16(positions, 3 * m_nrAtoms, &center.x, 32767.0f / scale, m_quantizedPositions.data());
+	m_frameQuantization[frameNr] = glm::vec4(center, scale);
+
+	// rounding is off by half a step, float arithmetic adds a fraction of it
+	m_quantizationError = std::max(m_quantizationError, scale / 32767.0f);
+	return m_quantizedPositions.data();
+}
+
+bool GLWidget::uploadFrame(int frameNr)
+{
+	// makes the widget's rendering context the current OpenGL rendering context
+	makeCurrent();
+
+    if (!m_trajectory || !m_positionStream.isCreated() || frameNr < 0 || size_t(frameNr) >= m_trajectory->loadedFrames()) {
+		return false; // not loaded (yet)
+	}
+
+	// a cached frame is drawn from its slot, it needs no upload
+	const int slot = m_frameCache.lookup(frameNr);
+
+    // atoms of the current frame, positions are a view into the trajectory or the prefetched frame
+	const float * flat_array_pos = nullptr;
+	if (m_prefetcher) {
+		flat_array_pos = m_prefetcher->acquire(frameNr);
+	}
+	else {
+		flat_array_pos = m_trajectory->framePositions(frameNr);
+	}
+	if (flat_array_pos) {
+		m_framePositions = flat_array_pos; // the fixed function pipeline draws from the CPU
+	}
+	else if (slot < 0) {
+		return false; // not prefetched yet, keep the previous frame
+	}
+	const bool firstUpload = m_uploadedFrame < 0;
+	m_uploadedFrame = frameNr;
+
+	// view all of the first frame (all copies of an assembly) from the default direction around the
+	// origin; structures are centered by the loader, trajectories keep their coordinates
+	if (firstUpload) {
+		const std::vector<Trajectory::Bounds> &frameBounds = m_trajectory->frameBounds;
+		const Trajectory::Bounds bounds = m_trajectory->instanceBounds(size_t(frameNr) < frameBounds.size()
+			? frameBounds[frameNr] : Trajectory::computeBounds(flat_array_pos, m_nrAtoms));
+		m_camera.fitSphere(std::max(glm::length(bounds.min), glm::length(bounds.max)));
+	}
+
+	if (slot >= 0) {
+		m_positionBuffer = m_frameCache.bufferId();
+		m_positionOffset = m_frameCache.offset(slot);
+		if (m_quantized) {
+			m_positionQuantization = m_frameQuantization[frameNr];
+		}
+	}
+	else {
+		// a single copy of the positions per frame, colors and radii stay on the GPU
+		const void *data = flat_array_pos;
+		if (m_quantized) {
+			data = quantizePositions(frameNr, flat_array_pos);
+			m_positionQuantization = m_frameQuantization[frameNr];
+		}
+		m_positionBuffer = m_positionStream.bufferId();
+		m_positionOffset = m_positionStream.write(data, positionBytes());
+		if (m_frameCache.isCreated()) {
+			m_frameCache.insert(frameNr, m_positionBuffer, m_positionOffset);
+		}
+	}
+
+	QOpenGLVertexArrayObject::Binder vaoBinder(&m_vao_molecules); // destructor unbinds (i.e. when out of scope)
+	bindPositions();
+
+	// the upload of a structure is timed until the driver has copied the data
+	if (firstUpload && renderMode == RenderMode::PDB) {
+		glFinish();
+		const size_t bytes = positionBytes() + m_nrAtoms * 4 * sizeof(float); // positions, colors and radii
+		qInfo() << "Uploaded" << m_nrAtoms << "atoms (" << bytes / (1024 * 1024) << "MB) in" << m_uploadTimer.elapsed() << "ms";
+		m_frameTimeReport = REPORT_WARMUP;
+		m_previousTimeFPS = m_fpsTimer.elapsed();
+		m_frameCount = 0;
+	}
+    return true;
+}
+
+void GLWidget::fillFrameCache()
+{
+	// streamed trajectories only hold the prefetched frames, they are cached as they are shown
+	if (!m_frameCache.isResident() || m_prefetcher) {
+		return;
+	}
+
+	// frames are filled in order as the loader provides them, at least one per call
+	const size_t loadedFrames = m_trajectory->loadedFrames();
+	size_t bytes = 0;
+	while (m_frameCacheFill < loadedFrames && bytes < fillBytesPerFrame) {
+		const int frameNr = int(m_frameCacheFill++);
+		if (m_frameCache.isCached(frameNr)) {
+			continue;
+		}
+		const void *data = m_trajectory->framePositions(frameNr);
+		if (m_quantized) {
+			data = quantizePositions(frameNr, m_trajectory->framePositions(frameNr));
+		}
+		m_frameCache.insert(frameNr, data);
+		bytes += positionBytes();
+	}
+}
+
 bool GLWidget::loadMoleculeShader()
 {
     bool success = false;
@@ -314,7 +549,6 @@ void GLWidget::paintGL()
         case(RenderMode::NONE):
             break; // do nothing
         case(RenderMode::PDB):
-            break; // optional
         case(RenderMode::NETCDF):
             drawMolecules();
             break;
@@ -340,13 +574,27 @@ void GLWidget::drawMolecules()
 			elapsed -= msPerFrame;
 
 		}
-		if (m_currentFrame >= (*m_animation).size()) {
-			m_currentFrame = (*m_animation).size() - 1;
+		if (m_currentFrame >= int(m_trajectory->nrFrames())) {
+			m_currentFrame = int(m_trajectory->nrFrames()) - 1;
 			m_isPlaying = false;
+			reportPlayback();
+		}
+		else if (m_currentFrame >= int(m_trajectory->loadedFrames())) {
+			// wait for the loader
+			m_currentFrame = std::max(int(m_trajectory->loadedFrames()) - 1, 0);
 		}
 
 		m_MainWindow->setAnimationFrameGUI(m_currentFrame);
-		allocateGPUBuffer(m_currentFrame);
+	}
+
+	// upload the current frame once it is available, prefetched frames never block
+	if (m_uploadedFrame != m_currentFrame) {
+		uploadFrame(m_currentFrame);
+	}
+	fillFrameCache();
+	if (m_uploadedFrame < 0) {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		return;
 	}
 
 	if (isImposerRendering) {
@@ -377,6 +625,13 @@ void GLWidget::drawMolecules()
 		int projMatrixId = m_program_molecules->uniformLocation("proj");
 		glUniformMatrix4fv(projMatrixId, 1, GL_FALSE, glm::value_ptr(m_camera.getProjectionMatrix()));
 
+		// dequantization of 16-bit positions, identity for floats
+		int positionOffsetId = m_program_molecules->uniformLocation("positionOffset");
+		glUniform3fv(positionOffsetId, 1, &m_positionQuantization.x);
+
+		int positionScaleId = m_program_molecules->uniformLocation("positionScale");
+		glUniform1f(positionScaleId, m_positionQuantization.w);
+
 		int lightPosId = m_program_molecules->uniformLocation("lightPos");
 		glUniform1fv(lightPosId, 1, light_position);
 
@@ -402,8 +657,14 @@ void GLWidget::drawMolecules()
 		glUniform1f(screenHeightId, m_viewport[3]);
 
 
-		// draw call
-		glDrawArrays(GL_POINTS, 0, m_nrAtoms);
+		// draw call, one for all visible copies of an assembly
+		const GLsizei nrInstances = GLsizei(uploadVisibleInstances());
+		beginDrawQuery();
+		if (nrInstances > 0) {
+			QOpenGLContext::currentContext()->extraFunctions()->glDrawArraysInstanced(GL_POINTS, 0, GLsizei(m_nrAtoms), nrInstances);
+		}
+		endDrawQuery();
+		m_positionStream.fence();
 
 		m_program_molecules->release();
 
@@ -414,7 +675,8 @@ void GLWidget::drawMolecules()
 
         // simplistic implementation using OpenGL fixed function pipeline
 
-        size_t m_nrAtoms = (*m_animation)[m_currentFrame].size();
+        size_t m_nrAtoms = m_trajectory->nrAtoms();
+        const float *positions = m_framePositions;
 
         // setup light source and material
 
@@ -452,29 +714,81 @@ void GLWidget::drawMolecules()
 
 		glLightfv(GL_LIGHT0, GL_POSITION, light_position);
 
-        // draw actual spheres (not imposters)
+        // draw actual spheres (not imposters), once per copy of an assembly
 
 		er = glGetError();
-		//for (size_t i = 0; i < 1; i++) {
-        for (size_t i = 0; i < m_nrAtoms; i++) { //
-			Atom atom = (*m_animation)[m_currentFrame][i];
+		const std::vector<glm::mat4> identity(1, glm::mat4(1.0f));
+		const std::vector<glm::mat4> &instances = m_trajectory->instances.empty() ? identity : m_trajectory->instances;
+		for (size_t instance = 0; instance < instances.size(); instance++) {
 			glPushMatrix();
-            GLUquadric *quadric; // object to draw quadrics (surfaces described by second degree equation, e.g. ellipsoids like spheres)
-            quadric = gluNewQuadric();
-			//set color and position
-			glColor4f(atom.color.r, atom.color.g, atom.color.b, 1);
-			glTranslatef(atom.position.x, atom.position.y, atom.position.z);
-			er = glGetError();
-            gluSphere(quadric, atom.radius, 40, 40); // 40 vertical (polar angle) and horizontal (azimuthal angle) samples of the quadric function
-			er = glGetError();
+			glMultMatrixf(glm::value_ptr(instances[instance]));
+			//for (size_t i = 0; i < 1; i++) {
+            for (size_t i = 0; i < m_nrAtoms; i++) { //
+				const glm::vec3 &color = m_trajectory->colors[i];
+				const float *position = positions + i * 3;
+				glPushMatrix();
+                GLUquadric *quadric; // object to draw quadrics (surfaces described by second degree equation, e.g. ellipsoids like spheres)
+                quadric = gluNewQuadric();
+				//set color and position
+				glColor4f(color.r, color.g, color.b, 1);
+				glTranslatef(position[0], position[1], position[2]);
+				er = glGetError();
+                gluSphere(quadric, m_trajectory->radii[i], 40, 40); // 40 vertical (polar angle) and horizontal (azimuthal angle) samples of the quadric function
+				er = glGetError();
+				glPopMatrix();
+                gluDeleteQuadric(quadric);
+			}
 			glPopMatrix();
-            gluDeleteQuadric(quadric);
 		}
 	}
 
 
 }
 
+size_t GLWidget::uploadVisibleInstances()
+{
+	m_visibleInstances.clear();
+
+	const std::vector<glm::mat4> &instances = m_trajectory->instances;
+	if (instances.empty()) {
+		m_visibleInstances.push_back(glm::mat4(1.0f));
+	}
+	else if (m_uploadedFrame < 0 || size_t(m_uploadedFrame) >= m_trajectory->frameBounds.size()
+		|| size_t(m_uploadedFrame) >= m_trajectory->loadedFrames()) {
+		m_visibleInstances = instances; // no bounds to cull with, the loader writes those of later frames
+	}
+	else {
+		Trajectory::Bounds bounds = m_trajectory->frameBounds[m_uploadedFrame];
+		bounds.min -= glm::vec3(m_maxRadius);
+		bounds.max += glm::vec3(m_maxRadius);
+
+		// an instance is culled if the corners of its bounds in clip space are all outside of
+		// the same frustum plane
+		const glm::mat4 viewProjection = m_camera.getProjectionMatrix() * m_camera.getViewMatrix();
+		for (size_t i = 0; i < instances.size(); i++) {
+			const glm::mat4 transform = viewProjection * instances[i];
+			unsigned outside = 0x3f;
+			for (int c = 0; c < 8 && outside != 0; c++) {
+				const glm::vec4 corner((c & 1) ? bounds.max.x : bounds.min.x, (c & 2) ? bounds.max.y : bounds.min.y,
+					(c & 4) ? bounds.max.z : bounds.min.z, 1.0f);
+				const glm::vec4 p = transform * corner;
+				outside &= (p.x < -p.w ? 0x01u : 0u) | (p.x > p.w ? 0x02u : 0u) | (p.y < -p.w ? 0x04u : 0u)
+					| (p.y > p.w ? 0x08u : 0u) | (p.z < -p.w ? 0x10u : 0u) | (p.z > p.w ? 0x20u : 0u);
+			}
+			if (outside == 0) {
+				m_visibleInstances.push_back(instances[i]);
+			}
+		}
+	}
+
+	if (!m_visibleInstances.empty()) {
+		m_vbo_instances.bind();
+		m_vbo_instances.allocate(glm::value_ptr(m_visibleInstances[0]), int(m_visibleInstances.size() * sizeof(glm::mat4)));
+		m_vbo_instances.release();
+	}
+	return m_visibleInstances.size();
+}
+
 void GLWidget::calculateFPS()
 {
 	m_frameCount++;
@@ -488,6 +802,18 @@ void GLWidget::calculateFPS()
 		// calculate the number of frames per second
 		m_fps = m_frameCount / (timeInterval / 1000.0f);
 
+		if (m_frameTimeReport == REPORT_MEASURING) {
+			qInfo() << "Steady-state frame time" << float(timeInterval) / std::max<size_t>(m_frameCount, 1) << "ms,"
+				<< "GPU draw time" << (m_drawSamples > 0 ? m_drawTimeNs / 1e6 / m_drawSamples : 0.0) << "ms for"
+				<< m_nrAtoms << "atoms," << m_visibleInstances.size() << "instances," << m_positionStream.stalls() << "upload stalls";
+			m_frameTimeReport = REPORT_NONE;
+		}
+		else if (m_frameTimeReport == REPORT_WARMUP) {
+			m_frameTimeReport = REPORT_MEASURING;
+		}
+		m_drawTimeNs = 0;
+		m_drawSamples = 0;
+
 		m_previousTimeFPS = currentTime;
 		m_frameCount = 0;
 	}
@@ -497,6 +823,32 @@ void GLWidget::calculateFPS()
 
 
 
+void GLWidget::beginDrawQuery()
+{
+	if (!m_drawQuery.isCreated()) {
+		return;
+	}
+
+	// collect the result of the previous query without waiting for the GPU
+	if (m_drawQueryPending) {
+		if (!m_drawQuery.isResultAvailable()) {
+			return;
+		}
+		m_drawTimeNs += qint64(m_drawQuery.waitForResult());
+		m_drawSamples++;
+		m_drawQueryPending = false;
+	}
+	m_drawQuery.begin();
+}
+
+void GLWidget::endDrawQuery()
+{
+	if (m_drawQuery.isCreated() && !m_drawQueryPending) {
+		m_drawQuery.end();
+		m_drawQueryPending = true;
+	}
+}
+
 void GLWidget::resizeGL(int w, int h)
 {
 	m_camera.setAspect(float(w) / h);
@@ -574,11 +926,20 @@ void GLWidget::fileChanged(const QString &path)
 	initglsw();
 
 	loadMoleculeShader();
+
+	// attribute locations of the relinked program
+	if (m_positionStream.isCreated()) {
+		makeCurrent();
+		bindAttributes();
+	}
 	update();
 }
 
 void GLWidget::playAnimation()
 {
+	if (m_prefetcher) {
+		m_prefetcher->seek(m_uploadedFrame == m_currentFrame ? m_currentFrame + 1 : m_currentFrame, 1);
+	}
 	m_AnimationTimer.start();
 	m_lastTime = 0;
 	m_isPlaying = true;
@@ -587,6 +948,18 @@ void GLWidget::playAnimation()
 void GLWidget::pauseAnimation()
 {
 	m_isPlaying = false;
+	reportPlayback();
+}
+
+void GLWidget::reportPlayback()
+{
+	if (m_trajectory && m_quantized) {
+		qInfo() << "16-bit positions: error at most" << m_quantizationError << "per coordinate";
+	}
+	if (m_trajectory && m_frameCache.isCreated()) {
+		qInfo() << "GPU frame cache:" << m_frameCache.hits() << "hits," << m_frameCache.misses() << "misses,"
+			<< m_frameCache.nrSlots() << "of" << m_trajectory->nrFrames() << "frames" << (m_frameCache.isResident() ? "(resident)" : "(LRU)");
+	}
 }
 
 bool GLWidget::isPlaying()
@@ -596,7 +969,14 @@ bool GLWidget::isPlaying()
 
 void GLWidget::setAnimationFrame(int frameNr)
 {
-	qDebug() << frameNr;
+	if (frameNr == m_currentFrame) {
+		return; // slider update during playback
+	}
+
+	// prefetch in scrubbing direction
+	if (m_prefetcher) {
+		m_prefetcher->seek(frameNr, (m_isPlaying || frameNr > m_currentFrame) ? 1 : -1);
+	}
 	m_currentFrame = frameNr;
-	allocateGPUBuffer(frameNr);
+	uploadFrame(frameNr);
 }
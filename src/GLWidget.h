@@ -15,12 +15,17 @@
 #include <QOpenGLBuffer>
 #include <QGLShader>
 #include <QOpenGLShaderProgram>
+#include <QOpenGLTimerQuery>
 #include <QFileSystemWatcher>
 #include <QElapsedTimer>
 #include <QTimer>
 
 #include "Camera.h"
+#include "FramePrefetcher.h"
+#include "GpuFrameCache.h"
 #include "PdbLoader.h"
+#include "StreamBuffer.h"
+#include "Trajectory.h"
 
 class MainWindow;
 
@@ -29,16 +34,32 @@ class GLWidget : public QOpenGLWidget, protected QOpenGLFunctions
 	Q_OBJECT
 
 public:
+	enum RenderMode
+	{
+		NONE,
+        PDB,   // RCSB Protein Data Bank files
+        NETCDF // Network Common Data Form files (and other trajectories)
+	};
+
 	GLWidget(QWidget *parent, MainWindow *mainWindow);
 	~GLWidget();
 
-	void initMoleculeRenderMode(std::vector<std::vector<Atom> > *animation);
+	// PDB structures are framed by the camera, their upload and frame times are reported
+	void initMoleculeRenderMode(Trajectory *trajectory, RenderMode mode = NETCDF);
+	void releaseTrajectory();
 
 	void playAnimation();
 	void pauseAnimation();
 	bool isPlaying();
 	void setAnimationFrame(int frameNr);
 
+	// GPU memory for frames of the next trajectory, capped at half of the available memory
+	void setFrameCacheBudget(size_t bytes) { m_frameCacheBudget = bytes; }
+
+	// positions of the frames of the next trajectory as normalized 16-bit integers relative to the
+	// bounding box of each frame, half the upload and GPU memory of floats
+	void setPositionQuantization(bool enabled) { m_quantizePositions = enabled; }
+
 	float ambientFactor;
 	float diffuseFactor;
 	float specularFactor;
@@ -49,12 +70,7 @@ public:
 		return this->grabFramebuffer();
 	}
 
-	enum RenderMode
-	{
-		NONE,
-        PDB,   // RCSB Protein Data Bank files
-        NETCDF // Network Common Data Form files
-	} renderMode;
+	RenderMode renderMode;
 
 public slots:
 	void cleanup();
@@ -87,19 +103,46 @@ private:
 
 	void initglsw();
 
-	void allocateGPUBuffer(int frameNr);
+	// colors, radii and the position stream of the trajectory, once per trajectory
+	void initGPUBuffers();
+	void bindAttributes();
+	void bindPositions(); // atomPos of the uploaded frame
+
+	// bytes of the positions of a frame on the GPU
+	size_t positionBytes() const;
+
+	// 16-bit positions of a frame, valid until the next call; stores the dequantization of the frame
+	const int16_t *quantizePositions(int frameNr, const float *positions);
+
+	// positions of a frame from the frame cache or copied to the position stream,
+	// false if they are not available (yet)
+	bool uploadFrame(int frameNr);
+
+	// uploads the next loaded frames to a resident frame cache, a few MB per call, so that scrubbing
+	// a trajectory in memory needs no uploads
+	void fillFrameCache();
+
+	// precision of quantized positions and frame cache hits, when playback stops
+	void reportPlayback();
+
+	// writes the transforms of the instances that may be visible to the instance buffer, culled
+	// with the bounds of the uploaded frame; returns their number
+	size_t uploadVisibleInstances();
 
 	void calculateFPS();
 
+	// GPU time of the draw call, measured in every frame whose previous query has completed
+	void beginDrawQuery();
+	void endDrawQuery();
+
 	Camera m_camera;
 
     size_t m_nrAtoms;
 		
     // CPU atom data
-    std::vector<std::vector<Atom> > *m_animation; // one atom vector for each frame
-	std::vector<glm::vec3> m_pos;
-	std::vector<float> m_radii;
-	std::vector<glm::vec3> m_colors;
+    Trajectory *m_trajectory; // topology and positions of all frames
+	FramePrefetcher *m_prefetcher; // reads ahead of the playhead for streamed trajectories
+	const float *m_framePositions; // positions of the uploaded frame
 	std::vector<glm::vec3> m_ambOcc;
 	
     // GPU atom data and shaders
@@ -109,10 +152,26 @@ private:
 	QOpenGLShader *m_geomShader;
 	QOpenGLShader *m_fragmentShader;
 
-	QOpenGLBuffer m_vbo_pos;
+	StreamBuffer m_positionStream; // positions of the last frames, one is written per animation step
+	GpuFrameCache m_frameCache; // frames shown before, copied from the position stream, or filled ahead if resident
+	size_t m_frameCacheBudget;
+	size_t m_frameCacheFill; // frames up to this one are cached if the cache is resident
+	GLuint m_positionBuffer; // stream or cache buffer of the uploaded frame
+	size_t m_positionOffset; // of the uploaded frame in m_positionBuffer
+
+	bool m_quantizePositions;
+	bool m_quantized; // positions of the trajectory are uploaded as 16-bit integers
+	std::vector<int16_t> m_quantizedPositions;
+	std::vector<glm::vec4> m_frameQuantization; // center and scale of the bounding box per frame
+	glm::vec4 m_positionQuantization; // of the uploaded frame, (0, 0, 0, 1) for floats
+	float m_quantizationError; // largest of the uploaded frames, per coordinate
 	QOpenGLBuffer m_vbo_radii;
 	QOpenGLBuffer m_vbo_colors;
 	QOpenGLBuffer m_vbo_ambOcc;
+	QOpenGLBuffer m_vbo_instances; // mat4 per instance, a single identity without assembly
+
+	std::vector<glm::mat4> m_visibleInstances;
+	float m_maxRadius; // atoms reach beyond the bounds of their centers
 
 	// ------------------------------
 	
@@ -124,9 +183,11 @@ private:
 	QFileSystemWatcher *m_fileWatcher;
 
 	int m_currentFrame;
+	int m_uploadedFrame;
 	bool m_isPlaying;
 	qint64 m_lastTime;
 	QElapsedTimer m_AnimationTimer;
+	QElapsedTimer m_uploadTimer; // of a structure, until its first frame is on the GPU
 
 	// vars to measure fps
 	size_t m_frameCount;
@@ -134,6 +195,19 @@ private:
 	qint64 m_previousTimeFPS;
 	QElapsedTimer m_fpsTimer;
 
+	// steady-state frame time of PDB structures: the first second after the upload is skipped,
+	// the frame and GPU draw times of the next second are reported
+	enum FrameTimeReport
+	{
+		REPORT_NONE,
+		REPORT_WARMUP,
+		REPORT_MEASURING
+	} m_frameTimeReport;
+	QOpenGLTimerQuery m_drawQuery;
+	bool m_drawQueryPending;
+	qint64 m_drawTimeNs;
+	size_t m_drawSamples;
+
     // memory usage
     GLint total_mem_kb = 0;
     GLint cur_avail_mem_kb = 0;
@@ -0,0 +1,124 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "GpuFrameCache.h"
+
+#include <algorithm>
+#include <limits>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+namespace
+{
+	// slots start at aligned offsets whatever the size of a frame (e.g. 6 bytes per atom)
+	const size_t SLOT_ALIGNMENT = 256;
+}
+
+GpuFrameCache::GpuFrameCache()
+	: m_buffer(QOpenGLBuffer::VertexBuffer), m_frameBytes(0), m_slotBytes(0), m_clock(0), m_hits(0), m_misses(0)
+{
+}
+
+bool GpuFrameCache::create(size_t nrFrames, size_t frameBytes, size_t budgetBytes)
+{
+	destroy();
+
+	// QOpenGLBuffer allocates at most 2 GB
+	budgetBytes = std::min(budgetBytes, size_t(std::numeric_limits<int>::max()));
+	const size_t slotBytes = (frameBytes + SLOT_ALIGNMENT - 1) / SLOT_ALIGNMENT * SLOT_ALIGNMENT;
+	const size_t nrSlots = frameBytes > 0 ? std::min(nrFrames, budgetBytes / slotBytes) : 0;
+	if (nrSlots == 0 || !m_buffer.create()) {
+		return false;
+	}
+
+	m_buffer.setUsagePattern(QOpenGLBuffer::DynamicCopy);
+	m_buffer.bind();
+	m_buffer.allocate(int(nrSlots * slotBytes));
+	m_buffer.release();
+
+	m_frameBytes = frameBytes;
+	m_slotBytes = slotBytes;
+	m_slotOfFrame.assign(nrFrames, -1);
+	m_frameOfSlot.assign(nrSlots, -1);
+	m_lastUse.assign(nrSlots, 0);
+	m_clock = 0;
+	m_hits = 0;
+	m_misses = 0;
+	return true;
+}
+
+void GpuFrameCache::destroy()
+{
+	m_buffer.destroy();
+	m_slotOfFrame.clear();
+	m_frameOfSlot.clear();
+	m_lastUse.clear();
+	m_frameBytes = 0;
+	m_slotBytes = 0;
+}
+
+int GpuFrameCache::lookup(int frameNr)
+{
+	if (frameNr < 0 || size_t(frameNr) >= m_slotOfFrame.size() || m_slotOfFrame[frameNr] < 0) {
+		return -1;
+	}
+	const int slot = m_slotOfFrame[frameNr];
+	m_lastUse[slot] = ++m_clock;
+	m_hits++;
+	return slot;
+}
+
+int GpuFrameCache::insert(int frameNr, GLuint source, size_t sourceOffset)
+{
+	if (frameNr < 0 || size_t(frameNr) >= m_slotOfFrame.size()) {
+		return -1;
+	}
+	if (m_slotOfFrame[frameNr] >= 0) {
+		return lookup(frameNr);
+	}
+	const int slot = assignSlot(frameNr);
+	m_misses++;
+
+	// ordered after the draws that still read the replaced frame, the CPU does not wait
+	QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
+	f->glBindBuffer(GL_COPY_READ_BUFFER, source);
+	f->glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer.bufferId());
+	f->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GLintptr(sourceOffset), GLintptr(offset(slot)),
+		GLsizeiptr(m_frameBytes));
+	f->glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	f->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return slot;
+}
+
+int GpuFrameCache::insert(int frameNr, const void *data)
+{
+	if (frameNr < 0 || size_t(frameNr) >= m_slotOfFrame.size()) {
+		return -1;
+	}
+	if (m_slotOfFrame[frameNr] >= 0) {
+		return m_slotOfFrame[frameNr];
+	}
+	const int slot = assignSlot(frameNr);
+
+	// the driver stages the data, draws from the other slots are not waited for
+	m_buffer.bind();
+	m_buffer.write(int(offset(slot)), data, int(m_frameBytes));
+	m_buffer.release();
+	return slot;
+}
+
+int GpuFrameCache::assignSlot(int frameNr)
+{
+	// empty slots have not been used at all, so they are taken first
+	const int slot = int(std::min_element(m_lastUse.begin(), m_lastUse.end()) - m_lastUse.begin());
+	if (m_frameOfSlot[slot] >= 0) {
+		m_slotOfFrame[m_frameOfSlot[slot]] = -1;
+	}
+	m_frameOfSlot[slot] = frameNr;
+	m_slotOfFrame[frameNr] = slot;
+	m_lastUse[slot] = ++m_clock;
+	return slot;
+}
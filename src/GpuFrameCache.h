@@ -0,0 +1,71 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <vector>
+#include <QOpenGLBuffer>
+
+// Frames of a trajectory kept in the slots of one vertex buffer on the GPU. A slot is filled by a
+// copy on the GPU (glCopyBufferSubData) from the buffer the frame was uploaded to, so caching costs
+// no upload and no synchronization. If all frames fit into the memory budget, every frame keeps its
+// slot and the cache can be filled ahead of the playhead, so scrubbing needs no uploads at all;
+// otherwise the least recently shown frame is replaced.
+// All functions except the accessors require the current context.
+class GpuFrameCache
+{
+public:
+
+	GpuFrameCache();
+
+	// slots for as many frames of frameBytes as fit into budgetBytes, at most nrFrames
+	bool create(size_t nrFrames, size_t frameBytes, size_t budgetBytes);
+	void destroy();
+
+	// slot of a cached frame, which becomes the most recently used one; -1 if the frame is not cached
+	int lookup(int frameNr);
+
+	// copies a frame uploaded to the buffer source at sourceOffset into the least recently used slot
+	int insert(int frameNr, GLuint source, size_t sourceOffset);
+
+	// uploads a frame into the least recently used slot to fill a resident cache, whose empty slots
+	// are not drawn from; counts neither as hit nor as miss
+	int insert(int frameNr, const void *data);
+
+	bool isCached(int frameNr) const
+	{
+		return frameNr >= 0 && size_t(frameNr) < m_slotOfFrame.size() && m_slotOfFrame[frameNr] >= 0;
+	}
+
+	// byte offset of a slot in the buffer
+	size_t offset(int slot) const { return size_t(slot) * m_slotBytes; }
+
+	bool isCreated() const { return m_buffer.isCreated(); }
+	GLuint bufferId() const { return m_buffer.bufferId(); }
+
+	size_t nrSlots() const { return m_frameOfSlot.size(); }
+	bool isResident() const { return isCreated() && nrSlots() == m_slotOfFrame.size(); } // all frames fit
+	size_t size() const { return nrSlots() * m_slotBytes; }
+
+	// lookups of cached frames and inserted frames since create()
+	size_t hits() const { return m_hits; }
+	size_t misses() const { return m_misses; }
+
+private:
+
+	// least recently used slot, taken from its frame and given to frameNr
+	int assignSlot(int frameNr);
+
+	QOpenGLBuffer m_buffer;
+	size_t m_frameBytes;
+	size_t m_slotBytes; // frameBytes, aligned
+	std::vector<int> m_slotOfFrame; // -1 if not cached
+	std::vector<int> m_frameOfSlot; // -1 if empty
+	std::vector<size_t> m_lastUse;  // clock of the last lookup or insert per slot, 0 if empty
+	size_t m_clock;
+	size_t m_hits;
+	size_t m_misses;
+};
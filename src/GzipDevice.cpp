@@ -0,0 +1,286 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "GzipDevice.h"
+
+#include <algorithm>
+#include <cstring>
+#include <QThread>
+#include <zlib.h>
+
+namespace
+{
+	const size_t INPUT_BYTES = 1 << 18;
+
+	// window of 32 KB, gzip or zlib header detected automatically
+	const int WINDOW_BITS = 15 + 32;
+}
+
+class GzipDevice::Worker : public QThread
+{
+public:
+
+	explicit Worker(GzipDevice &device)
+		: m_device(device)
+	{
+	}
+
+protected:
+
+	void run() Q_DECL_OVERRIDE
+	{
+		m_device.inflateAll();
+	}
+
+private:
+
+	GzipDevice &m_device;
+};
+
+GzipDevice::GzipDevice(const QString &path, bool threaded, size_t blockBytes, size_t depth)
+	: m_file(path), m_memberEnded(false), m_blocks(std::max(depth, size_t(1))), m_ready(m_blocks.size() + 1),
+	m_free(m_blocks.size()), m_threaded(threaded), m_stop(false), m_failed(false), m_compressedPos(0),
+	m_current(-1), m_currentPos(0), m_endReached(false)
+{
+	for (size_t i = 0; i < m_blocks.size(); i++) {
+		m_blocks[i].data.resize(blockBytes);
+		m_blocks[i].size = 0;
+	}
+}
+
+GzipDevice::~GzipDevice()
+{
+	close();
+}
+
+bool GzipDevice::isCompressed(const QString &path)
+{
+	return path.endsWith(".gz", Qt::CaseInsensitive);
+}
+
+QString GzipDevice::uncompressedName(const QString &path)
+{
+	return isCompressed(path) ? path.left(path.size() - 3) : path;
+}
+
+bool GzipDevice::open(OpenMode mode)
+{
+	if ((mode & QIODevice::WriteOnly) || !m_file.open(QIODevice::ReadOnly)) {
+		setErrorString(m_file.errorString());
+		return false;
+	}
+
+	m_stream.reset(new z_stream);
+	std::memset(m_stream.get(), 0, sizeof(z_stream));
+	if (inflateInit2(m_stream.get(), WINDOW_BITS) != Z_OK) {
+		m_stream.reset();
+		m_file.close();
+		setErrorString("zlib initialization failed");
+		return false;
+	}
+	m_input.resize(INPUT_BYTES);
+	m_memberEnded = false;
+	m_stop = false;
+	m_failed = false;
+	m_compressedPos = 0;
+	m_current = -1;
+	m_endReached = false;
+
+	QIODevice::open(mode | QIODevice::Unbuffered);
+
+	if (m_threaded) {
+		for (size_t i = 0; i < m_blocks.size(); i++) {
+			m_free.push(int(i));
+		}
+		m_worker.reset(new Worker(*this));
+		m_worker->start();
+	}
+	return true;
+}
+
+void GzipDevice::close()
+{
+	if (m_worker) {
+		m_stop = true;
+		{
+			QMutexLocker locker(&m_mutex);
+			m_blockFree.wakeOne();
+		}
+		m_worker->wait();
+		m_worker.reset();
+	}
+	int slot;
+	while (m_ready.pop(slot)) {
+	}
+	while (m_free.pop(slot)) {
+	}
+	if (m_stream) {
+		inflateEnd(m_stream.get());
+		m_stream.reset();
+	}
+	m_file.close();
+	QIODevice::close();
+}
+
+bool GzipDevice::atEnd() const
+{
+	// a failed stream is not at its end until the next read has returned the error
+	return m_endReached && m_current < 0 && !m_failed;
+}
+
+bool GzipDevice::inflateBlock(Block &block)
+{
+	z_stream &stream = *m_stream;
+	stream.next_out = reinterpret_cast<Bytef *>(block.data.data());
+	stream.avail_out = uInt(block.data.size());
+
+	bool more = true;
+	while (stream.avail_out > 0) {
+		if (stream.avail_in == 0) {
+			const qint64 read = m_file.read(m_input.data(), qint64(m_input.size()));
+			if (read < 0) {
+				m_error = m_file.errorString();
+				m_failed = true;
+				more = false;
+				break;
+			}
+			if (read == 0) {
+				if (!m_memberEnded) {
+					m_error = "unexpected end of compressed data";
+					m_failed = true;
+				}
+				more = false;
+				break;
+			}
+			m_compressedPos.fetch_add(read, std::memory_order_relaxed);
+			stream.next_in = reinterpret_cast<Bytef *>(m_input.data());
+			stream.avail_in = uInt(read);
+
+			// the next member of a concatenated file follows the end of the previous one
+			if (m_memberEnded) {
+				inflateReset(&stream);
+				m_memberEnded = false;
+			}
+		}
+
+		const int result = inflate(&stream, Z_NO_FLUSH);
+		if (result == Z_STREAM_END) {
+			m_memberEnded = true;
+			if (stream.avail_in > 0) {
+				inflateReset(&stream);
+				m_memberEnded = false;
+			}
+		}
+		else if (result != Z_OK && result != Z_BUF_ERROR) {
+			m_error = stream.msg ? QString::fromLatin1(stream.msg) : QString("corrupt compressed data");
+			m_failed = true;
+			more = false;
+			break;
+		}
+	}
+
+	block.size = block.data.size() - stream.avail_out;
+	return more;
+}
+
+void GzipDevice::pushReady(int slot)
+{
+	m_ready.push(slot);
+	QMutexLocker locker(&m_mutex);
+	m_blockReady.wakeOne();
+}
+
+void GzipDevice::pushFree(int slot)
+{
+	m_free.push(slot);
+	QMutexLocker locker(&m_mutex);
+	m_blockFree.wakeOne();
+}
+
+void GzipDevice::inflateAll()
+{
+	while (!m_stop.load(std::memory_order_relaxed)) {
+		int slot;
+		if (!m_free.pop(slot)) {
+			// all blocks are full, wait for the reader (or close)
+			QMutexLocker locker(&m_mutex);
+			while (!m_free.pop(slot)) {
+				if (m_stop.load(std::memory_order_relaxed)) {
+					return;
+				}
+				m_blockFree.wait(&m_mutex);
+			}
+		}
+
+		const bool more = inflateBlock(m_blocks[slot]);
+		if (m_blocks[slot].size > 0) {
+			pushReady(slot);
+		}
+		if (!more) {
+			pushReady(-1);
+			return;
+		}
+	}
+}
+
+qint64 GzipDevice::readData(char *data, qint64 maxSize)
+{
+	qint64 copied = 0;
+	while (copied < maxSize) {
+		if (m_current < 0) {
+			if (m_endReached) {
+				break;
+			}
+
+			int slot = -1;
+			if (m_threaded) {
+				if (!m_ready.pop(slot)) {
+					// wait for the worker
+					QMutexLocker locker(&m_mutex);
+					while (!m_ready.pop(slot)) {
+						m_blockReady.wait(&m_mutex);
+					}
+				}
+			}
+			else if (inflateBlock(m_blocks[0]) || m_blocks[0].size > 0) {
+				slot = 0;
+			}
+			if (slot < 0 || m_blocks[slot].size == 0) {
+				m_endReached = true;
+				if (slot >= 0 && m_threaded) {
+					pushFree(slot);
+				}
+				break;
+			}
+			m_current = slot;
+			m_currentPos = 0;
+		}
+
+		const Block &block = m_blocks[m_current];
+		const size_t count = std::min(size_t(maxSize - copied), block.size - m_currentPos);
+		std::memcpy(data + copied, block.data.data() + m_currentPos, count);
+		copied += qint64(count);
+		m_currentPos += count;
+
+		if (m_currentPos == block.size) {
+			if (m_threaded) {
+				pushFree(m_current);
+			}
+			m_current = -1;
+		}
+	}
+
+	if (copied == 0 && m_endReached && m_failed) {
+		setErrorString(m_file.fileName() + ": " + m_error);
+		return -1;
+	}
+	return copied;
+}
+
+qint64 GzipDevice::writeData(const char *, qint64)
+{
+	return -1;
+}
@@ -0,0 +1,98 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <QFile>
+#include <QIODevice>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "SpscQueue.h"
+
+struct z_stream_s;
+
+// Sequential read-only device of the decompressed content of a gzip (or zlib) file, e.g.
+// "1abc.cif.gz", without temporary files. Concatenated gzip members are read as one stream.
+// The file is inflated in blocks into a ring of reusable buffers; a worker thread inflates
+// ahead of the reader, so decompression and parsing run in parallel. Without the thread the
+// blocks are inflated on demand.
+class GzipDevice : public QIODevice
+{
+public:
+
+	explicit GzipDevice(const QString &path, bool threaded = true, size_t blockBytes = 1 << 20, size_t depth = 8);
+	~GzipDevice();
+
+	// ReadOnly
+	bool open(OpenMode mode) Q_DECL_OVERRIDE;
+	void close() Q_DECL_OVERRIDE;
+
+	bool isSequential() const Q_DECL_OVERRIDE { return true; }
+	bool atEnd() const Q_DECL_OVERRIDE;
+
+	// bytes of the compressed file read so far, e.g. for progress
+	qint64 compressedPos() const { return m_compressedPos.load(std::memory_order_relaxed); }
+	qint64 compressedSize() const { return m_file.size(); }
+
+	// true for the .gz suffix
+	static bool isCompressed(const QString &path);
+
+	// path without the .gz suffix, its suffix tells the format of the content
+	static QString uncompressedName(const QString &path);
+
+protected:
+
+	qint64 readData(char *data, qint64 maxSize) Q_DECL_OVERRIDE;
+	qint64 writeData(const char *data, qint64 maxSize) Q_DECL_OVERRIDE;
+
+private:
+
+	class Worker;
+
+	struct Block
+	{
+		std::vector<char> data;
+		size_t size;
+	};
+
+	// fills the block, false at the end of the stream or on errors (see m_failed)
+	bool inflateBlock(Block &block);
+	void inflateAll(); // worker thread
+
+	// hand a block to the other thread and wake it if it waits
+	void pushReady(int slot);
+	void pushFree(int slot);
+
+	QFile m_file;
+	std::unique_ptr<z_stream_s> m_stream;
+	std::vector<char> m_input;
+	bool m_memberEnded; // the last gzip member is complete
+
+	std::vector<Block> m_blocks;
+	SpscQueue<int> m_ready; // inflated blocks, worker -> reader, -1 marks the end
+	SpscQueue<int> m_free;  // consumed blocks, reader -> worker
+
+	// the reader waits while no block is ready, the worker while all blocks are full; both check
+	// their queue again under the mutex before they wait, the other side wakes them under it
+	QMutex m_mutex;
+	QWaitCondition m_blockReady;
+	QWaitCondition m_blockFree;
+
+	bool m_threaded;
+	std::unique_ptr<Worker> m_worker;
+	std::atomic<bool> m_stop;
+	std::atomic<bool> m_failed;
+	std::atomic<qint64> m_compressedPos;
+	QString m_error; // written before the end is marked
+
+	int m_current; // block of the reader
+	size_t m_currentPos;
+	bool m_endReached;
+};
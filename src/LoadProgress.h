@@ -0,0 +1,35 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+
+// State shared between a loader running on a worker thread and the GUI.
+// The loader publishes its progress, the GUI polls it and may cancel the load.
+struct LoadProgress
+{
+	LoadProgress() : total(0), done(0), canceled(false)
+	{
+	}
+
+	void reset()
+	{
+		total = 0;
+		done = 0;
+		canceled = false;
+		ready = nullptr;
+	}
+
+	std::atomic<size_t> total; // frames (or blocks of structure files) to load
+	std::atomic<size_t> done;
+	std::atomic<bool> canceled;
+
+	// called on the loading thread once topology and frame count are final and the
+	// trajectory may be displayed while the remaining frames are loaded
+	std::function<void()> ready;
+};
@@ -1,10 +1,67 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include <QApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFileInfo>
 
+#include "BcifLoader.h"
+#include "CifLoader.h"
+#include "GzipDevice.h"
 #include "MainWindow.h"
+#include "PdbLoader.h"
 #include "streamserver.h"
 
+namespace
+{
+	const int BENCHMARK_RUNS = 5;
+
+	// loads each structure file (pdb, cif or bcif, each optionally gzip compressed) a few times and
+	// reports the fastest load, e.g. "--benchmark 4v6x.pdb 4v6x.cif 4v6x.bcif 4v6x.cif.gz"
+	// compares the formats of one structure; MB/s refer to the file size on disk
+	int runBenchmark(int argc, char *argv[])
+	{
+		for (int i = 2; i < argc; i++) {
+			QString path = QString::fromLocal8Bit(argv[i]);
+			const QString extension = QFileInfo(GzipDevice::uncompressedName(path)).suffix().toLower();
+
+			qint64 best = std::numeric_limits<qint64>::max();
+			size_t nrAtoms = 0;
+			for (int run = 0; run < BENCHMARK_RUNS; run++) {
+				std::vector<Atom> atoms;
+				StringPool strings;
+				QElapsedTimer timer;
+				timer.start();
+
+				bool loaded = false;
+				if (extension == "pdb") loaded = PdbLoader::readAtomData(path, atoms, strings);
+				else if (extension == "cif") loaded = CifLoader::readAtomData(path, atoms, strings);
+				else if (extension == "bcif") loaded = BcifLoader::readAtomData(path, atoms, strings);
+				if (!loaded) {
+					qCritical() << "Benchmark failed to load" << path;
+					return 1;
+				}
+
+				best = std::min(best, timer.nsecsElapsed());
+				nrAtoms = atoms.size();
+			}
+
+			const double ms = double(best) / 1e6;
+			qInfo() << "Benchmark" << path << (GzipDevice::isCompressed(path) ? "(compressed)" : "") << ":" << nrAtoms << "atoms, best of" << BENCHMARK_RUNS << "loads"
+				<< ms << "ms," << double(QFileInfo(path).size()) / 1e6 / (ms / 1e3) << "MB/s,"
+				<< double(nrAtoms) / 1e3 / ms << "M atoms/s";
+		}
+		return 0;
+	}
+}
+
 int main(int argc, char *argv[])
 {
+	if (argc > 1 && std::strcmp(argv[1], "--benchmark") == 0) {
+		QCoreApplication app(argc, argv);
+		return runBenchmark(argc, argv);
+	}
 
 	QApplication app(argc, argv);
 	MainWindow mainWindow;
@@ -7,17 +7,32 @@
 
 #include "MainWindow.h"
 
+#include <algorithm>
+#include <QCoreApplication>
 #include <QFileDialog>
+#include <QInputDialog>
 #include <qmessagebox.h>
 #include <QPainter>
 #include <QXmlStreamReader>
 #include <QDomDocument>
+#include <QtConcurrent>
 
+#include "BcifLoader.h"
+#include "CifLoader.h"
+#include "DcdLoader.h"
+#include "GzipDevice.h"
 #include "PdbLoader.h"
 #include "NetCDFLoader.h"
+#include "XtcLoader.h"
+
+// memory for atom positions, larger trajectories are compressed or streamed from disk during playback
+const size_t positionMemoryBudget = size_t(1) << 30;
+
+// GPU memory for frames shown before, trajectories that fit are scrubbed without uploads
+const size_t frameCacheBudget = size_t(1) << 30;
 
 MainWindow::MainWindow(QWidget *parent)
-	: QMainWindow(parent)
+	: QMainWindow(parent), m_loadId(0), m_isDisplayed(false)
 {
 	m_Ui = new Ui_MainWindow();
 	m_Ui->setupUi(this);
@@ -31,6 +46,9 @@ MainWindow::MainWindow(QWidget *parent)
     QSurfaceFormat::setDefaultFormat(format);
 
 	m_glWidget = new GLWidget(this, this);
+	m_glWidget->setFrameCacheBudget(frameCacheBudget);
+	// frames of trajectories are uploaded as 16-bit integers with --quantized-positions
+	m_glWidget->setPositionQuantization(QCoreApplication::arguments().contains("--quantized-positions"));
 	m_Ui->glLayout->addWidget(m_glWidget);
 	
 
@@ -51,6 +69,10 @@ MainWindow::MainWindow(QWidget *parent)
 	connect(m_Ui->playButton, SIGNAL(clicked()), this, SLOT(playAnimation()));
 	connect(m_Ui->pauseButton, SIGNAL(clicked()), this, SLOT(pauseAnimation()));
 
+	// loading
+	connect(&m_loadWatcher, SIGNAL(finished()), this, SLOT(loadFinished()));
+	connect(&m_loadTimer, SIGNAL(timeout()), this, SLOT(updateLoadProgress()));
+
 
 	m_Ui->memSizeLCD->setPalette(Qt::darkGreen);
 	m_Ui->usedMemLCD->setPalette(Qt::darkGreen);
@@ -60,51 +82,162 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
+	// the loader and the prefetch thread use the trajectory, which is destroyed before the child widgets
+	cancelLoad();
+	m_glWidget->releaseTrajectory();
 }
 
 void MainWindow::openFileAction()
 {
-    QString filename = QFileDialog::getOpenFileName(this, "Data File", 0, tr("Data Files (*.nc)"), 0, QFileDialog::DontUseNativeDialog);
+    QString filename = QFileDialog::getOpenFileName(this, "Data File", 0, tr("Data Files (*.nc *.dcd *.xtc *.pdb *.cif *.bcif *.pdb.gz *.cif.gz *.bcif.gz)"), 0, QFileDialog::DontUseNativeDialog);
 
     if (!filename.isEmpty()) {
 
-		// store filename
-		m_FileType.filename = filename;
-		std::string fn = filename.toStdString();
-		bool success = false;
-
-		// progress bar and top label
-		m_Ui->progressBar->setEnabled(true);
-		m_Ui->labelTop->setText("Loading data ...");
-
-        if (fn.substr(fn.find_last_of(".") + 1) == "nc") { // LOAD NetCDF DATA
-			
-			int nrFrames;
-			success = NetCDFLoader::readData(filename, m_animation, &nrFrames, m_Ui->progressBar);
-					
-			m_Ui->frame_slider->setMaximum(nrFrames);
-            m_glWidget->initMoleculeRenderMode(&m_animation);
+		// structure files may be gzip compressed, trajectories are read with random access
+		std::string fn = GzipDevice::uncompressedName(filename).toStdString();
+		std::string extension = fn.substr(fn.find_last_of(".") + 1);
+		const bool isStructure = extension == "pdb" || extension == "cif" || extension == "bcif";
 
+		if (GzipDevice::isCompressed(filename) && !isStructure) {
+			m_Ui->labelTop->setText("Compressed trajectories are not supported " + filename);
+			return;
 		}
 
-		m_Ui->progressBar->setEnabled(false);
-
-		// status message
-        if (success) {
-			QString type;
-			if (m_FileType.type == NETCDF) type = "NETCDF";
-			m_Ui->labelTop->setText("File LOADED [" + filename + "] - Type [" + type + "]");
-		}
-        else {
-			m_Ui->labelTop->setText("ERROR loading file " + filename + "!");
+        if (extension == "nc" || extension == "dcd" || extension == "xtc" || isStructure) { // LOAD NetCDF, DCD, XTC, PDB, mmCIF or BinaryCIF DATA
+
+			// optional frame range, stride and atom subset of trajectories
+			FrameSelection selection;
+			if (!isStructure) {
+				bool accepted = false;
+				QString spec = QInputDialog::getText(this, "Load Options",
+					"Frames first:end:stride and atoms, e.g. \"0:5000:10 0-120,300\" (empty loads everything)",
+					QLineEdit::Normal, "", &accepted);
+				if (!accepted || !FrameSelection::parse(spec, selection)) {
+					m_Ui->labelTop->setText(accepted ? "Invalid load options " + spec : "Loading canceled");
+					return;
+				}
+			}
+
+			// a running load is replaced by the new one
+			cancelLoad();
+			m_glWidget->releaseTrajectory();
+			m_trajectory.clear();
+
+			// store filename
+			m_FileType.filename = filename;
+			m_FileType.type = (extension == "dcd") ? DCD : (extension == "xtc") ? XTC : (extension == "pdb") ? PDB : (extension == "cif") ? CIF : (extension == "bcif") ? BCIF : NETCDF;
+
+			// progress bar and top label
+			m_Ui->progressBar->setEnabled(true);
 			m_Ui->progressBar->setValue(0);
+			m_Ui->labelTop->setText("Loading data ...");
+
+			// the GUI (and the stream server) keep running while the file is loaded on a worker thread
+			const int loadId = ++m_loadId;
+			m_isDisplayed = false;
+			m_loadClock.start();
+			m_loadProgress.reset();
+			m_loadProgress.ready = [this, loadId]() {
+				QMetaObject::invokeMethod(this, "displayTrajectory", Qt::QueuedConnection, Q_ARG(int, loadId));
+			};
+
+			const DataType type = m_FileType.type;
+			m_loadWatcher.setFuture(QtConcurrent::run([this, filename, selection, type]() {
+				QString path = filename;
+				if (type == PDB) {
+					if (!PdbLoader::readData(path, m_trajectory, &m_loadProgress)) {
+						return false;
+					}
+					PdbLoader::centerTrajectory(m_trajectory);
+					return true;
+				}
+				if (type == CIF) {
+					if (!CifLoader::readData(path, m_trajectory, &m_loadProgress)) {
+						return false;
+					}
+					PdbLoader::centerTrajectory(m_trajectory);
+					return true;
+				}
+				if (type == BCIF) {
+					if (!BcifLoader::readData(path, m_trajectory, &m_loadProgress)) {
+						return false;
+					}
+					PdbLoader::centerTrajectory(m_trajectory);
+					return true;
+				}
+				if (type == DCD) {
+					return DcdLoader::readData(path, m_trajectory, &m_loadProgress, positionMemoryBudget, selection);
+				}
+				if (type == XTC) {
+					return XtcLoader::readData(path, m_trajectory, &m_loadProgress, positionMemoryBudget, selection);
+				}
+				return NetCDFLoader::readData(path, m_trajectory, &m_loadProgress, positionMemoryBudget, selection);
+			}));
+			m_loadTimer.start(50);
 		}
 	}
 }
 
+void MainWindow::cancelLoad()
+{
+	if (m_loadWatcher.isRunning()) {
+		m_loadProgress.canceled = true;
+		m_loadWatcher.waitForFinished();
+	}
+	m_loadTimer.stop();
+}
+
+void MainWindow::displayTrajectory(int loadId)
+{
+	// announcements of canceled loads arrive late
+	if (loadId != m_loadId || m_isDisplayed) {
+		return;
+	}
+	m_isDisplayed = true;
+	m_Ui->frame_slider->setMaximum(int(m_trajectory.nrFrames()));
+	m_glWidget->initMoleculeRenderMode(&m_trajectory, (m_FileType.type == PDB || m_FileType.type == CIF || m_FileType.type == BCIF) ? GLWidget::PDB : GLWidget::NETCDF);
+}
+
+void MainWindow::updateLoadProgress()
+{
+	m_Ui->progressBar->setMaximum(int(std::max<size_t>(m_loadProgress.total, 1)));
+	m_Ui->progressBar->setValue(int(m_loadProgress.done));
+}
+
+void MainWindow::loadFinished()
+{
+	m_loadTimer.stop();
+	m_Ui->progressBar->setEnabled(false);
+	m_Ui->progressBar->setValue(0);
+
+	const QString filename = m_FileType.filename;
+	if (m_loadWatcher.result()) {
+		// streamed, compressed and cached trajectories are displayed when complete
+		displayTrajectory(m_loadId);
+
+		QString type;
+		if (m_FileType.type == NETCDF) type = "NETCDF";
+		if (m_FileType.type == DCD) type = "DCD";
+		if (m_FileType.type == XTC) type = "XTC";
+		if (m_FileType.type == PDB) type = "PDB";
+		if (m_FileType.type == CIF) type = "CIF";
+		if (m_FileType.type == BCIF) type = "BCIF";
+		const qint64 loadTime = m_loadClock.elapsed();
+		qInfo() << "Loaded" << m_trajectory.nrAtoms() << "atoms," << m_trajectory.nrFrames() << "frames of" << filename
+			<< "in" << loadTime << "ms";
+		m_Ui->labelTop->setText("File LOADED [" + filename + "] - Type [" + type + "] - "
+			+ QString::number(m_trajectory.nrAtoms()) + " atoms in " + QString::number(loadTime) + " ms");
+	}
+	else {
+		m_glWidget->releaseTrajectory();
+		m_trajectory.clear();
+		m_Ui->labelTop->setText((m_loadProgress.canceled ? "Loading canceled " : "ERROR loading file ") + filename + "!");
+	}
+}
+
 void MainWindow::frameChanged(int value)
 {
-	if (value < m_animation.size()) {
+	if (value < int(m_trajectory.nrFrames())) {
 		m_glWidget->setAnimationFrame(value);
 	}
 	m_glWidget->update();
@@ -9,6 +9,9 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QTimer>
 #include <QPushButton>
 #include <QLabel>
 #include <QProgressBar>
@@ -18,6 +21,7 @@
 #include "ui_MainWindow.h"
 #include "streamserver.h"
 #include "GLWidget.h"
+#include "LoadProgress.h"
 
 class MainWindow : public QMainWindow
 {
@@ -54,8 +58,15 @@ protected slots :
 	void playAnimation();
 	void pauseAnimation();
 
+	// loading on a worker thread
+	void displayTrajectory(int loadId);
+	void updateLoadProgress();
+	void loadFinished();
+
 private:
 
+	void cancelLoad();
+
 	// USER INTERFACE ELEMENTS
 
 	Ui_MainWindow *m_Ui;
@@ -65,7 +76,12 @@ private:
 
 	enum DataType
 	{
-		NETCDF
+		NETCDF,
+		DCD,
+		XTC,
+		PDB,
+		CIF,
+		BCIF
 	};
 
 	struct FileType
@@ -75,7 +91,15 @@ private:
 	} m_FileType;
 
 	GLWidget *m_glWidget;
-	std::vector<std::vector<Atom> > m_animation;
+	Trajectory m_trajectory;
+
+	// the running load writes m_trajectory, the GUI displays it once the loader announces it
+	QFutureWatcher<bool> m_loadWatcher;
+	LoadProgress m_loadProgress;
+	QTimer m_loadTimer;
+	QElapsedTimer m_loadClock; // time to load and display
+	int m_loadId;
+	bool m_isDisplayed;
 
 };
 
@@ -0,0 +1,274 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "MessagePack.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	inline quint8 byteAt(const char *p)
+	{
+		return static_cast<quint8>(*p);
+	}
+}
+
+bool MessagePackReader::Bytes::operator==(const char *text) const
+{
+	return std::strlen(text) == size && std::memcmp(data, text, size) == 0;
+}
+
+MessagePackReader::MessagePackReader(const char *begin, const char *end)
+	: m_p(begin), m_end(end), m_ok(true)
+{
+}
+
+bool MessagePackReader::fail()
+{
+	m_ok = false;
+	m_p = m_end;
+	return false;
+}
+
+MessagePackReader::Type MessagePackReader::type() const
+{
+	if (!m_ok || m_p == m_end) {
+		return INVALID;
+	}
+
+	const quint8 b = byteAt(m_p);
+	if (b <= 0x7f || b >= 0xe0 || (b >= 0xcc && b <= 0xd3)) {
+		return INTEGER;
+	}
+	if (b <= 0x8f || b == 0xde || b == 0xdf) {
+		return MAP;
+	}
+	if (b <= 0x9f || b == 0xdc || b == 0xdd) {
+		return ARRAY;
+	}
+	if (b <= 0xbf || (b >= 0xd9 && b <= 0xdb)) {
+		return STRING;
+	}
+	switch (b) {
+	case 0xc0: return NIL;
+	case 0xc2: case 0xc3: return BOOLEAN;
+	case 0xc4: case 0xc5: case 0xc6: return BINARY;
+	case 0xca: case 0xcb: return FLOAT;
+	default: return INVALID;
+	}
+}
+
+quint64 MessagePackReader::readUnsigned(int bytes)
+{
+	if (!has(size_t(bytes))) {
+		fail();
+		return 0;
+	}
+	quint64 value = 0;
+	for (int i = 0; i < bytes; i++) {
+		value = (value << 8) | byteAt(m_p + i);
+	}
+	m_p += bytes;
+	return value;
+}
+
+MessagePackReader::Bytes MessagePackReader::readBytes(size_t size)
+{
+	Bytes bytes = { m_p, 0 };
+	if (!has(size)) {
+		fail();
+		bytes.data = m_end;
+		return bytes;
+	}
+	bytes.size = size;
+	m_p += size;
+	return bytes;
+}
+
+size_t MessagePackReader::readArray()
+{
+	if (type() != ARRAY) {
+		fail();
+		return 0;
+	}
+	const quint8 b = byteAt(m_p++);
+	const size_t size = b <= 0x9f ? size_t(b & 0x0f) : size_t(readUnsigned(b == 0xdc ? 2 : 4));
+
+	// every element takes at least one byte, a larger count is truncated or corrupt data
+	if (!has(size)) {
+		fail();
+		return 0;
+	}
+	return size;
+}
+
+size_t MessagePackReader::readMap()
+{
+	if (type() != MAP) {
+		fail();
+		return 0;
+	}
+	const quint8 b = byteAt(m_p++);
+	const size_t size = b <= 0x8f ? size_t(b & 0x0f) : size_t(readUnsigned(b == 0xde ? 2 : 4));
+
+	// every key and every value takes at least one byte
+	if (!has(size * 2)) {
+		fail();
+		return 0;
+	}
+	return size;
+}
+
+bool MessagePackReader::readNil()
+{
+	if (type() != NIL) {
+		return fail();
+	}
+	m_p++;
+	return true;
+}
+
+qint64 MessagePackReader::readInt()
+{
+	const Type t = type();
+	if (t == FLOAT) {
+		// the conversion is undefined for NaN and values out of range
+		const double value = readDouble();
+		if (!(value >= -9223372036854775808.0 && value < 9223372036854775808.0) || value != std::floor(value)) {
+			fail();
+			return 0;
+		}
+		return qint64(value);
+	}
+	if (t != INTEGER) {
+		fail();
+		return 0;
+	}
+
+	const quint8 b = byteAt(m_p++);
+	if (b <= 0x7f) {
+		return b;
+	}
+	if (b >= 0xe0) {
+		return qint64(qint8(b));
+	}
+	switch (b) {
+	case 0xcc: return qint64(readUnsigned(1));
+	case 0xcd: return qint64(readUnsigned(2));
+	case 0xce: return qint64(readUnsigned(4));
+	case 0xcf: return qint64(readUnsigned(8));
+	case 0xd0: return qint64(qint8(readUnsigned(1)));
+	case 0xd1: return qint64(qint16(readUnsigned(2)));
+	case 0xd2: return qint64(qint32(readUnsigned(4)));
+	default: return qint64(readUnsigned(8));
+	}
+}
+
+double MessagePackReader::readDouble()
+{
+	const Type t = type();
+	if (t == INTEGER) {
+		return double(readInt());
+	}
+	if (t != FLOAT) {
+		fail();
+		return 0.0;
+	}
+
+	if (byteAt(m_p++) == 0xca) {
+		const quint32 bits = quint32(readUnsigned(4));
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+	const quint64 bits = readUnsigned(8);
+	double value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+bool MessagePackReader::readBool()
+{
+	if (type() != BOOLEAN) {
+		return fail();
+	}
+	return byteAt(m_p++) == 0xc3;
+}
+
+MessagePackReader::Bytes MessagePackReader::readString()
+{
+	if (type() != STRING) {
+		fail();
+		return readBytes(0);
+	}
+	const quint8 b = byteAt(m_p++);
+	const size_t size = b <= 0xbf ? size_t(b & 0x1f) : size_t(readUnsigned(1 << (b - 0xd9)));
+	return readBytes(size);
+}
+
+MessagePackReader::Bytes MessagePackReader::readBinary()
+{
+	if (type() != BINARY) {
+		fail();
+		return readBytes(0);
+	}
+	const quint8 b = byteAt(m_p++);
+	return readBytes(size_t(readUnsigned(1 << (b - 0xc4))));
+}
+
+void MessagePackReader::skip()
+{
+	// values left to skip, containers add their elements
+	size_t pending = 1;
+	while (pending > 0 && m_ok) {
+		pending--;
+		switch (type()) {
+		case NIL:
+		case BOOLEAN:
+			m_p++;
+			break;
+		case INTEGER:
+			readInt();
+			break;
+		case FLOAT:
+			readDouble();
+			break;
+		case STRING:
+			readString();
+			break;
+		case BINARY:
+			readBinary();
+			break;
+		case ARRAY:
+			pending += readArray();
+			break;
+		case MAP:
+			pending += readMap() * 2;
+			break;
+		default: {
+			if (m_p == m_end) {
+				fail();
+				break;
+			}
+			// extension types: fixext 1 to 16 or ext 8, 16, 32 with their type byte
+			const quint8 b = byteAt(m_p++);
+			size_t size;
+			if (b >= 0xd4 && b <= 0xd8) {
+				size = size_t(1) << (b - 0xd4);
+			}
+			else if (b >= 0xc7 && b <= 0xc9) {
+				size = size_t(readUnsigned(1 << (b - 0xc7)));
+			}
+			else {
+				fail();
+				break;
+			}
+			readBytes(size + 1);
+		}
+		}
+	}
+}
@@ -0,0 +1,77 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <QtGlobal>
+
+// Sequential reader of MessagePack data in memory (e.g. a mapped BinaryCIF file). Values are
+// read in place without building a tree, strings and binary data point into the input.
+// Errors are sticky: after truncated or unexpected data every read returns an empty value
+// and ok() is false.
+// https://github.com/msgpack/msgpack/blob/master/spec.md
+class MessagePackReader
+{
+public:
+
+	enum Type
+	{
+		NIL,
+		BOOLEAN,
+		INTEGER,
+		FLOAT,
+		STRING,
+		BINARY,
+		ARRAY,
+		MAP,
+		INVALID // extension types or the end of the data
+	};
+
+	// string or binary data
+	struct Bytes
+	{
+		const char *data;
+		size_t size;
+
+		// compares a string with text
+		bool operator==(const char *text) const;
+		bool operator!=(const char *text) const { return !(*this == text); }
+	};
+
+	MessagePackReader(const char *begin, const char *end);
+
+	bool ok() const { return m_ok; }
+	const char *position() const { return m_p; }
+
+	// type of the next value
+	Type type() const;
+
+	// number of elements (or key value pairs) that follow, fails if there are fewer bytes left
+	size_t readArray();
+	size_t readMap();
+
+	bool readNil();
+	qint64 readInt(); // also reads integral floats
+	double readDouble(); // also reads integers
+	bool readBool();
+	Bytes readString();
+	Bytes readBinary();
+
+	// skips the next value including its elements
+	void skip();
+
+private:
+
+	bool fail();
+	bool has(size_t bytes) const { return size_t(m_end - m_p) >= bytes; }
+	quint64 readUnsigned(int bytes);
+	Bytes readBytes(size_t size);
+
+	const char *m_p;
+	const char *m_end;
+	bool m_ok;
+};
@@ -7,19 +7,180 @@
 
 #include "NetCDFLoader.h"
 
+#include <algorithm>
+#include <cstring>
 #include <netcdf.h>
 #include <QDebug>
 
-bool NetCDFLoader::readData(QString &path, std::vector<std::vector<Atom> > &animation, int *nrFrames, QProgressBar *progressBar)
+#include "NetCDFMappedSource.h"
+#include "TrajectoryCache.h"
+#include "TrajectoryLoader.h"
+
+// load NetCDF (Network Common Data Form) data
+// see http://www.unidata.ucar.edu/software/netcdf/docs
+
+NetCDFFrameSource::NetCDFFrameSource(size_t windowBytes)
+	: m_ncid(-1), m_coordId(-1), m_nrFrames(0), m_nrAtoms(0),
+	m_windowBytes(windowBytes), m_windowSize(1), m_windowStart(0), m_windowFrames(0)
+{
+}
+
+NetCDFFrameSource::~NetCDFFrameSource()
+{
+	close();
+}
+
+static bool readDimension(int ncid, const char *name, size_t *length)
+{
+	int dimId;
+	int status = nc_inq_dimid(ncid, name, &dimId);
+	if (status == NC_NOERR) {
+		status = nc_inq_dimlen(ncid, dimId, length);
+	}
+	if (status != NC_NOERR) {
+		qCritical() << "NetCDF dimension" << name << ":" << nc_strerror(status);
+		return false;
+	}
+	return true;
+}
+
+bool NetCDFFrameSource::open(const QString &path, const FrameSelection &selection)
+{
+	close();
+
+	int status = nc_open(path.toStdString().c_str(), NC_NOWRITE, &m_ncid);
+	if (status != NC_NOERR) {
+		qCritical() << "Error loading file: " << path << nc_strerror(status);
+		m_ncid = -1;
+		return false;
+	}
+
+	// AMBER convention: coordinates(frame, atom, spatial)
+	size_t fileFrames, fileAtoms, nrSpatial;
+	if (!readDimension(m_ncid, "frame", &fileFrames) ||
+		!readDimension(m_ncid, "atom", &fileAtoms) ||
+		!readDimension(m_ncid, "spatial", &nrSpatial)) {
+		close();
+		return false;
+	}
+	if (nrSpatial != 3) {
+		qCritical() << "Unsupported number of spatial dimensions: " << nrSpatial;
+		close();
+		return false;
+	}
+
+	status = nc_inq_varid(m_ncid, "coordinates", &m_coordId);
+	if (status != NC_NOERR) {
+		qCritical() << "NetCDF variable coordinates:" << nc_strerror(status);
+		close();
+		return false;
+	}
+
+	m_selection = selection;
+	m_atomRuns = selection.atomRuns(fileAtoms);
+	m_nrFrames = selection.nrFrames(fileFrames);
+	m_nrAtoms = selection.nrAtoms(fileAtoms);
+
+	m_windowSize = std::max<size_t>(m_windowBytes / std::max<size_t>(m_nrAtoms * 3 * sizeof(float), 1), 1);
+
+	return true;
+}
+
+void NetCDFFrameSource::close()
 {
-	// load NetCDF (Network Common Data Form) data
-	// see http://www.unidata.ucar.edu/software/netcdf/docs
-	int status, ncid, ndims, nvars, ngatts, unlimdimid;
+	if (m_ncid >= 0) {
+		nc_close(m_ncid);
+	}
+	m_ncid = -1;
+	m_coordId = -1;
+	m_nrFrames = m_nrAtoms = 0;
+	m_windowStart = m_windowFrames = 0;
+	m_selection = FrameSelection();
+	m_atomRuns.clear();
+	std::vector<float>().swap(m_window);
+	std::vector<float>().swap(m_runBuffer);
+}
 
-	float rh_array[1][1];
+bool NetCDFFrameSource::readFrames(size_t first, size_t count, float *dst)
+{
+	if (!isOpen() || first + count > m_nrFrames) {
+		return false;
+	}
 
-	status = nc_open(path.toStdString().c_str(), NC_NOWRITE, &ncid);
-	status = nc_inq(ncid, &ndims, &nvars, &ngatts, &unlimdimid);
+	const ptrdiff_t stride[] = { ptrdiff_t(m_selection.frameStride), 1, 1 };
+
+	// one strided hyperslab per run of consecutive atoms
+	size_t atomOffset = 0;
+	for (size_t r = 0; r < m_atomRuns.size(); r++) {
+		const size_t runAtoms = m_atomRuns[r].second;
+		const bool inPlace = (runAtoms == m_nrAtoms);
+		if (!inPlace) {
+			m_runBuffer.resize(count * runAtoms * 3);
+		}
+
+		size_t start[] = { m_selection.fileFrame(first), m_atomRuns[r].first, 0 };
+		size_t extent[] = { count, runAtoms, 3 };
+		int status = nc_get_vars_float(m_ncid, m_coordId, start, extent, stride, inPlace ? dst : m_runBuffer.data());
+		if (status != NC_NOERR) {
+			qCritical() << "Error reading frames" << first << "-" << first + count << ":" << nc_strerror(status);
+			return false;
+		}
+
+		if (!inPlace) {
+			for (size_t f = 0; f < count; f++) {
+				std::memcpy(dst + (f * m_nrAtoms + atomOffset) * 3, &m_runBuffer[f * runAtoms * 3], runAtoms * 3 * sizeof(float));
+			}
+		}
+		atomOffset += runAtoms;
+	}
+	return true;
+}
+
+bool NetCDFFrameSource::loadWindow(size_t first)
+{
+	size_t count = std::min(m_windowSize, m_nrFrames - first);
+	m_window.resize(m_windowSize * m_nrAtoms * 3);
+
+	if (!readFrames(first, count, m_window.data())) {
+		m_windowFrames = 0;
+		return false;
+	}
+	m_windowStart = first;
+	m_windowFrames = count;
+	return true;
+}
+
+const float *NetCDFFrameSource::frame(size_t frameNr)
+{
+	if (frameNr >= m_nrFrames) {
+		return nullptr;
+	}
+
+	if (frameNr < m_windowStart || frameNr >= m_windowStart + m_windowFrames) {
+		// align windows so that sequential playback reads each frame exactly once
+		if (!loadWindow(frameNr - frameNr % m_windowSize)) {
+			return nullptr;
+		}
+	}
+	return &m_window[(frameNr - m_windowStart) * m_nrAtoms * 3];
+}
+
+bool NetCDFFrameSource::readFrame(size_t frameNr, float *dst)
+{
+	const float *positions = frame(frameNr);
+	if (!positions) {
+		return false;
+	}
+	std::memcpy(dst, positions, m_nrAtoms * 3 * sizeof(float));
+	return true;
+}
+
+void NetCDFFrameSource::printInfo() const
+{
+	int ndims, nvars, ngatts, unlimdimid;
+	if (nc_inq(m_ncid, &ndims, &nvars, &ngatts, &unlimdimid) != NC_NOERR) {
+		return;
+	}
 
 	size_t dim_length;
 	char name_in[NC_MAX_NAME + 1];
@@ -27,71 +188,54 @@ bool NetCDFLoader::readData(QString &path, std::vector<std::vector<Atom> > &anim
 	qInfo() << "----------------------------------------";
 	qInfo() << "DIMENSIONS";
 	for (int i = 0; i < ndims; i++) {
-		status = nc_inq_dimname(ncid, i, name_in);
-		status = nc_inq_dimlen(ncid, i, &dim_length);
+		nc_inq_dimname(m_ncid, i, name_in);
+		nc_inq_dimlen(m_ncid, i, &dim_length);
 		qInfo() << i << +": " << name_in << "[" << dim_length << "]";
 	}
 	qInfo() << "----------------------------------------";
 	qInfo() << "VARIABLES:";
 	int nDims;
 	for (int i = 0; i < nvars; i++) {
-		status = nc_inq_varname(ncid, i, name_in);
-		status = nc_inq_varndims(ncid, i, &nDims);
+		nc_inq_varname(m_ncid, i, name_in);
+		nc_inq_varndims(m_ncid, i, &nDims);
 		qInfo() << name_in;
-		int *dimIds = new int[nDims];
-		status = nc_inq_vardimid(ncid, i, dimIds);
+		std::vector<int> dimIds(nDims);
+		nc_inq_vardimid(m_ncid, i, dimIds.data());
 		for (int j = 0; j < nDims; j++) {
-			status = nc_inq_dimname(ncid, dimIds[j], name_in);
-            qInfo() << "Dimension: " << name_in;
+			nc_inq_dimname(m_ncid, dimIds[j], name_in);
+			qInfo() << "Dimension: " << name_in;
 		}
 
 	}
 	qInfo() << "----------------------------------------";
 	qInfo() << "ATTRIBUTES:";
 	for (int i = 0; i < ngatts; i++) {
-		status = nc_inq_attname(ncid, i, NC_GLOBAL, name_in);
+		nc_inq_attname(m_ncid, NC_GLOBAL, i, name_in);
 		qInfo() << name_in;
 	}
+}
 
-	const int FRAMES = 500; // 50000 total
-	(*nrFrames) = FRAMES;
-	const int ATOMS = 4684;
-	const int SPATIAL = 3;
-	if (progressBar) {
-		progressBar->setMaximum(FRAMES + 10);
-		progressBar->setValue(10);
+bool NetCDFLoader::readData(QString &path, Trajectory &trajectory, LoadProgress *progress, size_t memoryBudget,
+    const FrameSelection &selection)
+{
+	// a valid cache skips parsing, conversion and the file dump
+	if (TrajectoryCache::read(path, selection, trajectory, memoryBudget)) {
+		return true;
 	}
 
-	float *rh_vals = new float[FRAMES*ATOMS*SPATIAL];
-
-	static size_t start[] = { 0, 0, 0 };
-	static size_t count[] = { FRAMES, ATOMS, SPATIAL };
-	int coord_id;
-	status = nc_inq_varid(ncid, "coordinates", &coord_id);
-	status = nc_get_vara_float(ncid, coord_id, start, count, rh_vals);
-
-	if (progressBar) {
-		progressBar->setValue(FRAMES);
+	NetCDFMappedSource *mapped = new NetCDFMappedSource();
+	if (NetCDFMappedSource::isClassicFormat(path) && mapped->open(path, selection)) {
+		return TrajectoryLoader::load(path, mapped, trajectory, progress, memoryBudget, selection);
 	}
+	delete mapped;
 
-    for (size_t i = 0; i < FRAMES; i++) {
-		std::vector<Atom> frame;
-        for (size_t j = 0; j < ATOMS; j++) {
-			Atom atom;
-            for (size_t k = 0; k < SPATIAL; k++) {
-				atom.position[k] = rh_vals[i * ATOMS * SPATIAL + j * SPATIAL + k];
-			}
-			atom.color = glm::vec3(0.341f, 0.776f, 0.921f);
-			atom.radius = 1.4f;
-			frame.push_back(atom);
-		}
-		animation.push_back(frame);
-		if (progressBar) {
-			progressBar->setValue(10 + i);
-		}
+	NetCDFFrameSource *netcdf = new NetCDFFrameSource();
+	if (!netcdf->open(path, selection)) {
+		delete netcdf;
+		return false;
 	}
+	netcdf->printInfo();
 
-	delete rh_vals;
-	progressBar->setValue(0);
-	return true;
+	// libnetcdf is not thread-safe (not even for separate handles), its reads are serialized
+	return TrajectoryLoader::load(path, netcdf, trajectory, progress, memoryBudget, selection);
 }
@@ -8,13 +8,76 @@
 #pragma once
 
 #include <vector>
-#include <QProgressBar>
+#include <QString>
 
-#include "Commons.h"
+#include "FrameSelection.h"
+#include "FrameSource.h"
+#include "LoadProgress.h"
+#include "Trajectory.h"
+
+// Streams the "coordinates" variable of an AMBER NetCDF trajectory.
+// Frames are read on demand in windows of at most windowBytes bytes,
+// so memory usage does not depend on the length of the trajectory.
+// Only the frames and atoms of the selection are read (nc_get_vars_float).
+class NetCDFFrameSource : public FrameSource
+{
+public:
+
+	NetCDFFrameSource(size_t windowBytes = 16 * 1024 * 1024);
+	~NetCDFFrameSource();
+
+	bool open(const QString &path, const FrameSelection &selection = FrameSelection());
+	void close();
+
+	bool isOpen() const { return m_ncid >= 0; }
+
+	size_t nrFrames() const Q_DECL_OVERRIDE { return m_nrFrames; }
+	size_t nrAtoms() const Q_DECL_OVERRIDE { return m_nrAtoms; }
+
+	// returns the nrAtoms * 3 coordinates of a selected frame or nullptr on error,
+	// the pointer stays valid until a frame outside the current window is requested
+	const float *frame(size_t frameNr);
+
+	bool readFrame(size_t frameNr, float *dst) Q_DECL_OVERRIDE;
+
+	// reads the hyperslab of count frames directly into dst
+	bool readFrames(size_t first, size_t count, float *dst) Q_DECL_OVERRIDE;
+
+	// dimensions, variables and global attributes of the opened file
+	void printInfo() const;
+
+private:
+
+	bool loadWindow(size_t first);
+
+	int m_ncid;
+	int m_coordId;
+
+	size_t m_nrFrames; // selected frames and atoms
+	size_t m_nrAtoms;
+
+	FrameSelection m_selection;
+	std::vector<std::pair<size_t, size_t> > m_atomRuns;
+	std::vector<float> m_runBuffer;
+
+	size_t m_windowBytes;
+	size_t m_windowSize; // in frames
+	size_t m_windowStart;
+	size_t m_windowFrames;
+	std::vector<float> m_window;
+};
 
 class NetCDFLoader
 {
 	public:
 
-        static bool readData(QString &path, std::vector<std::vector<Atom> > &animation, int *nrFrames, QProgressBar *progressBar = nullptr);
+        // trajectories whose positions exceed memoryBudget bytes are compressed in memory or,
+        // if that does not fit either, streamed from disk (0 loads all frames as floats);
+        // classic and 64-bit offset files are memory mapped, NetCDF-4 files are read through libnetcdf;
+        // loaded trajectories are cached next to the file (see TrajectoryCache) and reopened from the cache.
+        // Blocks, call it on a worker thread: trajectories loaded as floats are announced through progress->ready
+        // before their frames are read and Trajectory::loadedFrames grows as the frames arrive.
+        // On failure or cancellation the trajectory may hold partial data, the caller clears it
+        static bool readData(QString &path, Trajectory &trajectory, LoadProgress *progress = nullptr, size_t memoryBudget = 0,
+            const FrameSelection &selection = FrameSelection());
 };
@@ -0,0 +1,349 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "NetCDFMappedSource.h"
+
+#include <vector>
+#include <QDebug>
+#include <QtEndian>
+
+#include "SimdKernels.h"
+
+// NetCDF classic file format specification
+// see http://www.unidata.ucar.edu/software/netcdf/docs/file_format_specifications.html
+
+namespace
+{
+	const quint32 NC_DIMENSION = 0x0A;
+	const quint32 NC_VARIABLE = 0x0B;
+	const quint32 NC_ATTRIBUTE = 0x0C;
+	const quint32 NC_FLOAT = 5;
+	const quint32 STREAMING = 0xFFFFFFFF;
+
+	// sizes of NC_BYTE, NC_CHAR, NC_SHORT, NC_INT, NC_FLOAT, NC_DOUBLE
+	quint64 typeSize(quint32 type)
+	{
+		static const quint64 sizes[] = { 0, 1, 1, 2, 4, 4, 8 };
+		return type < 7 ? sizes[type] : 0;
+	}
+
+	inline quint64 pad4(quint64 size)
+	{
+		return (size + 3) & ~quint64(3);
+	}
+
+	// sequential big-endian reader over the header bytes
+	class HeaderReader
+	{
+	public:
+
+		HeaderReader(const uchar *data, qint64 size, bool offset64)
+			: m_data(data), m_pos(0), m_size(quint64(size)), m_offset64(offset64), m_ok(true)
+		{
+		}
+
+		bool ok() const { return m_ok; }
+
+		quint32 u32()
+		{
+			if (!require(4)) return 0;
+			quint32 value = qFromBigEndian<quint32>(m_data + m_pos);
+			m_pos += 4;
+			return value;
+		}
+
+		quint64 offset()
+		{
+			if (!m_offset64) return u32();
+			if (!require(8)) return 0;
+			quint64 value = qFromBigEndian<quint64>(m_data + m_pos);
+			m_pos += 8;
+			return value;
+		}
+
+		QByteArray name()
+		{
+			quint32 length = u32();
+			if (!require(pad4(length))) return QByteArray();
+			QByteArray value(reinterpret_cast<const char *>(m_data + m_pos), int(length));
+			m_pos += pad4(length);
+			return value;
+		}
+
+		void skip(quint64 bytes)
+		{
+			if (require(bytes)) m_pos += bytes;
+		}
+
+	private:
+
+		bool require(quint64 bytes)
+		{
+			if (m_pos + bytes > m_size) m_ok = false;
+			return m_ok;
+		}
+
+		const uchar *m_data;
+		quint64 m_pos;
+		quint64 m_size;
+		bool m_offset64;
+		bool m_ok;
+	};
+
+	void skipAttributes(HeaderReader &in)
+	{
+		quint32 tag = in.u32();
+		quint32 count = in.u32();
+		if (tag != NC_ATTRIBUTE) return; // ABSENT
+		for (quint32 i = 0; i < count && in.ok(); i++) {
+			in.name();
+			quint32 type = in.u32();
+			quint32 nelems = in.u32();
+			in.skip(pad4(nelems * typeSize(type)));
+		}
+	}
+}
+
+NetCDFMappedSource::NetCDFMappedSource()
+	: m_data(nullptr), m_size(0), m_nrFrames(0), m_nrAtoms(0), m_begin(0), m_frameStride(0)
+{
+}
+
+NetCDFMappedSource::~NetCDFMappedSource()
+{
+	close();
+}
+
+bool NetCDFMappedSource::isClassicFormat(const QString &path)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	char magic[4];
+	if (file.read(magic, 4) != 4) {
+		return false;
+	}
+	return magic[0] == 'C' && magic[1] == 'D' && magic[2] == 'F' && (magic[3] == 1 || magic[3] == 2);
+}
+
+bool NetCDFMappedSource::open(const QString &path, const FrameSelection &selection)
+{
+	close();
+
+	m_file.setFileName(path);
+	if (!m_file.open(QIODevice::ReadOnly)) {
+		qCritical() << "Error loading file: " << m_file.errorString();
+		return false;
+	}
+
+	m_size = m_file.size();
+	m_data = m_file.map(0, m_size);
+	if (!m_data) {
+		qCritical() << "Error mapping file: " << m_file.errorString();
+		close();
+		return false;
+	}
+
+	if (!parseHeader(m_data, m_size)) {
+		qCritical() << "Not a NetCDF classic trajectory: " << path;
+		close();
+		return false;
+	}
+
+	// pages of unselected frames and atoms are never touched
+	m_selection = selection;
+	m_atomRuns = selection.atomRuns(m_nrAtoms);
+	m_nrFrames = selection.nrFrames(m_nrFrames);
+	m_nrAtoms = selection.nrAtoms(m_nrAtoms);
+
+	qInfo() << "Mapped" << path << ":" << m_nrFrames << "frames," << m_nrAtoms << "atoms";
+	return true;
+}
+
+void NetCDFMappedSource::close()
+{
+	if (m_data) {
+		m_file.unmap(m_data);
+	}
+	m_file.close();
+	m_data = nullptr;
+	m_size = 0;
+	m_nrFrames = m_nrAtoms = 0;
+	m_begin = m_frameStride = 0;
+	m_selection = FrameSelection();
+	m_atomRuns.clear();
+}
+
+bool NetCDFMappedSource::parseHeader(const uchar *header, qint64 size)
+{
+	if (size < 8 || header[0] != 'C' || header[1] != 'D' || header[2] != 'F' || (header[3] != 1 && header[3] != 2)) {
+		return false;
+	}
+	HeaderReader in(header + 4, size - 4, header[3] == 2);
+
+	quint32 numrecs = in.u32();
+
+	// DIMENSIONS
+	struct Dimension
+	{
+		QByteArray name;
+		quint64 length;
+	};
+	std::vector<Dimension> dims;
+	int recordDim = -1;
+
+	quint32 tag = in.u32();
+	quint32 count = in.u32();
+	if (tag == NC_DIMENSION) {
+		for (quint32 i = 0; i < count && in.ok(); i++) {
+			Dimension dim;
+			dim.name = in.name();
+			dim.length = in.u32();
+			if (dim.length == 0) {
+				recordDim = int(i);
+			}
+			dims.push_back(dim);
+		}
+	}
+
+	skipAttributes(in);
+
+	// VARIABLES
+	struct Variable
+	{
+		QByteArray name;
+		std::vector<quint32> dimIds;
+		quint32 type;
+		quint64 begin;
+	};
+	std::vector<Variable> vars;
+
+	tag = in.u32();
+	count = in.u32();
+	if (tag == NC_VARIABLE) {
+		for (quint32 i = 0; i < count && in.ok(); i++) {
+			Variable var;
+			var.name = in.name();
+			quint32 nrDims = in.u32();
+			for (quint32 j = 0; j < nrDims && in.ok(); j++) {
+				var.dimIds.push_back(in.u32());
+			}
+			skipAttributes(in);
+			var.type = in.u32();
+			in.u32(); // vsize, recomputed below since it overflows for large variables
+			var.begin = in.offset();
+			vars.push_back(var);
+		}
+	}
+
+	if (!in.ok()) {
+		return false;
+	}
+
+	// bytes of one record (or the whole variable for fixed size variables)
+	auto slabSize = [&](const Variable &var) {
+		quint64 bytes = typeSize(var.type);
+		for (size_t j = 0; j < var.dimIds.size(); j++) {
+			if (int(var.dimIds[j]) != recordDim && var.dimIds[j] < dims.size()) {
+				bytes *= dims[var.dimIds[j]].length;
+			}
+		}
+		return bytes;
+	};
+
+	// all record variables are interleaved record by record
+	quint64 recordSize = 0;
+	int nrRecordVars = 0;
+	const Variable *coords = nullptr;
+	for (size_t i = 0; i < vars.size(); i++) {
+		bool isRecord = !vars[i].dimIds.empty() && int(vars[i].dimIds[0]) == recordDim;
+		if (isRecord) {
+			recordSize += pad4(slabSize(vars[i]));
+			nrRecordVars++;
+		}
+		if (vars[i].name == "coordinates") {
+			coords = &vars[i];
+		}
+	}
+
+	// AMBER convention: coordinates(frame, atom, spatial)
+	if (!coords || coords->type != NC_FLOAT || coords->dimIds.size() != 3) {
+		return false;
+	}
+	for (size_t j = 0; j < 3; j++) {
+		if (coords->dimIds[j] >= dims.size()) return false;
+	}
+	if (dims[coords->dimIds[2]].length != 3) {
+		return false;
+	}
+
+	m_nrAtoms = size_t(dims[coords->dimIds[1]].length);
+	m_begin = coords->begin;
+	const quint64 frameBytes = quint64(m_nrAtoms) * 3 * sizeof(float);
+	if (frameBytes == 0) {
+		return false;
+	}
+
+	quint64 nrFrames;
+	if (int(coords->dimIds[0]) == recordDim) {
+		// a single record variable is stored without padding
+		m_frameStride = nrRecordVars == 1 ? frameBytes : recordSize;
+		nrFrames = numrecs;
+	}
+	else {
+		m_frameStride = frameBytes;
+		nrFrames = dims[coords->dimIds[0]].length;
+	}
+
+	// streaming files and files of running simulations end with the last complete frame
+	if (m_begin + frameBytes > quint64(size)) {
+		nrFrames = 0;
+	}
+	else {
+		quint64 available = (quint64(size) - m_begin - frameBytes) / m_frameStride + 1;
+		if (numrecs == STREAMING || available < nrFrames) {
+			nrFrames = available;
+		}
+	}
+	m_nrFrames = size_t(nrFrames);
+
+	return true;
+}
+
+bool NetCDFMappedSource::readFrame(size_t frameNr, float *dst)
+{
+	return convertFrame(frameNr, dst, nullptr);
+}
+
+bool NetCDFMappedSource::readFramesAndBounds(size_t first, size_t count, float *dst, FrameBounds *bounds)
+{
+	for (size_t i = 0; i < count; i++) {
+		if (!convertFrame(first + i, dst + i * m_nrAtoms * 3, &bounds[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool NetCDFMappedSource::convertFrame(size_t frameNr, float *dst, FrameBounds *bounds)
+{
+	if (!isOpen() || frameNr >= m_nrFrames) {
+		return false;
+	}
+	const uchar *frame = frameData(frameNr);
+	for (size_t r = 0; r < m_atomRuns.size(); r++) {
+		const uchar *src = frame + m_atomRuns[r].first * 3 * sizeof(float);
+		if (bounds) {
+			SimdKernels::bigEndianToFloat(src, dst, m_atomRuns[r].second * 3, &bounds->min.x, &bounds->max.x);
+		}
+		else {
+			SimdKernels::bigEndianToFloat(src, dst, m_atomRuns[r].second * 3);
+		}
+		dst += m_atomRuns[r].second * 3;
+	}
+	return true;
+}
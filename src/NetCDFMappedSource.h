@@ -0,0 +1,71 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <QFile>
+#include <QString>
+
+#include "FrameSelection.h"
+#include "FrameSource.h"
+
+// Zero-copy reader for the "coordinates" variable of NetCDF classic (CDF-1)
+// and 64-bit offset (CDF-2) files. The header is parsed directly and the file
+// is memory mapped, so opening is independent of the file size and the page
+// cache is shared between processes. NetCDF-4 (HDF5) files are not supported,
+// use NetCDFFrameSource for those.
+class NetCDFMappedSource : public FrameSource
+{
+public:
+
+	NetCDFMappedSource();
+	~NetCDFMappedSource();
+
+	// true if the file starts with the CDF-1 or CDF-2 magic number
+	static bool isClassicFormat(const QString &path);
+
+	bool open(const QString &path, const FrameSelection &selection = FrameSelection());
+	void close();
+
+	bool isOpen() const { return m_data != nullptr; }
+
+	size_t nrFrames() const Q_DECL_OVERRIDE { return m_nrFrames; }
+	size_t nrAtoms() const Q_DECL_OVERRIDE { return m_nrAtoms; }
+
+	// big-endian coordinates of all atoms of a selected frame inside the mapping (no copy)
+	inline const uchar *frameData(size_t frameNr) const
+	{
+		return m_data + m_begin + m_selection.fileFrame(frameNr) * m_frameStride;
+	}
+
+	bool isReentrant() const Q_DECL_OVERRIDE { return true; }
+
+	// byte-swaps the selected atoms of the frame into dst, may be called from several threads at once
+	bool readFrame(size_t frameNr, float *dst) Q_DECL_OVERRIDE;
+
+	// the bounds are reduced while swapping
+	bool readFramesAndBounds(size_t first, size_t count, float *dst, FrameBounds *bounds) Q_DECL_OVERRIDE;
+
+private:
+
+	// readFrame, also extends bounds unless it is null
+	bool convertFrame(size_t frameNr, float *dst, FrameBounds *bounds);
+
+	bool parseHeader(const uchar *header, qint64 size);
+
+	QFile m_file;
+	uchar *m_data;
+	qint64 m_size;
+
+	size_t m_nrFrames; // selected frames and atoms
+	size_t m_nrAtoms;
+
+	FrameSelection m_selection;
+	std::vector<std::pair<size_t, size_t> > m_atomRuns;
+
+	quint64 m_begin;       // file offset of the first frame
+	quint64 m_frameStride; // bytes between two frames (record size for record variables)
+};
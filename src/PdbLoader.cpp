@@ -8,165 +8,573 @@
 #include "PdbLoader.h"
 
 #include <algorithm>
+#include <cstring>
+#include <deque>
+#include <unordered_map>
 #include <QFile>
 #include <QDebug>
-#include <QTextStream>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QtConcurrent>
 
-// Color scheme taken from http://life.nthu.edu.tw/~fmhsu/rasframe/COLORS.HTM
-const glm::vec3 residueColors[] =
-{
-	glm::vec3(200,200,200) / 255.0f,     // ALA      dark grey
-	glm::vec3(20,90,255) / 255.0f,       // ARG      blue       
-	glm::vec3(0,220,220) / 255.0f,       // ASN      cyan   
-	glm::vec3(230,10,10) / 255.0f,       // ASP      bright red
-	glm::vec3(255,200,50) / 255.0f,      // CYS      yellow 
-	glm::vec3(0,220,220) / 255.0f,       // GLN      cyan   
-	glm::vec3(230,10,10) / 255.0f,       // GLU      bright red
-	glm::vec3(235,235,235) / 255.0f,     // GLY      light grey
-	glm::vec3(130,130,210) / 255.0f,     // HID      pale blue
-	glm::vec3(130,130,210) / 255.0f,     // HIE      pale blue
-	glm::vec3(130,130,210) / 255.0f,     // HIP      pale blue
-	glm::vec3(130,130,210) / 255.0f,     // HIS      pale blue
-	glm::vec3(15,130,15) / 255.0f,       // ILE      green  
-	glm::vec3(15,130,15) / 255.0f,       // LEU      green  
-	glm::vec3(20,90,255) / 255.0f,       // LYS      blue       
-	glm::vec3(255,200,50) / 255.0f,      // MET      yellow 
-	glm::vec3(50,50,170) / 255.0f,       // PHE      mid blue
-	glm::vec3(220,150,130) / 255.0f,     // PRO      flesh  
-	glm::vec3(250,150,0) / 255.0f,       // SER      orange 
-	glm::vec3(250,150,0) / 255.0f,       // THR      orange 
-	glm::vec3(180,90,180) / 255.0f,      // TRP      pink   
-	glm::vec3(50,50,170) / 255.0f,       // TYR      mid blue
-	glm::vec3(15,130,15) / 255.0f        // VAL      green  
-};
-
-const glm::vec3 AtomColors[] =
-{
-	glm::vec3(200,200,200) / 255.0f,	// C        light grey
-	glm::vec3(255,255,255) / 255.0f,	// H        white       
-	glm::vec3(143,143,255) / 255.0f,	// N        light blue
-	glm::vec3(240,0,0) / 255.0f,		// O        red         
-	glm::vec3(255,165,0) / 255.0f,		// P        orange      
-	glm::vec3(255,200,50) / 255.0f,		// S        yellow    
-	glm::vec3(255, 0,255) / 255.0f		// A        purple   
-};
-
-// RCSB Protein Data Bank File Format
-// http://deposit.rcsb.org/adit/docs/pdb_atom_format.html#ATOM
-bool PdbLoader::readAtomData(QString &path, std::vector<Atom> &atoms)
+#include "AtomTables.h"
+#include "GzipDevice.h"
+#include "PdbParser.h"
+#include "SimdKernels.h"
+
+namespace
 {
+	// blocks of a few MB keep all cores busy without merging many small blocks
+	const qint64 MIN_BLOCK_BYTES = 1 << 22;
+
+	// interns the blank trimmed field, -1 if it is blank
+	int intern(StringPool &strings, const char *field, int width)
+	{
+		int first = 0;
+		while (first < width && field[first] == ' ') {
+			first++;
+		}
+		int last = width;
+		while (last > first && field[last - 1] == ' ') {
+			last--;
+		}
+		return last > first ? strings.intern(field + first, last - first) : -1;
+	}
 
-	QFile file(path);
-		
-	if (!file.exists()) {
-        qCritical() << "Error loading file: " << path;
-		return false;
+	// chain ids in order of first appearance of the chain keys
+	class ChainIds
+	{
+	public:
+
+		void add(const std::vector<quint32> &chainOrder)
+		{
+			for (size_t i = 0; i < chainOrder.size(); i++) {
+				m_ids.insert(std::make_pair(chainOrder[i], int(m_ids.size())));
+			}
+		}
+
+		int id(quint32 key) const
+		{
+			const auto it = m_ids.find(key);
+			return it != m_ids.end() ? it->second : -1;
+		}
+
+	private:
+
+		std::unordered_map<quint32, int> m_ids;
+	};
+
+	// parsed blocks of each model of a file in file order
+	typedef std::vector<std::vector<PdbAtoms>> Models;
+
+	size_t countAtoms(const std::vector<PdbAtoms> &blocks)
+	{
+		size_t nrAtoms = 0;
+		for (size_t i = 0; i < blocks.size(); i++) {
+			nrAtoms += blocks[i].size();
+		}
+		return nrAtoms;
 	}
 
-	if (!file.open(QIODevice::ReadOnly)) {
-        qCritical() << "Error loading file: " << file.errorString();
+	// prints the totals of the parsed blocks
+	void reportModels(const QString &path, const Models &models, qint64 elapsed, size_t nrThreads)
+	{
+		size_t nrAtoms = 0;
+		size_t nrBlocks = 0;
+		size_t unknownSymbols = 0;
+		size_t malformedLines = 0;
+		for (size_t m = 0; m < models.size(); m++) {
+			nrAtoms += countAtoms(models[m]);
+			nrBlocks += models[m].size();
+			for (size_t i = 0; i < models[m].size(); i++) {
+				unknownSymbols += models[m][i].unknownSymbols;
+				malformedLines += models[m][i].malformedLines;
+			}
+		}
+
+		if (unknownSymbols > 0) {
+			qDebug() << path << ":" << unknownSymbols << "atoms with unknown symbols";
+		}
+		if (malformedLines > 0) {
+			qWarning() << path << ":" << malformedLines << "malformed ATOM records skipped";
+		}
+		qInfo() << "Parsed" << nrAtoms << "atoms in" << models.size() << "models of" << path << "in" << elapsed << "ms,"
+			<< nrBlocks << "blocks on" << nrThreads << "threads";
 	}
 
-	QString pdbName = file.fileName();
-	QList<QChar> chains;
-	QTextStream in(&file);
+	// operators of the assembly in the header [begin, end)
+	std::vector<float> readAssembly(const QString &path, const char *begin, const char *end)
+	{
+		size_t nrChainGroups = 0;
+		std::vector<float> assembly = PdbParser::parseAssembly(begin, end, &nrChainGroups);
+		if (nrChainGroups > 1) {
+			qWarning() << "Assembly of" << path << "applies operators to" << nrChainGroups
+				<< "groups of chains, drawing the asymmetric unit";
+		}
+		return assembly;
+	}
+
+	// borders of the parts of the lines [begin, end) that belong to one model each, given the MODEL
+	// records in them; the first part continues the model of the lines before. In a file with models
+	// (see PdbParser::hasModels) a model starts at each MODEL record but the first one, the lines
+	// before the second MODEL record belong to the first model; a file without them is one model.
+	// seenModel tells whether the lines before had a MODEL record, mapped and inflated files are
+	// split the same way
+	std::vector<const char *> modelBorders(const char *begin, const char *end, const std::vector<const char *> &records,
+		bool hasModels, bool &seenModel)
+	{
+		std::vector<const char *> borders(1, begin);
+		if (hasModels && !records.empty()) {
+			borders.insert(borders.end(), records.begin() + (seenModel ? 0 : 1), records.end());
+			seenModel = true;
+		}
+		borders.push_back(end);
+		return borders;
+	}
+
+	// inflated lines of a compressed file split into the parts of its models
+	struct InflatedBlock
+	{
+		std::vector<char> lines;
+		std::vector<const char *> borders;
+		std::vector<size_t> models; // model of each part
+		std::vector<PdbAtoms> parts;
+	};
+
+	// inflates a .pdb.gz file block by block; each block of complete lines is parsed by a task of the
+	// thread pool while the next one is inflated, the parts of the models are collected in file order.
+	// progress counts the blocks of the file on disk
+	bool parseCompressedFile(const QString &path, Models &models, std::vector<float> &assembly, LoadProgress *progress)
+	{
+		GzipDevice file(path);
+
+		if (!file.open(QIODevice::ReadOnly)) {
+			qCritical() << "Error loading file: " << file.errorString();
+			return false;
+		}
+
+		QElapsedTimer timer;
+		timer.start();
 
-	while (!in.atEnd()) {
-		QString line = in.readLine();
-		QStringList fields = line.split(",");
+		if (progress) {
+			progress->total = size_t((file.compressedSize() + MIN_BLOCK_BYTES - 1) / MIN_BLOCK_BYTES);
+		}
+
+		// HETATM records are only read for 3irl
+		const PdbParser parser(path.contains("3irl"));
+		std::deque<InflatedBlock> blocks; // added blocks do not move the ones being parsed
+		std::vector<QFuture<void>> parsed;
+		std::vector<char> buffer(MIN_BLOCK_BYTES);
+		size_t carried = 0;
+		size_t nrModels = 1;
+		bool hasModels = false;
+		bool seenModel = false;
+		bool failed = false;
+		for (bool last = false; !last; ) {
+			if (progress && progress->canceled) {
+				failed = true;
+				break;
+			}
+
+			const qint64 read = file.read(buffer.data() + carried, qint64(buffer.size() - carried));
+			if (read < 0) {
+				qCritical() << "Error reading file: " << file.errorString();
+				failed = true;
+				break;
+			}
+			last = read == 0;
+			if (progress) {
+				progress->done = size_t((file.compressedPos() + MIN_BLOCK_BYTES - 1) / MIN_BLOCK_BYTES);
+			}
+
+			// the unfinished line at the end of the block is carried to the next block
+			const char *begin = buffer.data();
+			const char *end = begin + carried + size_t(read);
+			const char *rest = end;
+			if (!last) {
+				while (rest > begin && rest[-1] != '\n') {
+					rest--;
+				}
+			}
+
+			// the first block extends past the header, which decides whether the file has models
+			if (blocks.empty() && !last && PdbParser::headerEnd(begin, rest) == rest) {
+				rest = begin;
+			}
+			carried = size_t(end - rest);
+			if (rest == begin) {
+				if (carried == buffer.size()) {
+					buffer.resize(buffer.size() * 2);
+				}
+				continue;
+			}
+
+			// the header with the assembly is at the beginning of the first block
+			if (blocks.empty()) {
+				assembly = readAssembly(path, begin, rest);
+				hasModels = PdbParser::hasModels(begin, rest);
+			}
+
+			// the lines are split at the MODEL records like a mapped file, the moved buffer keeps its data
+			blocks.emplace_back();
+			InflatedBlock &block = blocks.back();
+			const std::vector<const char *> records = hasModels ? PdbParser::findModels(begin, rest) : std::vector<const char *>();
+			block.borders = modelBorders(begin, rest, records, hasModels, seenModel);
+			block.models.push_back(nrModels - 1);
+			while (block.models.size() + 1 < block.borders.size()) {
+				block.models.push_back(nrModels++);
+			}
+			block.lines = std::move(buffer);
 
-        if (line.startsWith("ATOM") || (pdbName.contains("3irl") && line.startsWith("HETATM"))) {
+			buffer.assign(std::max(size_t(MIN_BLOCK_BYTES), carried * 2), 0);
+			std::memcpy(buffer.data(), rest, carried);
 
-			QStringRef xString(&line, 30, 8);
-			float x = xString.toFloat();
-			QStringRef yString(&line, 38, 8);
-			float y = yString.toFloat();
-			QStringRef zString(&line, 46, 8);
-			float z = zString.toFloat();
+			parsed.push_back(QtConcurrent::run([&parser, &block]() {
+				block.parts.resize(block.models.size());
+				for (size_t i = 0; i < block.parts.size(); i++) {
+					parser.parse(block.borders[i], block.borders[i + 1], block.parts[i]);
+				}
+			}));
+		}
+		for (size_t i = 0; i < parsed.size(); i++) {
+			parsed[i].waitForFinished();
+		}
+		if (failed) {
+			return false;
+		}
 
-			QStringRef name(&line, 12, 4);
-			name = name.trimmed();
-			
-			QStringRef symbol(&line, 76, 2);
-			symbol = symbol.trimmed();
+		models.assign(nrModels, std::vector<PdbAtoms>());
+		for (size_t b = 0; b < blocks.size(); b++) {
+			for (size_t i = 0; i < blocks[b].parts.size(); i++) {
+				models[blocks[b].models[i]].push_back(std::move(blocks[b].parts[i]));
+			}
+		}
 
-			//if (std::find(AtomHelper::atomSymbols.begin(), AtomHelper::atomSymbols.end(), x) != AtomHelper::atomSymbols.end()) {
-				//var t = Regex.Replace(name, @"[\d - ]", string.Empty).Trim();
-				//symbol = t[0].ToString();
-			//}
+		reportModels(path, models, timer.elapsed(), size_t(std::max(QThread::idealThreadCount(), 1)));
+		return true;
+	}
 
-			auto it_atomSymbols = std::find(AtomHelper::atomSymbols.begin(), AtomHelper::atomSymbols.end(), symbol);
-			auto symbolId = std::distance(AtomHelper::atomSymbols.begin(), it_atomSymbols);
-            if (it_atomSymbols == AtomHelper::atomSymbols.end()) {
-                qDebug() << pdbName << ": Atom symbol not available at line : " << line;
-				symbolId = 6;
+	// lines of a model parsed into one of its blocks
+	struct ModelBlock
+	{
+		size_t model;
+		size_t block;
+		const char *begin;
+		const char *end;
+	};
+
+	// lines searched for MODEL records
+	struct ModelSearch
+	{
+		const char *begin;
+		const char *end;
+		std::vector<const char *> models;
+	};
+
+	// borders of the models of a file, see modelBorders. The MODEL records are searched in blocks in
+	// parallel, a file without them is one model and only its header is scanned
+	std::vector<const char *> splitModels(const char *begin, const char *end, size_t nrThreads)
+	{
+		const bool hasModels = PdbParser::hasModels(begin, end);
+		std::vector<const char *> records;
+		if (hasModels) {
+			const size_t nrBlocks = std::min(nrThreads, size_t((end - begin) / MIN_BLOCK_BYTES) + 1);
+			const std::vector<const char *> blockBorders = PdbParser::split(begin, end, nrBlocks);
+			std::vector<ModelSearch> blocks;
+			for (size_t b = 0; b + 1 < blockBorders.size(); b++) {
+				const ModelSearch block = { blockBorders[b], blockBorders[b + 1], std::vector<const char *>() };
+				blocks.push_back(block);
 			}
-			
+			QtConcurrent::blockingMap(blocks, [](ModelSearch &block) {
+				block.models = PdbParser::findModels(block.begin, block.end);
+			});
+			for (size_t b = 0; b < blocks.size(); b++) {
+				records.insert(records.end(), blocks[b].models.begin(), blocks[b].models.end());
+			}
+		}
+		bool seenModel = false;
+		return modelBorders(begin, end, records, hasModels, seenModel);
+	}
+
+	// maps the file and parses blocks of its lines in parallel, the blocks of the models are in
+	// file order; models are independent and are parsed in parallel as well. progress counts the
+	// parsed blocks, a canceled load skips the remaining ones
+	bool parseFile(const QString &path, Models &models, std::vector<float> &assembly, LoadProgress *progress)
+	{
+		if (GzipDevice::isCompressed(path)) {
+			return parseCompressedFile(path, models, assembly, progress);
+		}
+
+		QFile file(path);
 
-			// Skip hydrogen atoms 
-			if (symbolId == 1) continue;
+		if (!file.open(QIODevice::ReadOnly)) {
+			qCritical() << "Error loading file: " << file.errorString();
+			return false;
+		}
+
+		const qint64 size = file.size();
+		const uchar *data = size > 0 ? file.map(0, size) : nullptr;
+		if (!data) {
+			qCritical() << "Error mapping file: " << path;
+			return false;
+		}
 
-			float radius = AtomHelper::atomRadii[symbolId];
+		QElapsedTimer timer;
+		timer.start();
+
+		const char *begin = reinterpret_cast<const char *>(data);
+		assembly = readAssembly(path, begin, begin + size);
+		const size_t nrThreads = size_t(std::max(QThread::idealThreadCount(), 1));
+		const std::vector<const char *> modelBorders = splitModels(begin, begin + size, nrThreads);
+		const size_t nrModels = modelBorders.size() - 1;
+		models.assign(nrModels, std::vector<PdbAtoms>());
+
+		// large models are split into blocks, an ensemble of many small models is parsed model by model
+		const size_t maxBlocks = std::max(nrThreads * 4 / nrModels, size_t(1));
+		std::vector<ModelBlock> blocks;
+		for (size_t m = 0; m < nrModels; m++) {
+			const qint64 modelSize = modelBorders[m + 1] - modelBorders[m];
+			const size_t nrBlocks = std::min(maxBlocks, size_t(modelSize / MIN_BLOCK_BYTES) + 1);
+			const std::vector<const char *> borders = PdbParser::split(modelBorders[m], modelBorders[m + 1], nrBlocks);
+			models[m].resize(borders.size() - 1);
+			for (size_t b = 0; b + 1 < borders.size(); b++) {
+				const ModelBlock block = { m, b, borders[b], borders[b + 1] };
+				blocks.push_back(block);
+			}
+		}
 
-			QStringRef residueName(&line, 17, 3);
-			//residueName = residueName.trimmed();
+		if (progress) {
+			progress->total = blocks.size();
+		}
 
-			auto it_residueNames = std::find(AtomHelper::residueNames.begin(), AtomHelper::residueNames.end(), residueName);
-			auto residueId = std::distance(AtomHelper::residueNames.begin(), it_residueNames);
-            if (residueId < 0) {
-                qDebug() << pdbName << ": Residue symbol not available at line: " + line;
+		// HETATM records are only read for 3irl
+		const PdbParser parser(path.contains("3irl"));
+		QtConcurrent::blockingMap(blocks, [&](const ModelBlock &block) {
+			if (progress && progress->canceled) {
+				return;
+			}
+			parser.parse(block.begin, block.end, models[block.model][block.block]);
+			if (progress) {
+				progress->done++;
 			}
+		});
 
-			if (residueName == "HOH") continue;
+		file.unmap(const_cast<uchar *>(data));
+		if (progress && progress->canceled) {
+			return false;
+		}
 
-			QStringRef residueIndexStr(&line, 22, 4);
-			int residueIndex = residueIndexStr.toInt();
-			
+		reportModels(path, models, timer.elapsed(), nrThreads);
+		return true;
+	}
 
-			QCharRef chain = line[21];
-			if (chains.contains(chain)) {
-				chains.append(chain);
+	// the models with the atom count of the first one become frames, the others cannot share its topology
+	std::vector<size_t> frameModels(const QString &path, const Models &models)
+	{
+		std::vector<size_t> frames;
+		const size_t nrAtoms = countAtoms(models[0]);
+		for (size_t m = 0; m < models.size(); m++) {
+			const size_t modelAtoms = countAtoms(models[m]);
+			if (modelAtoms == nrAtoms) {
+				frames.push_back(m);
 			}
-			int chainId = chains.indexOf(chain);
+			else {
+				qWarning() << path << ": model" << m + 1 << "skipped, it has" << modelAtoms << "atoms instead of" << nrAtoms;
+			}
+		}
+		return frames;
+	}
+
+	// assembly operators as instance transforms of the parsed atoms, whose x is mirrored:
+	// the mirror S is applied before and after the operator (S R S, S t)
+	std::vector<glm::mat4> assemblyInstances(const std::vector<float> &assembly)
+	{
+		const float mirror[3] = { -1.0f, 1.0f, 1.0f };
+
+		std::vector<glm::mat4> instances(assembly.size() / 12, glm::mat4(1.0f));
+		for (size_t i = 0; i < instances.size(); i++) {
+			const float *rows = &assembly[i * 12];
+			for (int row = 0; row < 3; row++) {
+				for (int column = 0; column < 3; column++) {
+					instances[i][column][row] = mirror[row] * rows[row * 4 + column] * mirror[column];
+				}
+				instances[i][3][row] = mirror[row] * rows[row * 4 + 3];
+			}
+		}
+		return instances;
+	}
+}
+
+bool PdbLoader::readData(QString &path, Trajectory &trajectory, LoadProgress *progress)
+{
+	Models models;
+	std::vector<float> assembly;
+	if (!parseFile(path, models, assembly, progress)) {
+		return false;
+	}
+
+	// the first model holds the topology, every model adds a frame of positions
+	const std::vector<size_t> frames = frameModels(path, models);
+	if (!storeAtoms(models[0], trajectory, frames.size())) {
+		qCritical() << "No atoms in file: " << path;
+		return false;
+	}
+
+	std::vector<size_t> frameNrs;
+	for (size_t f = 1; f < frames.size(); f++) {
+		frameNrs.push_back(f);
+	}
+	QtConcurrent::blockingMap(frameNrs, [&](size_t frameNr) {
+		const std::vector<PdbAtoms> &blocks = models[frames[frameNr]];
+		float *positions = trajectory.framePositions(frameNr);
+		Trajectory::Bounds &bounds = trajectory.frameBounds[frameNr];
+		for (size_t b = 0; b < blocks.size(); b++) {
+			positions = std::copy(blocks[b].positions.begin(), blocks[b].positions.end(), positions);
+			SimdKernels::bounds(blocks[b].positions.data(), blocks[b].size(), &bounds.min.x, &bounds.max.x);
+		}
+	});
+
+	// the asymmetric unit is drawn once per copy of the assembly instead of expanding it
+	trajectory.instances = assemblyInstances(assembly);
+	if (!trajectory.instances.empty()) {
+		qInfo() << "Assembly of" << trajectory.instances.size() << "copies in" << path;
+	}
+	return true;
+}
+
+bool PdbLoader::storeAtoms(const std::vector<PdbAtoms> &blocks, Trajectory &trajectory, size_t nrFrames)
+{
+	// reconcile the numbering at the block borders in file order: chains get ids in order of
+	// their first appearance in the file, residues continue the numbering of the previous block
+	ChainIds chainIds;
+	std::vector<size_t> atomOffsets(blocks.size(), 0);
+	std::vector<int> residueOffsets(blocks.size(), 0);
+	size_t nrAtoms = 0;
+	size_t previous = blocks.size();
+	for (size_t b = 0; b < blocks.size(); b++) {
+		const PdbAtoms &atoms = blocks[b];
+		if (atoms.size() == 0) {
+			continue;
+		}
+		chainIds.add(atoms.chainOrder);
+		atomOffsets[b] = nrAtoms;
+		if (previous < blocks.size()) {
+			residueOffsets[b] = residueOffsets[previous] + blocks[previous].nextResidueSerial(atoms);
+		}
+		nrAtoms += atoms.size();
+		previous = b;
+	}
 
-			Atom atom;
-			atom.radius = radius;
-			atom.color = AtomColors[symbolId];
-			atom.name = name.toString();
-			atom.symbol = symbol.toString();
-			atom.symbolId = symbolId;
-			atom.residueName = residueName.toString();
-			atom.residueId = residueId;
-			atom.residueIndex = residueIndex;
-			atom.chain = chain;
-			atom.chainId = chainId;
-			atom.position = glm::vec3(-x,y,z);
+	if (nrAtoms == 0) {
+		return false;
+	}
 
-			atoms.push_back(atom);
+	// blocks are copied into the trajectory in parallel, their bounds in the same pass
+	trajectory.resize(std::max(nrFrames, size_t(1)), nrAtoms);
+	trajectory.frameBounds.assign(trajectory.nrFrames(), Trajectory::emptyBounds());
+	std::vector<Trajectory::Bounds> blockBounds(blocks.size(), trajectory.frameBounds[0]);
+	QtConcurrent::blockingMap(blocks, [&](const PdbAtoms &atoms) {
+		const size_t b = &atoms - &blocks[0];
+		const size_t offset = atomOffsets[b];
+		std::copy(atoms.positions.begin(), atoms.positions.end(), trajectory.framePositions(0) + offset * 3);
+		SimdKernels::bounds(atoms.positions.data(), atoms.size(), &blockBounds[b].min.x, &blockBounds[b].max.x);
+
+		// atoms of a chain are mostly consecutive
+		quint32 chain = 0;
+		int chainId = chainIds.id(chain);
+		for (size_t i = 0; i < atoms.size(); i++) {
+			const int symbolId = atoms.symbolIds[i];
+			if (atoms.chains[i] != chain) {
+				chain = atoms.chains[i];
+				chainId = chainIds.id(chain);
+			}
+			trajectory.radii[offset + i] = AtomTables::elementRadius(symbolId);
+			trajectory.colors[offset + i] = AtomTables::elementColor(symbolId);
+			trajectory.symbolIds[offset + i] = symbolId;
+			trajectory.residueIds[offset + i] = atoms.residueIds[i];
+			trajectory.residueIndices[offset + i] = atoms.residueSerials[i] + residueOffsets[b];
+			trajectory.chainIds[offset + i] = chainId;
 		}
+	});
 
+	Trajectory::Bounds &bounds = trajectory.frameBounds[0];
+	for (size_t b = 0; b < blocks.size(); b++) {
+		bounds.min = glm::min(bounds.min, blockBounds[b].min);
+		bounds.max = glm::max(bounds.max, blockBounds[b].max);
 	}
-	file.close();
+	return true;
+}
 
+bool PdbLoader::readAtomData(QString &path, std::vector<Atom> &atoms, StringPool &strings)
+{
+	Models models;
+	std::vector<float> assembly;
+	if (!parseFile(path, models, assembly, nullptr)) {
+		return false;
+	}
+
+	std::vector<PdbAtoms> &blocks = models[0];
+	PdbAtoms parsed;
+	for (size_t b = 0; b < blocks.size(); b++) {
+		parsed.append(blocks[b]);
+		blocks[b] = PdbAtoms();
+	}
+
+	storeAtoms(parsed, atoms, strings);
 	return true;
 }
 
+void PdbLoader::storeAtoms(const PdbAtoms &parsed, std::vector<Atom> &atoms, StringPool &strings)
+{
+	ChainIds chainIds;
+	chainIds.add(parsed.chainOrder);
+
+	atoms.reserve(atoms.size() + parsed.size());
+	for (size_t i = 0; i < parsed.size(); i++) {
+		const PdbAtoms::Labels &labels = parsed.labels[i];
+		const int symbolId = parsed.symbolIds[i];
+		char chainName[4];
+		const int chainLength = PdbAtoms::chainName(parsed.chains[i], chainName);
+
+		Atom atom;
+		atom.radius = AtomTables::elementRadius(symbolId);
+		atom.chainId = chainIds.id(parsed.chains[i]);
+		atom.symbolId = symbolId;
+		atom.residueId = parsed.residueIds[i];
+		atom.residueIndex = parsed.residueNumbers[i];
+		atom.helixIndex = -1;
+		atom.sheetIndex = -1;
+		atom.nbHelicesPerChain = -1;
+		atom.nbSheetsPerChain = -1;
+		atom.nameId = intern(strings, labels.name, 4);
+		atom.chainNameId = intern(strings, chainName, chainLength);
+		atom.symbolNameId = intern(strings, labels.symbol, 2);
+		atom.residueNameId = intern(strings, labels.residueName, 4);
+		atom.helixNameId = -1;
+		atom.sheetNameId = -1;
+		atom.position = glm::vec3(parsed.positions[i * 3], parsed.positions[i * 3 + 1], parsed.positions[i * 3 + 2]);
+		atom.color = AtomTables::elementColor(symbolId);
+
+		atoms.push_back(atom);
+	}
+}
+
 void PdbLoader::offsetAtoms(std::vector<Atom> &atoms, glm::vec3 offset)
 {
-    for (auto i = 0; i < atoms.size(); i++) {
+    for (size_t i = 0; i < atoms.size(); i++) {
 		atoms[i].position -= offset;
 	}
 }
 
-void PdbLoader::computeBounds(std::vector<Atom> &atoms, glm::vec3 &bbSize, glm::vec3 &bbCenter)
+void PdbLoader::computeBounds(const std::vector<Atom> &atoms, glm::vec3 &bbSize, glm::vec3 &bbCenter)
 {
 	auto bbMin = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
 	auto bbMax = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
 
     for (size_t i = 0; i < atoms.size(); i++) {
-		auto atom = atoms[i];
-		bbMin = glm::min(bbMin, atom.position);
-		bbMax = glm::max(bbMax, atom.position);
+		const glm::vec3 &position = atoms[i].position;
+		bbMin = glm::min(bbMin, position);
+		bbMax = glm::max(bbMax, position);
 	}
 
 	bbSize = bbMax - bbMin;
@@ -183,16 +591,33 @@ void PdbLoader::centerAtoms(std::vector<Atom> &atoms)
 	offsetAtoms(atoms, bbCenter);
 }
 
-
-Atom::Atom() 
-{
-}
-
-Atom::~Atom() 
+void PdbLoader::centerTrajectory(Trajectory &trajectory)
 {
-}
+	if (trajectory.isEmpty() || trajectory.isStreamed()) {
+		return;
+	}
 
-const std::vector<float> AtomHelper::atomRadii = { 1.548f, 1.100f, 1.400f, 1.348f, 1.880f, 1.808f, 1.5f };
-const std::vector<QString> AtomHelper::atomSymbols = { "C", "H", "N", "O", "P", "S", "A" };
-const std::vector<QString> AtomHelper::residueNames = { "ALA", "ARG", "ASN", "ASP", "CYS", "GLN", "GLU", "GLY", "HID", "HIE", "HIP", "HIS", "ILE", "LEU", "LYS", "MET", "PHE", "PRO", "SER", "THR", "TRP", "TYR", "VAL" };
+	const Trajectory::Bounds first = trajectory.instanceBounds(trajectory.frameBounds.empty()
+		? Trajectory::computeBounds(trajectory.framePositions(0), trajectory.nrAtoms()) : trajectory.frameBounds[0]);
+	const glm::vec3 center = (first.min + first.max) * 0.5f;
+
+	const size_t nrAtoms = trajectory.nrAtoms();
+	for (size_t frameNr = 0; frameNr < trajectory.loadedFrames(); frameNr++) {
+		float *positions = trajectory.framePositions(frameNr);
+		for (size_t i = 0; i < nrAtoms; i++) {
+			positions[i * 3] -= center.x;
+			positions[i * 3 + 1] -= center.y;
+			positions[i * 3 + 2] -= center.z;
+		}
+	}
+	for (size_t i = 0; i < trajectory.frameBounds.size(); i++) {
+		trajectory.frameBounds[i].min -= center;
+		trajectory.frameBounds[i].max -= center;
+	}
 
+	// an instance maps p + center to T (p + center), centered that is T p + (T center - center)
+	for (size_t i = 0; i < trajectory.instances.size(); i++) {
+		glm::mat4 &instance = trajectory.instances[i];
+		instance[3] += instance * glm::vec4(center, 0.0f) - glm::vec4(center, 0.0f);
+	}
+}
@@ -13,26 +13,36 @@
 
 #include "Vector.h"
 #include "Commons.h"
-
-class AtomHelper
-{
-public:
-	const static std::vector<float> atomRadii;
-	const static std::vector<QString> atomSymbols;
-	const static std::vector<QString> residueNames;
-	const static glm::vec3 residueColors[];
-	const static glm::vec3 AtomColors[];
-};
+#include "LoadProgress.h"
+#include "PdbParser.h"
+#include "StringPool.h"
+#include "Trajectory.h"
 
 class PdbLoader
 {
 public:
-	static bool readAtomData(QString &path, std::vector<Atom> &atoms);
+	// maps the file and parses it with PdbParser into a trajectory with a frame per model
+	// (one for files without MODEL records), colors and radii per element, chain ids in order
+	// of appearance; the topology is taken from the first model, the BIOMT operators of the
+	// first biological assembly become instances of the atoms; progress counts the blocks read
+	// and may cancel the load
+	static bool readData(QString &path, Trajectory &trajectory, LoadProgress *progress = nullptr);
+
+	// appends the atoms of the file (of its first model), their names are interned in strings
+	static bool readAtomData(QString &path, std::vector<Atom> &atoms, StringPool &strings);
+
+	// parsed blocks in file order into the topology and frame 0 of a trajectory of nrFrames frames,
+	// false if there are no atoms; shared with the other readers that produce PdbAtoms
+	static bool storeAtoms(const std::vector<PdbAtoms> &blocks, Trajectory &trajectory, size_t nrFrames = 1);
+	static void storeAtoms(const PdbAtoms &parsed, std::vector<Atom> &atoms, StringPool &strings);
 
 	static void centerAtoms(std::vector<Atom> &atoms);
 
+	// moves the center of the bounding box of the first frame (of all its instances) to the origin
+	static void centerTrajectory(Trajectory &trajectory);
+
 	static void offsetAtoms(std::vector<Atom> &atoms, glm::vec3 offset);
 
-	static void computeBounds(std::vector<Atom> &atoms, glm::vec3 &bbSize, glm::vec3 &bbCenter);
+	static void computeBounds(const std::vector<Atom> &atoms, glm::vec3 &bbSize, glm::vec3 &bbCenter);
 
 };
@@ -0,0 +1,458 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "PdbParser.h"
+
+#include "AtomTables.h"
+
+#include <algorithm>
+#include <cstring>
+
+// columns of an ATOM record (0-based)
+//   0-5   record name       12-15 atom name        17-20 residue name (20 blank or CHARMM)
+//   21    chain identifier  22-25 residue number   26    insertion code
+//   30-37, 38-45, 46-53 x, y, z
+//   76-77 element symbol (right justified)
+// columns of a REMARK 350 BIOMTn record
+//   13-17 "BIOMT", 18 row   19-22 operator serial   23-32, 33-42, 43-52 rotation   53-67 translation
+
+namespace
+{
+	const size_t COORDS_END = 54;
+	const size_t LINE_BYTES = 81; // to estimate the number of records of a block
+
+	const double POW10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+		1e16, 1e17, 1e18 };
+
+	inline bool isDigit(char c)
+	{
+		return unsigned(c - '0') < 10;
+	}
+
+	// an ion is the only atom of its residue and named like it, e.g. HG (mercury)
+	inline bool isNamedLikeResidue(const PdbAtoms::Labels &labels)
+	{
+		int first = 0;
+		while (first < 4 && labels.residueName[first] == ' ') {
+			first++;
+		}
+		int last = 4;
+		while (last > first && labels.residueName[last - 1] == ' ') {
+			last--;
+		}
+		int length = 4;
+		while (length > 0 && labels.name[length - 1] == ' ') {
+			length--;
+		}
+		return length > 0 && length == last - first && std::memcmp(labels.name, labels.residueName + first, length) == 0;
+	}
+
+	// copies columns [first, first + count) of the line, blanks beyond its end
+	inline void copyColumns(const char *line, size_t length, size_t first, size_t count, char *dst)
+	{
+		for (size_t i = 0; i < count; i++) {
+			dst[i] = first + i < length ? line[first + i] : ' ';
+		}
+	}
+}
+
+void PdbAtoms::clear()
+{
+	positions.clear();
+	symbolIds.clear();
+	residueIds.clear();
+	residueNumbers.clear();
+	residueSerials.clear();
+	chains.clear();
+	chainOrder.clear();
+	labels.clear();
+	unknownSymbols = 0;
+	malformedLines = 0;
+}
+
+void PdbAtoms::reserve(size_t nrAtoms)
+{
+	positions.reserve(nrAtoms * 3);
+	symbolIds.reserve(nrAtoms);
+	residueIds.reserve(nrAtoms);
+	residueNumbers.reserve(nrAtoms);
+	residueSerials.reserve(nrAtoms);
+	chains.reserve(nrAtoms);
+	labels.reserve(nrAtoms);
+}
+
+void PdbAtoms::addAtom(const Labels &atomLabels, int symbolId, int residueId, int residueNumber, quint32 chain,
+	float x, float y, float z)
+{
+	positions.push_back(x);
+	positions.push_back(y);
+	positions.push_back(z);
+	symbolIds.push_back(symbolId);
+	residueIds.push_back(residueId);
+	residueNumbers.push_back(residueNumber);
+	chains.push_back(chain);
+	labels.push_back(atomLabels);
+
+	// a new residue starts where chain, residue number or insertion code change
+	const size_t atom = size() - 1;
+	if (atom == 0) {
+		residueSerials.push_back(0);
+	}
+	else {
+		const int previous = residueSerials.back();
+		residueSerials.push_back(sameResidue(*this, atom - 1, *this, atom) ? previous : previous + 1);
+	}
+	if (atom == 0 || chains[atom - 1] != chain) {
+		if (std::find(chainOrder.begin(), chainOrder.end(), chain) == chainOrder.end()) {
+			chainOrder.push_back(chain);
+		}
+	}
+}
+
+quint32 PdbAtoms::chainKey(const char *text, int length)
+{
+	quint32 key = 0;
+	for (int i = 0; i < length && i < 4; i++) {
+		key |= quint32(quint8(text[i])) << (i * 8);
+	}
+	return key;
+}
+
+int PdbAtoms::chainName(quint32 key, char name[4])
+{
+	int length = 0;
+	for (; length < 4 && (key >> (length * 8)) != 0; length++) {
+		name[length] = char((key >> (length * 8)) & 0xFF);
+	}
+	return length;
+}
+
+bool PdbAtoms::sameResidue(const PdbAtoms &a, size_t i, const PdbAtoms &b, size_t j)
+{
+	return a.chains[i] == b.chains[j] && a.residueNumbers[i] == b.residueNumbers[j]
+		&& a.labels[i].insertionCode == b.labels[j].insertionCode;
+}
+
+int PdbAtoms::nextResidueSerial(const PdbAtoms &block) const
+{
+	if (size() == 0) {
+		return 0;
+	}
+	const size_t last = size() - 1;
+	if (block.size() > 0 && sameResidue(*this, last, block, 0)) {
+		return residueSerials[last];
+	}
+	return residueSerials[last] + 1;
+}
+
+void PdbAtoms::append(const PdbAtoms &block)
+{
+	const int residueOffset = nextResidueSerial(block);
+
+	positions.insert(positions.end(), block.positions.begin(), block.positions.end());
+	symbolIds.insert(symbolIds.end(), block.symbolIds.begin(), block.symbolIds.end());
+	residueIds.insert(residueIds.end(), block.residueIds.begin(), block.residueIds.end());
+	residueNumbers.insert(residueNumbers.end(), block.residueNumbers.begin(), block.residueNumbers.end());
+	for (size_t i = 0; i < block.residueSerials.size(); i++) {
+		residueSerials.push_back(block.residueSerials[i] + residueOffset);
+	}
+	chains.insert(chains.end(), block.chains.begin(), block.chains.end());
+	for (size_t i = 0; i < block.chainOrder.size(); i++) {
+		if (std::find(chainOrder.begin(), chainOrder.end(), block.chainOrder[i]) == chainOrder.end()) {
+			chainOrder.push_back(block.chainOrder[i]);
+		}
+	}
+	labels.insert(labels.end(), block.labels.begin(), block.labels.end());
+
+	unknownSymbols += block.unknownSymbols;
+	malformedLines += block.malformedLines;
+}
+
+PdbParser::PdbParser(bool includeHetatm)
+	: m_includeHetatm(includeHetatm)
+{
+}
+
+const char *PdbParser::nextLine(const char *p, const char *end)
+{
+	const char *newline = static_cast<const char *>(std::memchr(p, '\n', end - p));
+	return newline ? newline + 1 : end;
+}
+
+std::vector<const char *> PdbParser::split(const char *begin, const char *end, size_t nrBlocks)
+{
+	nrBlocks = std::max(nrBlocks, size_t(1));
+
+	std::vector<const char *> borders(1, begin);
+	for (size_t i = 1; i < nrBlocks; i++) {
+		// the line containing the byte before the even split point belongs to the previous block
+		const char *p = begin + size_t(end - begin) * i / nrBlocks;
+		const char *border = p > begin ? nextLine(p - 1, end) : begin;
+		borders.push_back(std::max(border, borders.back()));
+	}
+	borders.push_back(end);
+	return borders;
+}
+
+const char *PdbParser::findModel(const char *begin, const char *end)
+{
+	const char *p = begin;
+	while (p < end && !(end - p >= 5 && std::memcmp(p, "MODEL", 5) == 0)) {
+		p = nextLine(p, end);
+	}
+	return p;
+}
+
+std::vector<float> PdbParser::parseAssembly(const char *begin, const char *end, size_t *nrChainGroups)
+{
+	static const size_t BIOMT_COLUMNS[] = { 23, 33, 43, 53, 68 };
+
+	std::vector<float> rows;
+	int nrBiomolecules = 0;
+	size_t nrGroups = 0;
+	for (const char *line = begin; line < end; ) {
+		const char *next = nextLine(line, end);
+
+		size_t length = size_t(next - line);
+		while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+			length--;
+		}
+
+		// the header ends with the first coordinate record
+		if ((length >= 4 && std::memcmp(line, "ATOM", 4) == 0) || (length >= 6 && std::memcmp(line, "HETATM", 6) == 0)
+			|| (length >= 5 && std::memcmp(line, "MODEL", 5) == 0)) {
+			break;
+		}
+		if (length < 19 || std::memcmp(line, "REMARK 350", 10) != 0) {
+			line = next;
+			continue;
+		}
+
+		// only the first biomolecule is read
+		const char *biomolecule = "BIOMOLECULE:";
+		if (std::search(line + 10, line + length, biomolecule, biomolecule + 12) != line + length && ++nrBiomolecules > 1) {
+			break;
+		}
+
+		// each group of chains has its own operators ("AND CHAINS:" continues the list of chains)
+		const char *apply = "APPLY THE FOLLOWING TO CHAINS:";
+		if (std::search(line + 10, line + length, apply, apply + 30) != line + length) {
+			nrGroups++;
+		}
+
+		if (std::memcmp(line + 13, "BIOMT", 5) == 0) {
+			// rows 1 to 3 of each operator in order
+			if (line[18] - '1' != int(rows.size() / 4 % 3)) {
+				return std::vector<float>();
+			}
+			for (int i = 0; i < 4; i++) {
+				float value;
+				if (BIOMT_COLUMNS[i] >= length
+					|| !parseFloat(line + BIOMT_COLUMNS[i], line + std::min(BIOMT_COLUMNS[i + 1], length), value)) {
+					return std::vector<float>();
+				}
+				rows.push_back(value);
+			}
+		}
+		line = next;
+	}
+
+	if (nrChainGroups) {
+		*nrChainGroups = nrGroups;
+	}
+	if (rows.size() % 12 != 0 || nrGroups > 1) {
+		return std::vector<float>();
+	}
+	return rows;
+}
+
+const char *PdbParser::headerEnd(const char *begin, const char *end)
+{
+	const char *line = begin;
+	for (; line < end; line = nextLine(line, end)) {
+		const size_t length = size_t(end - line);
+		if ((length >= 5 && std::memcmp(line, "MODEL", 5) == 0) || (length >= 4 && std::memcmp(line, "ATOM", 4) == 0)
+			|| (length >= 6 && std::memcmp(line, "HETATM", 6) == 0)) {
+			break;
+		}
+	}
+	return line;
+}
+
+bool PdbParser::hasModels(const char *begin, const char *end)
+{
+	const char *line = headerEnd(begin, end);
+	return end - line >= 5 && std::memcmp(line, "MODEL", 5) == 0;
+}
+
+std::vector<const char *> PdbParser::findModels(const char *begin, const char *end)
+{
+	std::vector<const char *> models;
+	for (const char *model = findModel(begin, end); model < end; model = findModel(nextLine(model, end), end)) {
+		models.push_back(model);
+	}
+	return models;
+}
+
+bool PdbParser::parseFloat(const char *begin, const char *end, float &value)
+{
+	const char *p = begin;
+	while (p < end && *p == ' ') {
+		p++;
+	}
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+
+	// fields are at most 8 characters wide, the mantissa is exact and a single
+	// correctly rounded division by a power of ten gives the value
+	quint64 mantissa = 0;
+	int digits = 0;
+	int decimals = 0;
+	while (p < end && isDigit(*p) && digits < 18) {
+		mantissa = mantissa * 10 + (*p++ - '0');
+		digits++;
+	}
+	if (p < end && *p == '.') {
+		p++;
+		while (p < end && isDigit(*p) && digits < 18) {
+			mantissa = mantissa * 10 + (*p++ - '0');
+			digits++;
+			decimals++;
+		}
+	}
+	while (p < end && *p == ' ') {
+		p++;
+	}
+	if (p != end || digits == 0) {
+		return false;
+	}
+
+	const double v = double(mantissa) / POW10[decimals];
+	value = float(negative ? -v : v);
+	return true;
+}
+
+bool PdbParser::parseInt(const char *begin, const char *end, int &value)
+{
+	const char *p = begin;
+	while (p < end && *p == ' ') {
+		p++;
+	}
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+
+	int v = 0;
+	int digits = 0;
+	while (p < end && isDigit(*p) && digits < 9) {
+		v = v * 10 + (*p++ - '0');
+		digits++;
+	}
+	while (p < end && *p == ' ') {
+		p++;
+	}
+	if (p != end || digits == 0) {
+		return false;
+	}
+
+	value = negative ? -v : v;
+	return true;
+}
+
+int PdbParser::elementId(const PdbAtoms::Labels &labels, int residueId)
+{
+	if (labels.symbol[0] != ' ' || labels.symbol[1] != ' ') {
+		return AtomTables::elementId(labels.symbol, 2);
+	}
+
+	// files without element column: the element is right justified in the first two columns
+	// of the atom name, two letter elements only occur in ions and ligands (" CA " is C alpha)
+	const char *name = labels.name;
+	const bool isLigand = AtomTables::residueType(residueId) == AtomTables::LIGAND;
+
+	// hydrogens with four character names start in the first column as well ("HO2'" is not holmium,
+	// "1HB " of older files), so does deuterium; ions like HG are named like their residue
+	if (isDigit(name[0]) || ((name[0] == 'H' || name[0] == 'D') && !(isLigand && isNamedLikeResidue(labels)))) {
+		return AtomTables::HYDROGEN;
+	}
+	if (name[0] != ' ' && isLigand) {
+		const int id = AtomTables::elementId(name, 2);
+		if (id != AtomTables::UNKNOWN_ELEMENT) {
+			return id;
+		}
+	}
+	for (int i = 0; i < 4; i++) {
+		if (name[i] != ' ' && !isDigit(name[i])) {
+			return AtomTables::elementId(name + i, 1);
+		}
+	}
+	return AtomTables::UNKNOWN_ELEMENT;
+}
+
+void PdbParser::parse(const char *begin, const char *end, PdbAtoms &atoms) const
+{
+	atoms.reserve(atoms.size() + size_t(end - begin) / LINE_BYTES + 1);
+
+	for (const char *line = begin; line < end; ) {
+		const char *next = nextLine(line, end);
+
+		size_t length = size_t(next - line);
+		while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+			length--;
+		}
+
+		const bool isAtom = length >= 4 && std::memcmp(line, "ATOM", 4) == 0;
+		const bool isHetatm = m_includeHetatm && length >= 6 && std::memcmp(line, "HETATM", 6) == 0;
+		if (!isAtom && !isHetatm) {
+			line = next;
+			continue;
+		}
+
+		PdbAtoms::Labels labels;
+		copyColumns(line, length, 12, 4, labels.name);
+		copyColumns(line, length, 17, 4, labels.residueName);
+		copyColumns(line, length, 76, 2, labels.symbol);
+
+		const int residue = AtomTables::residueId(labels.residueName, 4);
+		const int symbol = elementId(labels, residue);
+
+		// skip hydrogen atoms and waters
+		if (symbol == AtomTables::HYDROGEN || AtomTables::residueType(residue) == AtomTables::WATER) {
+			line = next;
+			continue;
+		}
+
+		float x, y, z;
+		if (length < COORDS_END || !parseFloat(line + 30, line + 38, x) || !parseFloat(line + 38, line + 46, y) ||
+			!parseFloat(line + 46, line + 54, z)) {
+			atoms.malformedLines++;
+			line = next;
+			continue;
+		}
+
+		int residueNumber;
+		if (!parseInt(line + 22, line + 26, residueNumber)) {
+			residueNumber = 0;
+		}
+
+		copyColumns(line, length, 26, 1, &labels.insertionCode);
+
+		if (symbol == AtomTables::UNKNOWN_ELEMENT) {
+			atoms.unknownSymbols++;
+		}
+
+		atoms.addAtom(labels, symbol, residue, residueNumber, PdbAtoms::chainKey(line + 21, 1), -x, y, z);
+
+		line = next;
+	}
+}
@@ -0,0 +1,114 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <vector>
+#include <QtGlobal>
+
+// Atoms parsed from a block of PDB lines in structure-of-arrays layout. The vectors grow
+// per block, not per atom, and hold no strings.
+struct PdbAtoms
+{
+	// fixed column text of an atom, space padded as in the file
+	struct Labels
+	{
+		char name[4];
+		char residueName[4];
+		char insertionCode;
+		char symbol[2];
+	};
+
+	std::vector<float> positions; // x, y, z
+	std::vector<int> symbolIds; // element ids, see AtomTables
+	std::vector<int> residueIds; // -1 for unknown residues
+	std::vector<int> residueNumbers; // residue sequence number of the file
+	std::vector<int> residueSerials; // residues numbered in file order, from 0
+	std::vector<quint32> chains; // chain identifiers, see chainKey
+	std::vector<quint32> chainOrder; // distinct chains in order of appearance
+	std::vector<Labels> labels;
+
+	size_t unknownSymbols = 0; // atoms stored with AtomTables::UNKNOWN_ELEMENT
+	size_t malformedLines = 0; // ATOM records (or mmCIF rows) too short or with unreadable coordinates
+
+	size_t size() const { return symbolIds.size(); }
+
+	void clear();
+	void reserve(size_t nrAtoms);
+
+	// appends an atom, numbers its residue and records its chain
+	void addAtom(const Labels &labels, int symbolId, int residueId, int residueNumber, quint32 chain,
+		float x, float y, float z);
+
+	// chain identifier of up to 4 characters (mmCIF) packed into an integer, 0 for none;
+	// chainName unpacks it
+	static quint32 chainKey(const char *text, int length);
+	static int chainName(quint32 key, char name[4]);
+
+	// true if atom i of a and atom j of b belong to the same residue
+	static bool sameResidue(const PdbAtoms &a, size_t i, const PdbAtoms &b, size_t j);
+
+	// serial of the first residue of block if block directly follows these atoms in the file:
+	// a residue split at the border of two blocks keeps its number
+	int nextResidueSerial(const PdbAtoms &block) const;
+
+	// appends the atoms of the following block of the file
+	void append(const PdbAtoms &block);
+};
+
+// Byte level parser of the fixed column ATOM (and optionally HETATM) records of a PDB file.
+// It works on any range of complete lines, e.g. of a memory mapped file, and performs no
+// allocation per line or atom. Hydrogen atoms and waters are skipped, x is mirrored.
+// A file split at line boundaries (see split) can be parsed in parallel, the blocks are
+// joined in file order with PdbAtoms::append.
+// RCSB Protein Data Bank File Format
+// http://deposit.rcsb.org/adit/docs/pdb_atom_format.html#ATOM
+class PdbParser
+{
+public:
+
+	explicit PdbParser(bool includeHetatm = false);
+
+	// appends the atoms of the lines in [begin, end) to atoms
+	void parse(const char *begin, const char *end, PdbAtoms &atoms) const;
+
+	// start of the line following p, or end
+	static const char *nextLine(const char *p, const char *end);
+
+	// nrBlocks + 1 borders of blocks of about the same size that start at line beginnings
+	static std::vector<const char *> split(const char *begin, const char *end, size_t nrBlocks);
+
+	// operators of the first biological assembly (REMARK 350 BIOMT records of the header), 12 values
+	// per operator: the rows of the 3x4 matrix that maps the deposited coordinates to a copy of
+	// the assembly; empty if there are none or they are incomplete. The operators are applied to
+	// all chains, so the assembly is empty as well if its operators are applied to different chains
+	// in several groups (APPLY THE FOLLOWING TO CHAINS), their number is returned in nrChainGroups
+	static std::vector<float> parseAssembly(const char *begin, const char *end, size_t *nrChainGroups = nullptr);
+
+	// start of the first MODEL record in the lines [begin, end), or end
+	static const char *findModel(const char *begin, const char *end);
+
+	// start of the first MODEL, ATOM or HETATM record, which ends the header, or end
+	static const char *headerEnd(const char *begin, const char *end);
+
+	// true if a MODEL record comes before the first ATOM or HETATM record, as in multi-model files
+	// (NMR ensembles, morphs); the scan stops at the first atom, the atoms of a structure are not read
+	static bool hasModels(const char *begin, const char *end);
+
+	// starts of all MODEL records in the lines [begin, end)
+	static std::vector<const char *> findModels(const char *begin, const char *end);
+
+	// fixed column numbers, leading and trailing blanks are allowed; false if the field holds anything else
+	static bool parseFloat(const char *begin, const char *end, float &value);
+	static bool parseInt(const char *begin, const char *end, int &value);
+
+	// element of the symbol columns or, if they are blank, guessed from the atom name
+	static int elementId(const PdbAtoms::Labels &labels, int residueId);
+
+private:
+
+	bool m_includeHetatm;
+};
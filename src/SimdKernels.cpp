@@ -0,0 +1,566 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "SimdKernels.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <QtEndian>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef USE_SSE2
+// swaps the bytes of each 16-bit half, then the two halves of each 32-bit word
+static inline __m128i swapBytes(__m128i v)
+{
+	v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+	v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+// stores x, y and z of four atoms as x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+static inline void interleave4(__m128 vx, __m128 vy, __m128 vz, float *out)
+{
+	__m128 xyLo = _mm_unpacklo_ps(vx, vy); // x0 y0 x1 y1
+	__m128 xyHi = _mm_unpackhi_ps(vx, vy); // x2 y2 x3 y3
+
+	__m128 t0 = _mm_shuffle_ps(vz, xyLo, _MM_SHUFFLE(2, 2, 0, 0)); // z0 z0 x1 x1
+	__m128 t1 = _mm_shuffle_ps(xyLo, vz, _MM_SHUFFLE(1, 1, 3, 3)); // y1 y1 z1 z1
+	__m128 t2 = _mm_shuffle_ps(xyHi, vz, _MM_SHUFFLE(3, 2, 3, 2)); // x3 y3 z2 z3
+
+	_mm_storeu_ps(out, _mm_shuffle_ps(xyLo, t0, _MM_SHUFFLE(2, 0, 1, 0)));
+	_mm_storeu_ps(out + 4, _mm_shuffle_ps(t1, xyHi, _MM_SHUFFLE(1, 0, 2, 0)));
+	_mm_storeu_ps(out + 8, _mm_shuffle_ps(t2, t2, _MM_SHUFFLE(3, 1, 0, 2)));
+}
+
+// extends min and max by three registers of x, y, z triples, lane k of the 12 values is axis k % 3
+static inline void foldBounds(const __m128 lo[3], const __m128 hi[3], float min[3], float max[3])
+{
+	float l[12], h[12];
+	for (int r = 0; r < 3; r++) {
+		_mm_storeu_ps(l + r * 4, lo[r]);
+		_mm_storeu_ps(h + r * 4, hi[r]);
+	}
+	for (int k = 0; k < 12; k++) {
+		min[k % 3] = std::min(min[k % 3], l[k]);
+		max[k % 3] = std::max(max[k % 3], h[k]);
+	}
+}
+#endif
+
+void SimdKernels::bigEndianToFloat(const void *src, float *dst, size_t count)
+{
+	const unsigned char *in = static_cast<const unsigned char *>(src);
+	size_t i = 0;
+
+#ifdef USE_SSE2
+	for (; i + 4 <= count; i += 4) {
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i * 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), swapBytes(v));
+	}
+#endif
+
+	for (; i < count; i++) {
+		quint32 bits = qFromBigEndian<quint32>(in + i * 4);
+		std::memcpy(dst + i, &bits, sizeof(float));
+	}
+}
+
+void SimdKernels::bigEndianToFloat(const void *src, float *dst, size_t count, float min[3], float max[3])
+{
+	const unsigned char *in = static_cast<const unsigned char *>(src);
+	size_t i = 0;
+
+#ifdef USE_SSE2
+	if (count >= 12) {
+		__m128 lo[3], hi[3];
+		for (int r = 0; r < 3; r++) {
+			lo[r] = _mm_set1_ps(FLT_MAX);
+			hi[r] = _mm_set1_ps(-FLT_MAX);
+		}
+		// 12 values cover the x, y, z pattern of four atoms
+		for (; i + 12 <= count; i += 12) {
+			for (int r = 0; r < 3; r++) {
+				const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + (i + r * 4) * 4));
+				const __m128 f = _mm_castsi128_ps(swapBytes(v));
+				_mm_storeu_ps(dst + i + r * 4, f);
+				lo[r] = _mm_min_ps(lo[r], f);
+				hi[r] = _mm_max_ps(hi[r], f);
+			}
+		}
+		foldBounds(lo, hi, min, max);
+	}
+#endif
+
+	for (; i < count; i++) {
+		quint32 bits = qFromBigEndian<quint32>(in + i * 4);
+		std::memcpy(dst + i, &bits, sizeof(float));
+		min[i % 3] = std::min(min[i % 3], dst[i]);
+		max[i % 3] = std::max(max[i % 3], dst[i]);
+	}
+}
+
+void SimdKernels::interleaveXYZ(const float *x, const float *y, const float *z, size_t count, float *dst)
+{
+	size_t i = 0;
+
+#ifdef USE_SSE2
+	for (; i + 4 <= count; i += 4) {
+		interleave4(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i), _mm_loadu_ps(z + i), dst + i * 3);
+	}
+#endif
+
+	for (; i < count; i++) {
+		dst[i * 3] = x[i];
+		dst[i * 3 + 1] = y[i];
+		dst[i * 3 + 2] = z[i];
+	}
+}
+
+void SimdKernels::interleaveXYZ(const float *x, const float *y, const float *z, size_t count, float *dst,
+	float min[3], float max[3])
+{
+	size_t i = 0;
+
+#ifdef USE_SSE2
+	if (count >= 4) {
+		// one register per axis before interleaving
+		__m128 lo[3], hi[3];
+		for (int k = 0; k < 3; k++) {
+			lo[k] = _mm_set1_ps(FLT_MAX);
+			hi[k] = _mm_set1_ps(-FLT_MAX);
+		}
+		for (; i + 4 <= count; i += 4) {
+			const __m128 v[3] = { _mm_loadu_ps(x + i), _mm_loadu_ps(y + i), _mm_loadu_ps(z + i) };
+			for (int k = 0; k < 3; k++) {
+				lo[k] = _mm_min_ps(lo[k], v[k]);
+				hi[k] = _mm_max_ps(hi[k], v[k]);
+			}
+			interleave4(v[0], v[1], v[2], dst + i * 3);
+		}
+
+		float l[4], h[4];
+		for (int k = 0; k < 3; k++) {
+			_mm_storeu_ps(l, lo[k]);
+			_mm_storeu_ps(h, hi[k]);
+			for (int j = 0; j < 4; j++) {
+				min[k] = std::min(min[k], l[j]);
+				max[k] = std::max(max[k], h[j]);
+			}
+		}
+	}
+#endif
+
+	for (; i < count; i++) {
+		dst[i * 3] = x[i];
+		dst[i * 3 + 1] = y[i];
+		dst[i * 3 + 2] = z[i];
+		min[0] = std::min(min[0], x[i]);
+		min[1] = std::min(min[1], y[i]);
+		min[2] = std::min(min[2], z[i]);
+		max[0] = std::max(max[0], x[i]);
+		max[1] = std::max(max[1], y[i]);
+		max[2] = std::max(max[2], z[i]);
+	}
+}
+
+void SimdKernels::quantize(const float *src, size_t count, const float origin[3], float scale, int32_t *dst)
+{
+	size_t i = 0;
+
+#ifdef USE_SSE2
+	// three registers cover the x, y, z pattern of four consecutive coordinates
+	const __m128 o0 = _mm_setr_ps(origin[0], origin[1], origin[2], origin[0]);
+	const __m128 o1 = _mm_setr_ps(origin[1], origin[2], origin[0], origin[1]);
+	const __m128 o2 = _mm_setr_ps(origin[2], origin[0], origin[1], origin[2]);
+	const __m128 s = _mm_set1_ps(scale);
+	for (; i + 12 <= count; i += 12) {
+		__m128 a = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(src + i), o0), s);
+		__m128 b = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(src + i + 4), o1), s);
+		__m128 c = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(src + i + 8), o2), s);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_cvtps_epi32(a));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 4), _mm_cvtps_epi32(b));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 8), _mm_cvtps_epi32(c));
+	}
+#endif
+
+	// lrintf rounds like _mm_cvtps_epi32 (to nearest even)
+	for (; i < count; i++) {
+		dst[i] = int32_t(lrintf((src[i] - origin[i % 3]) * scale));
+	}
+}
+
+void SimdKernels::quantize16(const float *src, size_t count, const float origin[3], float scale, int16_t *dst)
+{
+	size_t i = 0;
+
+#ifdef USE_SSE2
+	const __m128 o0 = _mm_setr_ps(origin[0], origin[1], origin[2], origin[0]);
+	const __m128 o1 = _mm_setr_ps(origin[1], origin[2], origin[0], origin[1]);
+	const __m128 o2 = _mm_setr_ps(origin[2], origin[0], origin[1], origin[2]);
+	const __m128 s = _mm_set1_ps(scale);
+	for (; i + 12 <= count; i += 12) {
+		__m128 a = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(src + i), o0), s);
+		__m128 b = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(src + i + 4), o1), s);
+		__m128 c = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(src + i + 8), o2), s);
+		const __m128i cc = _mm_cvtps_epi32(c);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i + 8), _mm_packs_epi32(cc, cc));
+	}
+#endif
+
+	for (; i < count; i++) {
+		const long value = lrintf((src[i] - origin[i % 3]) * scale);
+		dst[i] = int16_t(std::min(std::max(value, -32768L), 32767L));
+	}
+}
+
+void SimdKernels::dequantize(const int32_t *src, size_t count, const float origin[3], float step, float *dst)
+{
+	size_t i = 0;
+
+#ifdef USE_SSE2
+	const __m128 o0 = _mm_setr_ps(origin[0], origin[1], origin[2], origin[0]);
+	const __m128 o1 = _mm_setr_ps(origin[1], origin[2], origin[0], origin[1]);
+	const __m128 o2 = _mm_setr_ps(origin[2], origin[0], origin[1], origin[2]);
+	const __m128 s = _mm_set1_ps(step);
+	for (; i + 12 <= count; i += 12) {
+		__m128 a = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+		__m128 b = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 4)));
+		__m128 c = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 8)));
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_mul_ps(a, s), o0));
+		_mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_mul_ps(b, s), o1));
+		_mm_storeu_ps(dst + i + 8, _mm_add_ps(_mm_mul_ps(c, s), o2));
+	}
+#endif
+
+	for (; i < count; i++) {
+		dst[i] = float(src[i]) * step + origin[i % 3];
+	}
+}
+
+void SimdKernels::bounds(const float *src, size_t nrAtoms, float min[3], float max[3])
+{
+	size_t i = 0;
+
+#ifdef USE_SSE2
+	if (nrAtoms >= 4) {
+		// three registers cover the x, y, z pattern of four atoms
+		__m128 lo[3] = { _mm_loadu_ps(src), _mm_loadu_ps(src + 4), _mm_loadu_ps(src + 8) };
+		__m128 hi[3] = { lo[0], lo[1], lo[2] };
+		for (i = 4; i + 4 <= nrAtoms; i += 4) {
+			const float *p = src + i * 3;
+			for (int r = 0; r < 3; r++) {
+				const __m128 v = _mm_loadu_ps(p + r * 4);
+				lo[r] = _mm_min_ps(lo[r], v);
+				hi[r] = _mm_max_ps(hi[r], v);
+			}
+		}
+		foldBounds(lo, hi, min, max);
+	}
+#endif
+
+	for (; i < nrAtoms; i++) {
+		for (int k = 0; k < 3; k++) {
+			min[k] = std::min(min[k], src[i * 3 + k]);
+			max[k] = std::max(max[k], src[i * 3 + k]);
+		}
+	}
+}
+
+#ifdef USE_SSE2
+static inline __m128i addOrSub(__m128i values, __m128i deltas, bool subtract)
+{
+	return subtract ? _mm_sub_epi32(values, deltas) : _mm_add_epi32(values, deltas);
+}
+
+static inline void applyDeltas(int32_t *values, __m128i deltas, bool subtract)
+{
+	__m128i *dst = reinterpret_cast<__m128i *>(values);
+	_mm_storeu_si128(dst, addOrSub(_mm_loadu_si128(dst), deltas, subtract));
+}
+#endif
+
+void SimdKernels::addDeltas(const void *deltas, int width, size_t count, int32_t *values, bool subtract)
+{
+	const int sign = subtract ? -1 : 1;
+	size_t i = 0;
+
+	if (width == 1) {
+		const int8_t *d = static_cast<const int8_t *>(deltas);
+#ifdef USE_SSE2
+		// sign extension: duplicate each byte into all four bytes of a lane, then shift right arithmetically
+		for (; i + 16 <= count; i += 16) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(d + i));
+			__m128i lo = _mm_unpacklo_epi8(v, v);
+			__m128i hi = _mm_unpackhi_epi8(v, v);
+			applyDeltas(values + i, _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 24), subtract);
+			applyDeltas(values + i + 4, _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 24), subtract);
+			applyDeltas(values + i + 8, _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 24), subtract);
+			applyDeltas(values + i + 12, _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 24), subtract);
+		}
+#endif
+		for (; i < count; i++) {
+			values[i] += sign * int32_t(d[i]);
+		}
+	}
+	else if (width == 2) {
+		const unsigned char *d = static_cast<const unsigned char *>(deltas);
+#ifdef USE_SSE2
+		for (; i + 8 <= count; i += 8) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(d + i * 2));
+			applyDeltas(values + i, _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16), subtract);
+			applyDeltas(values + i + 4, _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16), subtract);
+		}
+#endif
+		for (; i < count; i++) {
+			int16_t delta;
+			std::memcpy(&delta, d + i * 2, sizeof(delta));
+			values[i] += sign * int32_t(delta);
+		}
+	}
+	else {
+		const unsigned char *d = static_cast<const unsigned char *>(deltas);
+#ifdef USE_SSE2
+		for (; i + 4 <= count; i += 4) {
+			applyDeltas(values + i, _mm_loadu_si128(reinterpret_cast<const __m128i *>(d + i * 4)), subtract);
+		}
+#endif
+		for (; i < count; i++) {
+			int32_t delta;
+			std::memcpy(&delta, d + i * 4, sizeof(delta));
+			values[i] += sign * delta;
+		}
+	}
+}
+
+#ifdef USE_SSE2
+namespace
+{
+	inline int firstBit(unsigned mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return int(index);
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	// bit i set if byte i of v is a blank (unsigned v <= ' ')
+	inline unsigned blankMask(__m128i v)
+	{
+		const __m128i space = _mm_set1_epi8(' ');
+		return unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, space), v)));
+	}
+}
+#endif
+
+const char *SimdKernels::skipBlanks(const char *p, const char *end)
+{
+#ifdef USE_SSE2
+	for (; end - p >= 16; p += 16) {
+		const unsigned mask = ~blankMask(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))) & 0xFFFF;
+		if (mask != 0) {
+			return p + firstBit(mask);
+		}
+	}
+#endif
+
+	while (p < end && static_cast<unsigned char>(*p) <= ' ') {
+		p++;
+	}
+	return p;
+}
+
+const char *SimdKernels::findBlank(const char *p, const char *end)
+{
+#ifdef USE_SSE2
+	for (; end - p >= 16; p += 16) {
+		const unsigned mask = blankMask(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+		if (mask != 0) {
+			return p + firstBit(mask);
+		}
+	}
+#endif
+
+	while (p < end && static_cast<unsigned char>(*p) > ' ') {
+		p++;
+	}
+	return p;
+}
+
+void SimdKernels::toInt32(const void *src, int width, bool isUnsigned, size_t count, int32_t *dst)
+{
+	const unsigned char *in = static_cast<const unsigned char *>(src);
+	size_t i = 0;
+
+	if (width == 1) {
+#ifdef USE_SSE2
+		// signed bytes are duplicated into all four bytes of a lane and shifted arithmetically,
+		// unsigned bytes are interleaved with zeros
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 16 <= count; i += 16) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+			__m128i *out = reinterpret_cast<__m128i *>(dst + i);
+			if (isUnsigned) {
+				const __m128i lo = _mm_unpacklo_epi8(v, zero);
+				const __m128i hi = _mm_unpackhi_epi8(v, zero);
+				_mm_storeu_si128(out, _mm_unpacklo_epi16(lo, zero));
+				_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo, zero));
+				_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi, zero));
+				_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi, zero));
+			}
+			else {
+				const __m128i lo = _mm_unpacklo_epi8(v, v);
+				const __m128i hi = _mm_unpackhi_epi8(v, v);
+				_mm_storeu_si128(out, _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 24));
+				_mm_storeu_si128(out + 1, _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 24));
+				_mm_storeu_si128(out + 2, _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 24));
+				_mm_storeu_si128(out + 3, _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 24));
+			}
+		}
+#endif
+		for (; i < count; i++) {
+			dst[i] = isUnsigned ? int32_t(in[i]) : int32_t(int8_t(in[i]));
+		}
+	}
+	else if (width == 2) {
+#ifdef USE_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 8 <= count; i += 8) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i * 2));
+			__m128i *out = reinterpret_cast<__m128i *>(dst + i);
+			if (isUnsigned) {
+				_mm_storeu_si128(out, _mm_unpacklo_epi16(v, zero));
+				_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(v, zero));
+			}
+			else {
+				_mm_storeu_si128(out, _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+				_mm_storeu_si128(out + 1, _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+			}
+		}
+#endif
+		for (; i < count; i++) {
+			const quint16 value = qFromLittleEndian<quint16>(in + i * 2);
+			dst[i] = isUnsigned ? int32_t(value) : int32_t(qint16(value));
+		}
+	}
+	else {
+		for (; i < count; i++) {
+			dst[i] = int32_t(qFromLittleEndian<quint32>(in + i * 4));
+		}
+	}
+}
+
+void SimdKernels::prefixSum(int32_t *values, size_t count, int32_t origin)
+{
+	size_t i = 0;
+	quint32 sum = quint32(origin);
+
+#ifdef USE_SSE2
+	// log-step scan within four lanes, then the sum of the previous lanes is added
+	__m128i carry = _mm_set1_epi32(origin);
+	for (; i + 4 <= count; i += 4) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+		v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+		v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+		v = _mm_add_epi32(v, carry);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(values + i), v);
+		carry = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3));
+	}
+	if (i > 0) {
+		sum = quint32(values[i - 1]);
+	}
+#endif
+
+	// unsigned arithmetic wraps like the vector lanes
+	for (; i < count; i++) {
+		sum += quint32(values[i]);
+		values[i] = int32_t(sum);
+	}
+}
+
+void SimdKernels::fixedToFloat(const int32_t *src, size_t count, float divisor, float *dst)
+{
+	size_t i = 0;
+
+#ifdef USE_SSE2
+	// a division (not a multiplication by the reciprocal) rounds like the text parsers
+	const __m128 d = _mm_set1_ps(divisor);
+	for (; i + 4 <= count; i += 4) {
+		const __m128 v = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+		_mm_storeu_ps(dst + i, _mm_div_ps(v, d));
+	}
+#endif
+
+	for (; i < count; i++) {
+		dst[i] = float(src[i]) / divisor;
+	}
+}
+
+size_t SimdKernels::expandRuns(const int32_t *runs, size_t nrRuns, int32_t *dst, size_t size)
+{
+	size_t n = 0;
+	for (size_t r = 0; r < nrRuns && n < size; r++) {
+		const int32_t value = runs[r * 2];
+		const size_t end = n + std::min(size_t(std::max(runs[r * 2 + 1], 0)), size - n);
+
+#ifdef USE_SSE2
+		const __m128i v = _mm_set1_epi32(value);
+		for (; n + 4 <= end; n += 4) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + n), v);
+		}
+#endif
+		for (; n < end; n++) {
+			dst[n] = value;
+		}
+	}
+	return n;
+}
+
+size_t SimdKernels::unpackIntegers(const int32_t *packed, size_t count, int32_t upper, int32_t lower, int32_t *dst,
+	size_t size)
+{
+	size_t i = 0;
+	size_t n = 0;
+
+#ifdef USE_SSE2
+	// blocks of four values without limit values are copied
+	const __m128i vUpper = _mm_set1_epi32(upper);
+	const __m128i vLower = _mm_set1_epi32(lower);
+#endif
+
+	while (i < count && n < size) {
+#ifdef USE_SSE2
+		if (i + 4 <= count && n + 4 <= size) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(packed + i));
+			const __m128i limits = _mm_or_si128(_mm_cmpeq_epi32(v, vUpper), _mm_cmpeq_epi32(v, vLower));
+			if (_mm_movemask_epi8(limits) == 0) {
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + n), v);
+				i += 4;
+				n += 4;
+				continue;
+			}
+		}
+#endif
+		int32_t value = 0;
+		while ((packed[i] == upper || packed[i] == lower) && i + 1 < count) {
+			value += packed[i++];
+		}
+		dst[n++] = value + packed[i++];
+	}
+	return n;
+}
@@ -0,0 +1,75 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Vectorized (SSE2) conversion kernels used by the loaders,
+// every kernel has a scalar fallback for other platforms.
+class SimdKernels
+{
+public:
+
+	// converts count big-endian IEEE floats (e.g. NetCDF classic data) to native floats
+	static void bigEndianToFloat(const void *src, float *dst, size_t count);
+
+	// as above for x, y, z triples (count values starting with x), also extends min and max by them
+	// (frame bounds reduced while converting, see bounds)
+	static void bigEndianToFloat(const void *src, float *dst, size_t count, float min[3], float max[3]);
+
+	// interleaves separate x, y and z arrays of count atoms (e.g. DCD frames) into x, y, z triples
+	static void interleaveXYZ(const float *x, const float *y, const float *z, size_t count, float *dst);
+
+	// as above, also extends min and max by the atoms
+	static void interleaveXYZ(const float *x, const float *y, const float *z, size_t count, float *dst,
+		float min[3], float max[3]);
+
+	// QUANTIZATION of interleaved x, y, z coordinates (count values starting with x)
+
+	// dst = round((src - origin) * scale)
+	static void quantize(const float *src, size_t count, const float origin[3], float scale, int32_t *dst);
+
+	// as quantize, saturated to 16 bits (e.g. normalized vertex attributes)
+	static void quantize16(const float *src, size_t count, const float origin[3], float scale, int16_t *dst);
+
+	// dst = origin + src * step
+	static void dequantize(const int32_t *src, size_t count, const float origin[3], float step, float *dst);
+
+	// extends min and max, initialized by the caller, by the nrAtoms x, y, z triples of src
+	// (bounding boxes, the origin of quantization)
+	static void bounds(const float *src, size_t nrAtoms, float min[3], float max[3]);
+
+	// values += deltas (or -= if subtract), deltas are count signed integers of 1, 2 or 4 bytes
+	static void addDeltas(const void *deltas, int width, size_t count, int32_t *values, bool subtract = false);
+
+	// COLUMN decoding of binary structure files (BinaryCIF), all data little-endian
+
+	// widens count integers of 1, 2 or 4 bytes
+	static void toInt32(const void *src, int width, bool isUnsigned, size_t count, int32_t *dst);
+
+	// inclusive prefix sum: values[i] = origin + values[0] + ... + values[i] (delta decoding)
+	static void prefixSum(int32_t *values, size_t count, int32_t origin);
+
+	// dst = src / divisor (fixed point decoding)
+	static void fixedToFloat(const int32_t *src, size_t count, float divisor, float *dst);
+
+	// integer unpacking: a value beyond [lower, upper] is stored as a run of upper (or lower) values
+	// followed by the remainder, the sum is written to dst of at most size values, returns the values written
+	static size_t unpackIntegers(const int32_t *packed, size_t count, int32_t upper, int32_t lower, int32_t *dst, size_t size);
+
+	// expands nrRuns (value, length) pairs into dst of at most size values, returns the values written
+	static size_t expandRuns(const int32_t *runs, size_t nrRuns, int32_t *dst, size_t size);
+
+	// TEXT scanning of whitespace separated tokens, bytes up to ' ' (blank, tab, CR, LF) are blanks
+
+	// first byte of [p, end) that is not a blank, or end
+	static const char *skipBlanks(const char *p, const char *end);
+
+	// first blank of [p, end), or end
+	static const char *findBlank(const char *p, const char *end);
+};
@@ -0,0 +1,72 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// push() may only be called by the producer, peek() and pop() only by the consumer.
+template <typename T>
+class SpscQueue
+{
+public:
+
+	explicit SpscQueue(size_t capacity)
+		: m_buffer(capacity + 1), m_head(0), m_tail(0)
+	{
+	}
+
+	bool push(const T &value)
+	{
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		size_t next = increment(tail);
+		if (next == m_head.load(std::memory_order_acquire)) {
+			return false; // full
+		}
+		m_buffer[tail] = value;
+		m_tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	bool peek(T &value) const
+	{
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire)) {
+			return false; // empty
+		}
+		value = m_buffer[head];
+		return true;
+	}
+
+	bool pop(T &value)
+	{
+		if (!peek(value)) {
+			return false;
+		}
+		m_head.store(increment(m_head.load(std::memory_order_relaxed)), std::memory_order_release);
+		return true;
+	}
+
+	bool isEmpty() const
+	{
+		return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+	}
+
+private:
+
+	inline size_t increment(size_t index) const
+	{
+		return index + 1 == m_buffer.size() ? 0 : index + 1;
+	}
+
+	std::vector<T> m_buffer;
+
+	// head and tail on separate cache lines, they are written by different threads
+	alignas(64) std::atomic<size_t> m_head;
+	alignas(64) std::atomic<size_t> m_tail;
+};
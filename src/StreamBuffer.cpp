@@ -0,0 +1,150 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "StreamBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+namespace
+{
+	// glBufferStorage is not part of QOpenGLExtraFunctions, it is resolved from the context
+	typedef void (QOPENGLF_APIENTRYP BufferStorage)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+	const GLuint64 WAIT_NS = 1000000;
+
+	// regions start at aligned offsets whatever the size of a frame (e.g. 6 bytes per atom)
+	const size_t REGION_ALIGNMENT = 256;
+}
+
+StreamBuffer::StreamBuffer()
+	: m_buffer(QOpenGLBuffer::VertexBuffer), m_mapped(nullptr), m_regionBytes(0), m_region(0), m_stalls(0)
+{
+}
+
+bool StreamBuffer::create(size_t regionBytes, size_t nrRegions)
+{
+	destroy();
+	if (regionBytes == 0 || !m_buffer.create()) {
+		return false;
+	}
+	m_regionBytes = (regionBytes + REGION_ALIGNMENT - 1) / REGION_ALIGNMENT * REGION_ALIGNMENT;
+	m_region = 0;
+	m_stalls = 0;
+
+	QOpenGLContext *context = QOpenGLContext::currentContext();
+	BufferStorage bufferStorage = nullptr;
+	if (!context->isOpenGLES() && (context->format().version() >= qMakePair(4, 4) || context->hasExtension("GL_ARB_buffer_storage"))) {
+		bufferStorage = reinterpret_cast<BufferStorage>(context->getProcAddress("glBufferStorage"));
+	}
+
+	m_buffer.bind();
+	if (bufferStorage) {
+		const GLsizeiptr bytes = GLsizeiptr(m_regionBytes * std::max(nrRegions, size_t(1)));
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		bufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+		m_mapped = static_cast<char *>(context->extraFunctions()->glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags));
+		if (m_mapped) {
+			m_fences.assign(std::max(nrRegions, size_t(1)), nullptr);
+		}
+		else {
+			// the storage is immutable, the fallback needs a new buffer
+			m_buffer.release();
+			m_buffer.destroy();
+			m_buffer.create();
+			m_buffer.bind();
+		}
+	}
+	if (!m_mapped) {
+		m_buffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+		m_buffer.allocate(int(m_regionBytes));
+		m_fences.assign(1, nullptr);
+	}
+	m_buffer.release();
+	return true;
+}
+
+void StreamBuffer::destroy()
+{
+	if (!m_buffer.isCreated()) {
+		return;
+	}
+
+	QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
+	for (size_t i = 0; i < m_fences.size(); i++) {
+		if (m_fences[i]) {
+			f->glDeleteSync(m_fences[i]);
+		}
+	}
+	m_fences.clear();
+
+	if (m_mapped) {
+		m_buffer.bind();
+		f->glUnmapBuffer(GL_ARRAY_BUFFER);
+		m_buffer.release();
+		m_mapped = nullptr;
+	}
+	m_buffer.destroy();
+	m_regionBytes = 0;
+}
+
+size_t StreamBuffer::write(const void *data, size_t bytes)
+{
+	bytes = std::min(bytes, m_regionBytes);
+
+	if (!m_mapped) {
+		// orphaning, the driver hands out new storage while the GPU still reads the old one
+		m_buffer.bind();
+		m_buffer.allocate(int(m_regionBytes));
+		m_buffer.write(0, data, int(bytes));
+		m_buffer.release();
+		return 0;
+	}
+
+	// the region written three frames ago is usually no longer read by the GPU
+	m_region = (m_region + 1) % m_fences.size();
+	GLsync &fence = m_fences[m_region];
+	if (fence) {
+		QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
+		GLenum result = f->glClientWaitSync(fence, 0, 0);
+		if (result == GL_TIMEOUT_EXPIRED) {
+			m_stalls++;
+			do {
+				result = f->glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_NS);
+			} while (result == GL_TIMEOUT_EXPIRED);
+		}
+		f->glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	// the mapping is coherent, the copy is visible to the commands issued after it
+	std::memcpy(m_mapped + m_region * m_regionBytes, data, bytes);
+	return m_region * m_regionBytes;
+}
+
+void StreamBuffer::fence()
+{
+	if (!m_mapped) {
+		return;
+	}
+
+	// a region may be drawn several times, the last fence covers the earlier draws
+	QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
+	GLsync &fence = m_fences[m_region];
+	if (fence) {
+		f->glDeleteSync(fence);
+	}
+	fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
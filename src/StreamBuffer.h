@@ -0,0 +1,54 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <vector>
+#include <QOpenGLBuffer>
+
+// Vertex buffer for data that is rewritten every frame, e.g. the atom positions of an animation.
+// With GL_ARB_buffer_storage (core in OpenGL 4.4) the buffer is a ring of regions that is mapped
+// once, persistently: a frame is copied into the next region after the fence behind the last draw
+// from that region has passed, so the driver neither reallocates nor synchronizes. Otherwise the
+// storage is orphaned before each write and the driver renames it instead of stalling.
+// All functions require the current context.
+class StreamBuffer
+{
+public:
+
+	StreamBuffer();
+
+	// storage for frames of regionBytes, nrRegions of them if persistent mapping is supported
+	bool create(size_t regionBytes, size_t nrRegions = 3);
+	void destroy();
+
+	// copies a frame of at most regionBytes into the next region and returns its byte offset
+	// in the buffer, e.g. for glVertexAttribPointer
+	size_t write(const void *data, size_t bytes);
+
+	// marks the region of the last write as used by the commands issued so far, call after each draw
+	void fence();
+
+	bool bind() { return m_buffer.bind(); }
+	void release() { m_buffer.release(); }
+
+	bool isCreated() const { return m_buffer.isCreated(); }
+	GLuint bufferId() const { return m_buffer.bufferId(); }
+	bool isPersistent() const { return m_mapped != nullptr; }
+	size_t size() const { return m_regionBytes * m_fences.size(); }
+
+	// writes that had to wait for the GPU to release their region
+	size_t stalls() const { return m_stalls; }
+
+private:
+
+	QOpenGLBuffer m_buffer;
+	char *m_mapped; // persistent mapping of all regions
+	size_t m_regionBytes;
+	std::vector<GLsync> m_fences; // last draw from each region
+	size_t m_region; // region of the last write
+	size_t m_stalls;
+};
@@ -0,0 +1,131 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "StringPool.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	const size_t BLOCK_BYTES = 64 * 1024;
+	const size_t MIN_SLOTS = 64;
+}
+
+StringPool::StringPool()
+	: m_blockUsed(0), m_blockSize(0), m_arenaBytes(0)
+{
+	rehash(MIN_SLOTS);
+}
+
+StringPool::~StringPool()
+{
+}
+
+void StringPool::clear()
+{
+	m_blocks.clear();
+	m_blockUsed = 0;
+	m_blockSize = 0;
+	m_arenaBytes = 0;
+	m_entries.clear();
+	rehash(MIN_SLOTS);
+}
+
+quint32 StringPool::hash(const char *text, int length)
+{
+	// FNV-1a
+	quint32 h = 2166136261u;
+	for (int i = 0; i < length; i++) {
+		h = (h ^ quint8(text[i])) * 16777619u;
+	}
+	return h;
+}
+
+int StringPool::findSlot(const char *text, int length, quint32 hash) const
+{
+	const size_t mask = m_slots.size() - 1;
+	for (size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+		const int id = m_slots[slot];
+		if (id < 0) {
+			return int(slot);
+		}
+		const Entry &entry = m_entries[id];
+		if (entry.hash == hash && entry.length == quint32(length) && std::memcmp(entry.text, text, length) == 0) {
+			return int(slot);
+		}
+	}
+}
+
+int StringPool::find(const char *text, int length) const
+{
+	return m_slots[findSlot(text, length, hash(text, length))];
+}
+
+int StringPool::intern(const char *text, int length)
+{
+	const quint32 h = hash(text, length);
+	const int slot = findSlot(text, length, h);
+	if (m_slots[slot] >= 0) {
+		return m_slots[slot];
+	}
+
+	char *copy = allocate(size_t(length) + 1);
+	std::memcpy(copy, text, length);
+	copy[length] = '\0';
+
+	Entry entry;
+	entry.text = copy;
+	entry.length = quint32(length);
+	entry.hash = h;
+	m_entries.push_back(entry);
+
+	const int id = int(m_entries.size() - 1);
+	m_slots[slot] = id;
+
+	// keep the table at most half full
+	if (m_entries.size() * 2 > m_slots.size()) {
+		rehash(m_slots.size() * 2);
+	}
+	return id;
+}
+
+QString StringPool::string(int id) const
+{
+	return QString::fromLatin1(m_entries[id].text, int(m_entries[id].length));
+}
+
+size_t StringPool::memoryUsage() const
+{
+	return m_arenaBytes + m_entries.capacity() * sizeof(Entry) + m_slots.capacity() * sizeof(int);
+}
+
+char *StringPool::allocate(size_t bytes)
+{
+	if (m_blocks.empty() || m_blockUsed + bytes > m_blockSize) {
+		// strings longer than a block get a block of their own
+		m_blockSize = std::max(BLOCK_BYTES, bytes);
+		m_blocks.push_back(std::unique_ptr<char[]>(new char[m_blockSize]));
+		m_blockUsed = 0;
+		m_arenaBytes += m_blockSize;
+	}
+	char *p = m_blocks.back().get() + m_blockUsed;
+	m_blockUsed += bytes;
+	return p;
+}
+
+void StringPool::rehash(size_t nrSlots)
+{
+	m_slots.assign(nrSlots, -1);
+	const size_t mask = nrSlots - 1;
+	for (size_t id = 0; id < m_entries.size(); id++) {
+		size_t slot = m_entries[id].hash & mask;
+		while (m_slots[slot] >= 0) {
+			slot = (slot + 1) & mask;
+		}
+		m_slots[slot] = int(id);
+	}
+}
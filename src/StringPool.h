@@ -0,0 +1,67 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <QString>
+
+// Interned strings: every distinct string is stored once in large arena blocks and referred to
+// by a small integer id (0, 1, 2, ... in order of interning). Interning a known string neither
+// allocates nor copies, strings are only converted to QString for display.
+class StringPool
+{
+public:
+
+	StringPool();
+	~StringPool();
+
+	void clear();
+
+	// id of the string, added if it is new
+	int intern(const char *text, int length);
+
+	// id of the string, -1 if it is not in the pool
+	int find(const char *text, int length) const;
+
+	int size() const { return int(m_entries.size()); }
+
+	// NUL terminated, valid as long as the pool
+	const char *text(int id) const { return m_entries[id].text; }
+	int length(int id) const { return int(m_entries[id].length); }
+
+	QString string(int id) const;
+
+	// bytes of arena blocks and tables
+	size_t memoryUsage() const;
+
+private:
+
+	StringPool(const StringPool &);
+	StringPool &operator=(const StringPool &);
+
+	struct Entry
+	{
+		const char *text;
+		quint32 length;
+		quint32 hash;
+	};
+
+	static quint32 hash(const char *text, int length);
+
+	int findSlot(const char *text, int length, quint32 hash) const;
+	char *allocate(size_t bytes);
+	void rehash(size_t nrSlots);
+
+	std::vector<std::unique_ptr<char[]> > m_blocks;
+	size_t m_blockUsed; // bytes used of the last block
+	size_t m_blockSize;
+	size_t m_arenaBytes;
+
+	std::vector<Entry> m_entries;
+	std::vector<int> m_slots; // open addressing, power of two size, -1 for empty slots
+};
@@ -0,0 +1,141 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "Trajectory.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <QtConcurrent>
+
+#include "SimdKernels.h"
+
+namespace
+{
+	// frames of very large systems are reduced in parallel, in chunks of CHUNK_ATOMS
+	const size_t PARALLEL_ATOMS = size_t(1) << 20;
+	const size_t CHUNK_ATOMS = size_t(1) << 18;
+}
+
+Trajectory::Trajectory()
+	: m_nrFrames(0), m_nrAtoms(0), m_loadedFrames(0)
+{
+}
+
+Trajectory::~Trajectory()
+{
+}
+
+void Trajectory::clear()
+{
+	m_nrFrames = 0;
+	m_nrAtoms = 0;
+	m_loadedFrames = 0;
+	m_source.reset();
+
+	// release the memory, clear() alone keeps the capacity
+	std::vector<float>().swap(m_positions);
+	std::vector<float>().swap(radii);
+	std::vector<glm::vec3>().swap(colors);
+	std::vector<int>().swap(symbolIds);
+	std::vector<int>().swap(residueIds);
+	std::vector<int>().swap(residueIndices);
+	std::vector<int>().swap(chainIds);
+	std::vector<Bounds>().swap(frameBounds);
+	std::vector<glm::mat4>().swap(instances);
+}
+
+void Trajectory::resize(size_t nrFrames, size_t nrAtoms)
+{
+	clear();
+
+	m_nrFrames = nrFrames;
+	m_nrAtoms = nrAtoms;
+	m_loadedFrames = nrFrames;
+	m_positions.resize(nrFrames * nrAtoms * 3);
+
+	radii.resize(nrAtoms, 0.0f);
+	colors.resize(nrAtoms, glm::vec3(0.0f));
+	symbolIds.resize(nrAtoms, 0);
+	residueIds.resize(nrAtoms, -1);
+	residueIndices.resize(nrAtoms, -1);
+	chainIds.resize(nrAtoms, 0);
+}
+
+void Trajectory::stream(FrameSource *source)
+{
+	resize(0, source->nrAtoms());
+
+	m_nrFrames = source->nrFrames();
+	m_loadedFrames = m_nrFrames;
+	m_source.reset(source);
+}
+
+size_t Trajectory::memoryUsage() const
+{
+	return m_positions.capacity() * sizeof(float)
+		+ radii.capacity() * sizeof(float)
+		+ colors.capacity() * sizeof(glm::vec3)
+		+ (symbolIds.capacity() + residueIds.capacity() + residueIndices.capacity() + chainIds.capacity()) * sizeof(int)
+		+ frameBounds.capacity() * sizeof(Bounds)
+		+ instances.capacity() * sizeof(glm::mat4);
+}
+
+Trajectory::Bounds Trajectory::emptyBounds()
+{
+	Bounds bounds;
+	bounds.min = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	bounds.max = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	return bounds;
+}
+
+Trajectory::Bounds Trajectory::computeBounds(const float *positions, size_t nrAtoms)
+{
+	Bounds bounds = emptyBounds();
+	if (nrAtoms < PARALLEL_ATOMS) {
+		SimdKernels::bounds(positions, nrAtoms, &bounds.min.x, &bounds.max.x);
+		return bounds;
+	}
+
+	std::vector<Bounds> chunks((nrAtoms + CHUNK_ATOMS - 1) / CHUNK_ATOMS, bounds);
+	QtConcurrent::blockingMap(chunks, [&](Bounds &chunk) {
+		const size_t first = size_t(&chunk - &chunks[0]) * CHUNK_ATOMS;
+		SimdKernels::bounds(positions + first * 3, std::min(CHUNK_ATOMS, nrAtoms - first), &chunk.min.x, &chunk.max.x);
+	});
+	for (size_t i = 0; i < chunks.size(); i++) {
+		bounds.min = glm::min(bounds.min, chunks[i].min);
+		bounds.max = glm::max(bounds.max, chunks[i].max);
+	}
+	return bounds;
+}
+
+Trajectory::Bounds Trajectory::transformBounds(const Bounds &bounds, const glm::mat4 &transform)
+{
+	Bounds transformed = emptyBounds();
+
+	for (int i = 0; i < 8; i++) {
+		const glm::vec3 corner((i & 1) ? bounds.max.x : bounds.min.x, (i & 2) ? bounds.max.y : bounds.min.y,
+			(i & 4) ? bounds.max.z : bounds.min.z);
+		const glm::vec3 p(transform * glm::vec4(corner, 1.0f));
+		transformed.min = glm::min(transformed.min, p);
+		transformed.max = glm::max(transformed.max, p);
+	}
+	return transformed;
+}
+
+Trajectory::Bounds Trajectory::instanceBounds(const Bounds &bounds) const
+{
+	if (instances.empty()) {
+		return bounds;
+	}
+
+	Bounds all = transformBounds(bounds, instances[0]);
+	for (size_t i = 1; i < instances.size(); i++) {
+		const Bounds instance = transformBounds(bounds, instances[i]);
+		all.min = glm::min(all.min, instance.min);
+		all.max = glm::max(all.max, instance.max);
+	}
+	return all;
+}
@@ -0,0 +1,102 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "FrameSource.h"
+
+// Atom animation in structure-of-arrays layout: the topology is stored once
+// per atom, the positions of all frames in one contiguous [frames][atoms][3] array.
+// Streamed trajectories keep only the topology in memory and read positions from a FrameSource.
+class Trajectory
+{
+public:
+
+	Trajectory();
+	~Trajectory();
+
+	void clear();
+
+	// allocates topology and positions, previous content is discarded
+	void resize(size_t nrFrames, size_t nrAtoms);
+
+	// allocates the topology only and takes ownership of the source
+	void stream(FrameSource *source);
+
+	bool isStreamed() const { return m_source != nullptr; }
+	FrameSource *source() const { return m_source.get(); }
+
+	size_t nrFrames() const { return m_nrFrames; }
+	size_t nrAtoms() const { return m_nrAtoms; }
+	bool isEmpty() const { return m_nrFrames == 0 || m_nrAtoms == 0; }
+
+	// frames whose positions are available, less than nrFrames while a load is in progress
+	size_t loadedFrames() const { return m_loadedFrames.load(std::memory_order_acquire); }
+	void setLoadedFrames(size_t nrFrames) { m_loadedFrames.store(nrFrames, std::memory_order_release); }
+
+	// nrAtoms * 3 floats (x, y, z) of one frame, only for trajectories that are not streamed
+	inline float *framePositions(size_t frameNr)
+	{
+		return &m_positions[frameNr * m_nrAtoms * 3];
+	}
+	inline const float *framePositions(size_t frameNr) const
+	{
+		return &m_positions[frameNr * m_nrAtoms * 3];
+	}
+
+	inline glm::vec3 position(size_t frameNr, size_t atom) const
+	{
+		const float *p = framePositions(frameNr) + atom * 3;
+		return glm::vec3(p[0], p[1], p[2]);
+	}
+
+	// resident memory in bytes
+	size_t memoryUsage() const;
+
+	typedef FrameBounds Bounds;
+
+	// min at FLT_MAX and max at -FLT_MAX, to be extended (e.g. by SimdKernels::bounds)
+	static Bounds emptyBounds();
+
+	// SIMD reduction, in parallel for very large frames
+	static Bounds computeBounds(const float *positions, size_t nrAtoms);
+
+	// box around the transformed corners of bounds
+	static Bounds transformBounds(const Bounds &bounds, const glm::mat4 &transform);
+
+	// bounds of all instances of atoms within bounds, bounds itself if there are no instances
+	Bounds instanceBounds(const Bounds &bounds) const;
+
+	// per-frame bounding boxes, empty if not known (e.g. for trajectories streamed from disk)
+	std::vector<Bounds> frameBounds;
+
+	// transforms of the copies of a biological assembly (e.g. PDB BIOMT records): the atoms are
+	// stored once and drawn once per instance; empty if they are drawn as they are
+	std::vector<glm::mat4> instances;
+
+	// TOPOLOGY (one entry per atom)
+
+	std::vector<float> radii;
+	std::vector<glm::vec3> colors;
+	std::vector<int> symbolIds;
+	std::vector<int> residueIds;
+	std::vector<int> residueIndices; // residue in file order, -1 for formats without residues
+	std::vector<int> chainIds;
+
+private:
+
+	size_t m_nrFrames;
+	size_t m_nrAtoms;
+	std::atomic<size_t> m_loadedFrames;
+
+	std::vector<float> m_positions;
+	std::unique_ptr<FrameSource> m_source;
+};
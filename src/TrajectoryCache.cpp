@@ -0,0 +1,398 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "TrajectoryCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QSaveFile>
+
+namespace
+{
+	const char MAGIC[8] = { 'S', 'I', 'T', 'R', 'A', 'J', 'C', '\0' };
+	const quint32 VERSION = 1;
+	const quint32 ENDIAN_TAG = 0x01020304;
+
+	const quint64 ALIGNMENT = 64;
+	const quint64 PAGE_BYTES = 4096;
+
+	// bytes of the source hashed at its start and end
+	const qint64 HASH_BYTES = 64 * 1024;
+
+	struct Header
+	{
+		char magic[8];
+		quint32 version;
+		quint32 byteOrder;
+
+		quint64 sourceSize;
+		qint64 sourceModified; // ms since epoch
+		quint64 sourceHash;
+		quint64 selectionHash;
+
+		quint64 nrFrames;
+		quint64 nrAtoms;
+
+		quint64 topologyOffset;
+		quint64 positionsOffset;
+		quint64 boundsOffset;
+		quint64 indexOffset;
+		quint64 fileSize;
+	};
+
+	inline quint64 align(quint64 offset, quint64 alignment)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	// FNV-1a
+	quint64 hashBytes(const void *data, size_t size, quint64 hash = 14695981039346656037ULL)
+	{
+		const uchar *bytes = static_cast<const uchar *>(data);
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ bytes[i]) * 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	// the first and last HASH_BYTES of the source, catches files replaced with the same size and time stamp
+	bool hashSource(const QString &path, quint64 *hash)
+	{
+		QFile file(path);
+		if (!file.open(QIODevice::ReadOnly)) {
+			return false;
+		}
+
+		QByteArray head = file.read(HASH_BYTES);
+		*hash = hashBytes(head.constData(), size_t(head.size()));
+		if (file.size() > HASH_BYTES) {
+			file.seek(std::max(file.size() - HASH_BYTES, HASH_BYTES));
+			QByteArray tail = file.read(HASH_BYTES);
+			*hash = hashBytes(tail.constData(), size_t(tail.size()), *hash);
+		}
+		return true;
+	}
+
+	quint64 hashSelection(const FrameSelection &selection)
+	{
+		const quint64 frames[] = { selection.firstFrame, selection.endFrame, selection.frameStride };
+		quint64 hash = hashBytes(frames, sizeof(frames));
+		for (size_t i = 0; i < selection.atomRanges.size(); i++) {
+			const quint64 range[] = { selection.atomRanges[i].first, selection.atomRanges[i].second };
+			hash = hashBytes(range, sizeof(range), hash);
+		}
+		return hash;
+	}
+
+	// size, modification time, content hash
+	bool describeSource(const QString &path, Header &header)
+	{
+		QFileInfo info(path);
+		header.sourceSize = quint64(info.size());
+		header.sourceModified = info.lastModified().toMSecsSinceEpoch();
+		return hashSource(path, &header.sourceHash);
+	}
+
+	// byte offsets of the topology arrays relative to the topology block
+	struct TopologyLayout
+	{
+		quint64 radii, colors, symbolIds, residueIds, chainIds, size;
+
+		explicit TopologyLayout(quint64 nrAtoms)
+		{
+			radii = 0;
+			colors = align(radii + nrAtoms * sizeof(float), ALIGNMENT);
+			symbolIds = align(colors + nrAtoms * 3 * sizeof(float), ALIGNMENT);
+			residueIds = align(symbolIds + nrAtoms * sizeof(qint32), ALIGNMENT);
+			chainIds = align(residueIds + nrAtoms * sizeof(qint32), ALIGNMENT);
+			size = align(chainIds + nrAtoms * sizeof(qint32), ALIGNMENT);
+		}
+	};
+
+	bool writePadding(QSaveFile &file, quint64 offset)
+	{
+		static const char zeros[PAGE_BYTES] = {};
+		while (quint64(file.pos()) < offset) {
+			qint64 n = qint64(std::min<quint64>(offset - quint64(file.pos()), PAGE_BYTES));
+			if (file.write(zeros, n) != n) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool writeInts(QSaveFile &file, const std::vector<int> &values)
+	{
+		std::vector<qint32> data(values.begin(), values.end());
+		const qint64 bytes = qint64(data.size() * sizeof(qint32));
+		return file.write(reinterpret_cast<const char *>(data.data()), bytes) == bytes;
+	}
+}
+
+TrajectoryCacheSource::TrajectoryCacheSource()
+	: m_data(nullptr), m_size(0), m_nrAtoms(0), m_topologyOffset(0), m_boundsOffset(0)
+{
+}
+
+TrajectoryCacheSource::~TrajectoryCacheSource()
+{
+	close();
+}
+
+bool TrajectoryCacheSource::open(const QString &cachePath, const QString &sourcePath, const FrameSelection &selection)
+{
+	close();
+
+	m_file.setFileName(cachePath);
+	if (!m_file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+
+	m_size = m_file.size();
+	if (m_size < qint64(sizeof(Header))) {
+		close();
+		return false;
+	}
+	m_data = m_file.map(0, m_size);
+	if (!m_data) {
+		qWarning() << "Error mapping cache: " << m_file.errorString();
+		close();
+		return false;
+	}
+
+	Header header;
+	std::memcpy(&header, m_data, sizeof(header));
+	if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.byteOrder != ENDIAN_TAG) {
+		qInfo() << "Ignoring cache of another version: " << cachePath;
+		close();
+		return false;
+	}
+
+	Header source;
+	if (!describeSource(sourcePath, source) ||
+		header.sourceSize != source.sourceSize ||
+		header.sourceModified != source.sourceModified ||
+		header.sourceHash != source.sourceHash ||
+		header.selectionHash != hashSelection(selection)) {
+		qInfo() << "Cache is outdated: " << cachePath;
+		close();
+		return false;
+	}
+
+	// all blocks have to lie inside the file, a truncated cache is rejected
+	const quint64 frameBytes = header.nrAtoms * 3 * sizeof(float);
+	if (header.fileSize != quint64(m_size) ||
+		header.topologyOffset + TopologyLayout(header.nrAtoms).size > header.positionsOffset ||
+		header.boundsOffset + header.nrFrames * sizeof(Trajectory::Bounds) > header.indexOffset ||
+		header.indexOffset + header.nrFrames * sizeof(quint64) > quint64(m_size)) {
+		qWarning() << "Corrupt cache: " << cachePath;
+		close();
+		return false;
+	}
+
+	m_frameOffsets.resize(header.nrFrames);
+	std::memcpy(m_frameOffsets.data(), m_data + header.indexOffset, header.nrFrames * sizeof(quint64));
+	for (size_t f = 0; f < m_frameOffsets.size(); f++) {
+		if (m_frameOffsets[f] < header.positionsOffset || m_frameOffsets[f] + frameBytes > header.boundsOffset) {
+			qWarning() << "Corrupt cache: " << cachePath;
+			close();
+			return false;
+		}
+	}
+
+	m_nrAtoms = size_t(header.nrAtoms);
+	m_topologyOffset = header.topologyOffset;
+	m_boundsOffset = header.boundsOffset;
+	return true;
+}
+
+void TrajectoryCacheSource::close()
+{
+	if (m_data) {
+		m_file.unmap(m_data);
+	}
+	m_file.close();
+	m_data = nullptr;
+	m_size = 0;
+	m_nrAtoms = 0;
+	m_topologyOffset = m_boundsOffset = 0;
+	std::vector<quint64>().swap(m_frameOffsets);
+}
+
+bool TrajectoryCacheSource::readFrame(size_t frameNr, float *dst)
+{
+	if (!isOpen() || frameNr >= m_frameOffsets.size()) {
+		return false;
+	}
+	std::memcpy(dst, frameData(frameNr), m_nrAtoms * 3 * sizeof(float));
+	return true;
+}
+
+void TrajectoryCacheSource::readTopology(Trajectory &trajectory) const
+{
+	const size_t n = m_nrAtoms;
+	const TopologyLayout layout(n);
+	const uchar *topology = m_data + m_topologyOffset;
+
+	std::memcpy(trajectory.radii.data(), topology + layout.radii, n * sizeof(float));
+	std::memcpy(trajectory.colors.data(), topology + layout.colors, n * 3 * sizeof(float));
+
+	const qint32 *symbolIds = reinterpret_cast<const qint32 *>(topology + layout.symbolIds);
+	const qint32 *residueIds = reinterpret_cast<const qint32 *>(topology + layout.residueIds);
+	const qint32 *chainIds = reinterpret_cast<const qint32 *>(topology + layout.chainIds);
+	trajectory.symbolIds.assign(symbolIds, symbolIds + n);
+	trajectory.residueIds.assign(residueIds, residueIds + n);
+	trajectory.chainIds.assign(chainIds, chainIds + n);
+
+	const Trajectory::Bounds *bounds = reinterpret_cast<const Trajectory::Bounds *>(m_data + m_boundsOffset);
+	trajectory.frameBounds.assign(bounds, bounds + m_frameOffsets.size());
+}
+
+QString TrajectoryCache::cachePath(const QString &sourcePath)
+{
+	return sourcePath + ".cache";
+}
+
+bool TrajectoryCache::read(const QString &sourcePath, const FrameSelection &selection, Trajectory &trajectory, size_t memoryBudget)
+{
+	const QString path = cachePath(sourcePath);
+	if (!QFileInfo::exists(path)) {
+		return false;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	std::unique_ptr<TrajectoryCacheSource> cache(new TrajectoryCacheSource());
+	if (!cache->open(path, sourcePath, selection)) {
+		return false;
+	}
+
+	const size_t frames = cache->nrFrames();
+	const size_t atoms = cache->nrAtoms();
+	const size_t frameBytes = atoms * 3 * sizeof(float);
+
+	if (memoryBudget == 0 || frames * frameBytes <= memoryBudget) {
+		trajectory.resize(frames, atoms);
+		for (size_t f = 0; f < frames; f++) {
+			std::memcpy(trajectory.framePositions(f), cache->frameData(f), frameBytes);
+		}
+		cache->readTopology(trajectory);
+	}
+	else {
+		TrajectoryCacheSource *source = cache.release();
+		trajectory.stream(source);
+		source->readTopology(trajectory);
+	}
+
+	qInfo() << "Opened cache" << path << "with" << frames << "frames of" << atoms << "atoms in" << timer.elapsed() << "ms"
+		<< (trajectory.isStreamed() ? "(streamed)" : "");
+	return true;
+}
+
+bool TrajectoryCache::write(const QString &sourcePath, const FrameSelection &selection, const Trajectory &trajectory,
+	LoadProgress *progress)
+{
+	const QString path = cachePath(sourcePath);
+
+	QElapsedTimer timer;
+	timer.start();
+
+	Header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.byteOrder = ENDIAN_TAG;
+	if (!describeSource(sourcePath, header)) {
+		return false;
+	}
+	header.selectionHash = hashSelection(selection);
+
+	const quint64 frames = trajectory.nrFrames();
+	const quint64 atoms = trajectory.nrAtoms();
+	const quint64 frameBytes = atoms * 3 * sizeof(float);
+	const quint64 frameStride = align(frameBytes, ALIGNMENT);
+	const TopologyLayout layout(atoms);
+
+	header.nrFrames = frames;
+	header.nrAtoms = atoms;
+	header.topologyOffset = align(sizeof(Header), ALIGNMENT);
+	header.positionsOffset = align(header.topologyOffset + layout.size, PAGE_BYTES);
+	header.boundsOffset = align(header.positionsOffset + frames * frameStride, ALIGNMENT);
+	header.indexOffset = align(header.boundsOffset + frames * sizeof(Trajectory::Bounds), ALIGNMENT);
+	header.fileSize = header.indexOffset + frames * sizeof(quint64);
+
+	// frame bounds are computed while loading, recompute them if the loader did not
+	std::vector<Trajectory::Bounds> bounds(trajectory.frameBounds);
+	const bool computeBounds = bounds.size() != frames;
+	bounds.resize(frames);
+
+	// written to a temporary file and renamed on commit, a cache is never seen half written
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly)) {
+		qWarning() << "Cannot write cache: " << file.errorString();
+		return false;
+	}
+
+	bool ok = file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == qint64(sizeof(header));
+
+	ok = ok && writePadding(file, header.topologyOffset + layout.radii);
+	ok = ok && file.write(reinterpret_cast<const char *>(trajectory.radii.data()), atoms * sizeof(float)) == qint64(atoms * sizeof(float));
+	ok = ok && writePadding(file, header.topologyOffset + layout.colors);
+	ok = ok && file.write(reinterpret_cast<const char *>(trajectory.colors.data()), atoms * 3 * sizeof(float)) == qint64(atoms * 3 * sizeof(float));
+	ok = ok && writePadding(file, header.topologyOffset + layout.symbolIds) && writeInts(file, trajectory.symbolIds);
+	ok = ok && writePadding(file, header.topologyOffset + layout.residueIds) && writeInts(file, trajectory.residueIds);
+	ok = ok && writePadding(file, header.topologyOffset + layout.chainIds) && writeInts(file, trajectory.chainIds);
+
+	std::vector<float> buffer;
+	std::vector<quint64> index(frames);
+	for (quint64 f = 0; f < frames && ok; f++) {
+		if (progress && progress->canceled) {
+			qInfo() << "Cache writing canceled: " << path;
+			file.cancelWriting();
+			return false;
+		}
+
+		const float *positions;
+		if (trajectory.isStreamed()) {
+			buffer.resize(atoms * 3);
+			ok = trajectory.source()->readFrame(f, buffer.data());
+			positions = buffer.data();
+		}
+		else {
+			positions = trajectory.framePositions(f);
+		}
+		if (computeBounds) {
+			bounds[f] = Trajectory::computeBounds(positions, atoms);
+		}
+
+		index[f] = header.positionsOffset + f * frameStride;
+		ok = ok && writePadding(file, index[f]);
+		ok = ok && file.write(reinterpret_cast<const char *>(positions), frameBytes) == qint64(frameBytes);
+	}
+
+	ok = ok && writePadding(file, header.boundsOffset);
+	ok = ok && file.write(reinterpret_cast<const char *>(bounds.data()), frames * sizeof(Trajectory::Bounds)) == qint64(frames * sizeof(Trajectory::Bounds));
+	ok = ok && writePadding(file, header.indexOffset);
+	ok = ok && file.write(reinterpret_cast<const char *>(index.data()), frames * sizeof(quint64)) == qint64(frames * sizeof(quint64));
+
+	if (!ok) {
+		qWarning() << "Cannot write cache: " << file.errorString();
+		file.cancelWriting();
+		return false;
+	}
+	if (!file.commit()) {
+		qWarning() << "Cannot write cache: " << file.errorString();
+		return false;
+	}
+
+	qInfo() << "Wrote cache" << path << "(" << header.fileSize / (1024 * 1024) << "MB) in" << timer.elapsed() << "ms";
+	return true;
+}
@@ -0,0 +1,87 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <vector>
+#include <QFile>
+#include <QString>
+
+#include "FrameSelection.h"
+#include "FrameSource.h"
+#include "LoadProgress.h"
+#include "Trajectory.h"
+
+// Preprocessed copy of a loaded trajectory, written next to the source file
+// (<source>.cache) in native byte order:
+//
+//   header    magic, version, source size, modification time and content hash,
+//             selection hash, dimensions and the offsets of the blocks below
+//   topology  radii, colors, symbol, residue and chain ids (64 byte aligned arrays)
+//   positions nrFrames * nrAtoms * 3 floats, page aligned, every frame 64 byte aligned
+//   bounds    per-frame bounding boxes
+//   index     file offset of every frame
+//
+// The cache is memory mapped on later loads, so reopening needs no parsing or conversion.
+// It is only used while size, modification time and hash of the source and the selection match.
+class TrajectoryCache
+{
+public:
+
+	static QString cachePath(const QString &sourcePath);
+
+	// opens the cache of sourcePath if it is valid, positions that fit into memoryBudget bytes
+	// are copied into the trajectory, larger trajectories are streamed from the mapping (0 copies all)
+	static bool read(const QString &sourcePath, const FrameSelection &selection, Trajectory &trajectory, size_t memoryBudget = 0);
+
+	// writes the cache of a trajectory loaded from sourcePath, streamed trajectories are decoded frame by frame;
+	// a canceled load discards the partly written cache
+	static bool write(const QString &sourcePath, const FrameSelection &selection, const Trajectory &trajectory,
+		LoadProgress *progress = nullptr);
+};
+
+// Positions of a memory mapped trajectory cache
+class TrajectoryCacheSource : public FrameSource
+{
+public:
+
+	TrajectoryCacheSource();
+	~TrajectoryCacheSource();
+
+	// maps the cache file and validates it against the source file and the selection
+	bool open(const QString &cachePath, const QString &sourcePath, const FrameSelection &selection);
+	void close();
+
+	bool isOpen() const { return m_data != nullptr; }
+
+	size_t nrFrames() const Q_DECL_OVERRIDE { return m_frameOffsets.size(); }
+	size_t nrAtoms() const Q_DECL_OVERRIDE { return m_nrAtoms; }
+
+	// native floats of a frame inside the mapping (no copy)
+	inline const float *frameData(size_t frameNr) const
+	{
+		return reinterpret_cast<const float *>(m_data + m_frameOffsets[frameNr]);
+	}
+
+	bool isReentrant() const Q_DECL_OVERRIDE { return true; }
+
+	// copies the frame into dst, may be called from several threads at once
+	bool readFrame(size_t frameNr, float *dst) Q_DECL_OVERRIDE;
+
+	// copies topology and frame bounds into the trajectory
+	void readTopology(Trajectory &trajectory) const;
+
+private:
+
+	QFile m_file;
+	uchar *m_data;
+	qint64 m_size;
+
+	size_t m_nrAtoms;
+	quint64 m_topologyOffset;
+	quint64 m_boundsOffset;
+	std::vector<quint64> m_frameOffsets;
+};
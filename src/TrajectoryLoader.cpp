@@ -0,0 +1,237 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "TrajectoryLoader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThread>
+#include <QtConcurrent>
+
+#include "CompressedFrameSource.h"
+#include "TrajectoryCache.h"
+
+void TrajectoryLoader::setDefaultTopology(Trajectory &trajectory)
+{
+	std::fill(trajectory.colors.begin(), trajectory.colors.end(), glm::vec3(0.341f, 0.776f, 0.921f));
+	std::fill(trajectory.radii.begin(), trajectory.radii.end(), 1.4f);
+}
+
+bool TrajectoryLoader::load(const QString &path, FrameSource *stream, Trajectory &trajectory, LoadProgress *progress,
+	size_t memoryBudget, const FrameSelection &selection, bool writeCache)
+{
+	const size_t FRAMES = stream->nrFrames();
+	const size_t ATOMS = stream->nrAtoms();
+	const size_t FRAME_BYTES = ATOMS * 3 * sizeof(float);
+	const size_t WINDOW = std::max<size_t>((8 * 1024 * 1024) / std::max<size_t>(FRAME_BYTES, 1), 1);
+
+	if (FRAMES == 0 || ATOMS == 0) {
+		qCritical() << "No frames or atoms selected in " << path;
+		delete stream;
+		return false;
+	}
+
+	// floats if they fit into the budget, else the compressed encoding (at least one byte per coordinate),
+	// else the frames stay on disk
+	const bool resident = memoryBudget == 0 || FRAMES * FRAME_BYTES <= memoryBudget;
+	const bool compress = !resident && FRAMES * ATOMS * 3 <= memoryBudget;
+
+	if (!resident && !compress) {
+		trajectory.stream(stream);
+		setDefaultTopology(trajectory);
+		qInfo() << "Streaming" << FRAMES << "frames of" << ATOMS << "atoms";
+		return true;
+	}
+
+	std::unique_ptr<FrameSource> source(stream);
+	std::unique_ptr<CompressedFrameSource> compressed;
+	if (progress) {
+		progress->total = FRAMES;
+	}
+
+	// bounds of compressed trajectories are assigned when they are complete
+	std::vector<Trajectory::Bounds> compressedBounds;
+	Trajectory::Bounds *bounds;
+	if (resident) {
+		// displayed while loading, the frames become visible as they arrive; the bounds of a frame
+		// are written before it is published by setLoadedFrames() and are read up to loadedFrames()
+		trajectory.resize(FRAMES, ATOMS);
+		setDefaultTopology(trajectory);
+		trajectory.frameBounds.assign(FRAMES, Trajectory::emptyBounds());
+		bounds = trajectory.frameBounds.data();
+		trajectory.setLoadedFrames(0);
+		if (progress && progress->ready) {
+			progress->ready();
+		}
+	}
+	else {
+		trajectory.clear();
+		compressed.reset(new CompressedFrameSource(FRAMES, ATOMS));
+		compressedBounds.assign(FRAMES, Trajectory::emptyBounds());
+		bounds = compressedBounds.data();
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	// split the trajectory into one frame range per task, a few tasks per core for load balancing,
+	// ranges start at keyframes so that every task encodes whole groups
+	struct FrameRange
+	{
+		size_t index;
+		size_t first;
+		size_t count;
+	};
+	std::vector<FrameRange> ranges;
+	const size_t nrTasks = size_t(std::max(QThread::idealThreadCount(), 1)) * 4;
+	const size_t groupSize = compressed ? compressed->keyframeInterval() : 1;
+	size_t rangeSize = std::max<size_t>((FRAMES + nrTasks - 1) / nrTasks, 1);
+	rangeSize = (rangeSize + groupSize - 1) / groupSize * groupSize;
+	for (size_t i = 0; i < FRAMES; i += rangeSize) {
+		FrameRange range = { ranges.size(), i, std::min(rangeSize, FRAMES - i) };
+		ranges.push_back(range);
+	}
+
+	// frames read by each range, ranges are read front to back
+	std::unique_ptr<std::atomic<size_t>[]> rangeDone(new std::atomic<size_t>[ranges.size()]);
+	for (size_t r = 0; r < ranges.size(); r++) {
+		rangeDone[r] = 0;
+	}
+
+	std::atomic<size_t> framesDone(0);
+	std::atomic<size_t> encodedBytes(0);
+	std::atomic<bool> failed(false);
+	std::atomic<bool> overBudget(false);
+	QMutex sourceMutex;
+
+	// reentrant sources are read in parallel and reduce the bounds while converting the coordinates;
+	// the reads of others (libnetcdf, which converts internally) are serialized, only the bounds
+	// (a second pass) and the compression of their frames run in parallel
+	const bool parallel = stream->isReentrant();
+	auto readRange = [&](const FrameRange &range) {
+		std::vector<float> buffer;
+		std::vector<int32_t> encoderState;
+		for (size_t i = range.first; i < range.first + range.count && !failed; i += WINDOW) {
+			size_t count = std::min(WINDOW, range.first + range.count - i);
+			float *dst;
+			if (resident) {
+				dst = trajectory.framePositions(i);
+			}
+			else {
+				buffer.resize(count * ATOMS * 3);
+				dst = buffer.data();
+			}
+
+			bool ok;
+			if (parallel) {
+				ok = source->readFramesAndBounds(i, count, dst, bounds + i);
+			}
+			else {
+				{
+					QMutexLocker locker(&sourceMutex);
+					ok = source->readFrames(i, count, dst);
+				}
+				for (size_t f = 0; f < count && ok; f++) {
+					bounds[i + f] = Trajectory::computeBounds(dst + f * ATOMS * 3, ATOMS);
+				}
+			}
+			if (!ok) {
+				failed = true;
+			}
+
+			if (compressed && ok) {
+				for (size_t f = 0; f < count; f++) {
+					encodedBytes += compressed->encodeFrame(i + f, dst + f * ATOMS * 3, bounds[i + f].min, encoderState);
+				}
+				if (encodedBytes > memoryBudget) {
+					overBudget = true;
+					failed = true;
+				}
+			}
+			rangeDone[range.index] += count;
+			framesDone += count;
+		}
+	};
+
+	QFuture<void> future = QtConcurrent::map(ranges, readRange);
+	while (!future.isFinished()) {
+		if (progress) {
+			progress->done = size_t(framesDone);
+			if (progress->canceled) {
+				failed = true;
+			}
+		}
+
+		// publish the frames read without gaps from the start
+		if (resident) {
+			size_t loaded = 0;
+			for (size_t r = 0; r < ranges.size(); r++) {
+				loaded += rangeDone[r];
+				if (rangeDone[r] < ranges[r].count) {
+					break;
+				}
+			}
+			trajectory.setLoadedFrames(loaded);
+		}
+		QThread::msleep(10);
+	}
+	future.waitForFinished();
+
+	if (overBudget) {
+		// the trajectory does not compress well enough, play it from disk
+		qInfo() << "Compressed trajectory exceeds the memory budget, streaming" << FRAMES << "frames";
+		compressed.reset();
+		trajectory.stream(source.release());
+		setDefaultTopology(trajectory);
+		return true;
+	}
+
+	if (failed) {
+		if (progress && progress->canceled) {
+			qInfo() << "Loading canceled: " << path;
+		}
+		return false;
+	}
+
+	qInfo() << "Read" << FRAMES << "frames in" << timer.elapsed() << "ms using" << ranges.size() << "tasks";
+
+	if (compressed) {
+		const size_t compressedBytes = compressed->memoryUsage();
+		qInfo() << "Compressed" << FRAMES * FRAME_BYTES / (1024 * 1024) << "MB to" << compressedBytes / (1024 * 1024) << "MB,"
+			<< "precision" << compressed->precision() << "Angstrom";
+
+		// sequential decode rate, has to stay well above the playback rate
+		std::vector<float> frame(ATOMS * 3);
+		const size_t nrSamples = std::min<size_t>(FRAMES, 256);
+		timer.restart();
+		for (size_t f = 0; f < nrSamples; f++) {
+			compressed->readFrame(f, frame.data());
+		}
+		qInfo() << "Decoding" << nrSamples * 1000.0 / std::max<qint64>(timer.elapsed(), 1) << "frames/s";
+
+		trajectory.stream(compressed.release());
+		setDefaultTopology(trajectory);
+		trajectory.frameBounds.swap(compressedBounds);
+	}
+	trajectory.setLoadedFrames(FRAMES);
+
+	qInfo() << "Loaded" << FRAMES << "frames of" << ATOMS << "atoms," << trajectory.memoryUsage() / (1024 * 1024) << "MB";
+
+	// only trajectories loaded as floats are cached; compressed ones exceed the memory budget, their
+	// cache would be a float copy of several GB decoded and written before the load finishes
+	if (writeCache && resident) {
+		TrajectoryCache::write(path, selection, trajectory, progress);
+		if (progress && progress->canceled) {
+			qInfo() << "Loading canceled: " << path;
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,32 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <QString>
+
+#include "FrameSelection.h"
+#include "FrameSource.h"
+#include "LoadProgress.h"
+#include "Trajectory.h"
+
+// Format independent part of loading a trajectory from an opened FrameSource:
+// positions that fit into memoryBudget bytes are read as floats, larger trajectories are
+// compressed in memory or, if that does not fit either, streamed from the source (0 loads all frames
+// as floats). Frames are read in parallel ranges, loaded trajectories can be cached (see TrajectoryCache).
+class TrajectoryLoader
+{
+public:
+
+	// takes ownership of source; trajectories loaded as floats are announced through progress->ready
+	// before their frames are read. writeCache writes the cache of trajectories loaded as floats
+	// (not of compressed or streamed ones). On failure or cancellation the trajectory may hold partial data, the caller clears it
+	static bool load(const QString &path, FrameSource *source, Trajectory &trajectory, LoadProgress *progress,
+		size_t memoryBudget, const FrameSelection &selection, bool writeCache = true);
+
+	// formats without topology (AMBER NetCDF, DCD): all atoms look the same
+	static void setDefaultTopology(Trajectory &trajectory);
+};
@@ -0,0 +1,604 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#include "XtcLoader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtEndian>
+
+#include "SimdKernels.h"
+#include "TrajectoryLoader.h"
+
+// XTC frame layout (XDR, big-endian)
+//   0  magic (1995), natoms, step, time, box[3][3], natoms
+//   56 natoms <= 9: natoms * 3 floats
+//      else:        precision, minint[3], maxint[3], smallidx, byte count, compressed bytes (padded to 4)
+// the decompression follows xdr3dfcoord of the GROMACS xdrfile library
+
+namespace
+{
+	const qint32 XTC_MAGIC = 1995;
+	const quint64 HEADER_BYTES = 56;
+	const quint64 COMPRESSED_HEADER_BYTES = 92;
+	const float NM_TO_ANGSTROM = 10.0f;
+
+	const char INDEX_MAGIC[8] = { 'S', 'I', 'X', 'T', 'C', 'I', 'D', 'X' };
+	const quint32 INDEX_VERSION = 1;
+
+	struct IndexHeader
+	{
+		char magic[8];
+		quint32 version;
+		quint32 reserved;
+		quint64 sourceSize;
+		qint64 sourceModified; // ms since epoch
+		quint64 nrAtoms;
+		quint64 nrFrames;
+	};
+
+	// sizes of the small deltas, roughly a factor 2^(1/3) apart
+	const int MAGICINTS[] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 8, 10, 12, 16, 20, 25, 32, 40, 50, 64,
+		80, 101, 128, 161, 203, 256, 322, 406, 512, 645, 812, 1024, 1290,
+		1625, 2048, 2580, 3250, 4096, 5060, 6501, 8192, 10321, 13003,
+		16384, 20642, 26007, 32768, 41285, 52015, 65536, 82570, 104031,
+		131072, 165140, 208063, 262144, 330280, 416127, 524287, 660561,
+		832255, 1048576, 1321122, 1664510, 2097152, 2642245, 3329021,
+		4194304, 5284491, 6658042, 8388607, 10568983, 13316085, 16777216
+	};
+	const int FIRSTIDX = 9;
+	const int LASTIDX = int(sizeof(MAGICINTS) / sizeof(*MAGICINTS));
+
+	inline qint32 readInt(const uchar *p)
+	{
+		return qFromBigEndian<qint32>(p);
+	}
+
+	inline float readFloat(const uchar *p)
+	{
+		quint32 bits = qFromBigEndian<quint32>(p);
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	inline quint64 pad4(quint64 size)
+	{
+		return (size + 3) & ~quint64(3);
+	}
+
+	// bits needed for values up to size
+	int sizeOfInt(unsigned size)
+	{
+		unsigned num = 1;
+		int nrBits = 0;
+		while (size >= num && nrBits < 32) {
+			nrBits++;
+			num <<= 1;
+		}
+		return nrBits;
+	}
+
+	// bits needed for the product of the sizes
+	int sizeOfInts(int nrInts, const unsigned sizes[])
+	{
+		unsigned bytes[32];
+		unsigned nrBytes = 1;
+		bytes[0] = 1;
+		for (int i = 0; i < nrInts; i++) {
+			unsigned tmp = 0;
+			unsigned byteCount;
+			for (byteCount = 0; byteCount < nrBytes; byteCount++) {
+				tmp = bytes[byteCount] * sizes[i] + tmp;
+				bytes[byteCount] = tmp & 0xff;
+				tmp >>= 8;
+			}
+			while (tmp != 0) {
+				bytes[byteCount++] = tmp & 0xff;
+				tmp >>= 8;
+			}
+			nrBytes = byteCount;
+		}
+
+		unsigned num = 1;
+		int nrBits = 0;
+		nrBytes--;
+		while (bytes[nrBytes] >= num) {
+			nrBits++;
+			num *= 2;
+		}
+		return nrBits + int(nrBytes) * 8;
+	}
+
+	// most significant bit first, reads past the end return zero bits
+	class BitReader
+	{
+	public:
+
+		BitReader(const uchar *data, size_t size)
+			: m_data(data), m_size(size), m_count(0), m_lastBits(0), m_lastByte(0)
+		{
+		}
+
+		int bits(int nrBits)
+		{
+			const int mask = nrBits >= 32 ? -1 : int((1u << nrBits) - 1);
+			int num = 0;
+			while (nrBits >= 8) {
+				m_lastByte = (m_lastByte << 8) | next();
+				num |= int((m_lastByte >> m_lastBits) << (nrBits - 8));
+				nrBits -= 8;
+			}
+			if (nrBits > 0) {
+				if (int(m_lastBits) < nrBits) {
+					m_lastBits += 8;
+					m_lastByte = (m_lastByte << 8) | next();
+				}
+				m_lastBits -= nrBits;
+				num |= int((m_lastByte >> m_lastBits) & ((1u << nrBits) - 1));
+			}
+			return num & mask;
+		}
+
+		// three integers packed as one number of nrBits bits in mixed radix sizes
+		void ints(int nrBits, const unsigned sizes[3], int nums[3])
+		{
+			int bytes[32];
+			int nrBytes = 0;
+			bytes[1] = bytes[2] = bytes[3] = 0;
+			while (nrBits > 8) {
+				bytes[nrBytes++] = bits(8);
+				nrBits -= 8;
+			}
+			if (nrBits > 0) {
+				bytes[nrBytes++] = bits(nrBits);
+			}
+			for (int i = 2; i > 0; i--) {
+				unsigned num = 0;
+				for (int j = nrBytes - 1; j >= 0; j--) {
+					num = (num << 8) | unsigned(bytes[j]);
+					unsigned p = num / sizes[i];
+					bytes[j] = int(p);
+					num = num - p * sizes[i];
+				}
+				nums[i] = int(num);
+			}
+			nums[0] = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (bytes[3] << 24);
+		}
+
+	private:
+
+		inline unsigned next()
+		{
+			return m_count < m_size ? m_data[m_count++] : 0;
+		}
+
+		const uchar *m_data;
+		size_t m_size;
+		size_t m_count;
+		unsigned m_lastBits;
+		unsigned m_lastByte;
+	};
+
+	// decodes the coordinates of a frame with more than 9 atoms into dst (nm)
+	bool decompress(const uchar *frame, quint64 available, size_t nrAtoms, float *dst)
+	{
+		if (available < COMPRESSED_HEADER_BYTES) {
+			return false;
+		}
+		const float precision = readFloat(frame + 56);
+		if (!(precision > 0.0f)) {
+			return false;
+		}
+
+		int minInt[3];
+		unsigned sizeInt[3];
+		int bitSizeInt[3] = { 0, 0, 0 };
+		for (int k = 0; k < 3; k++) {
+			minInt[k] = readInt(frame + 60 + k * 4);
+			sizeInt[k] = unsigned(readInt(frame + 72 + k * 4) - minInt[k]) + 1;
+		}
+
+		// sizes too large to be multiplied are sent separately
+		int bitSize = 0;
+		if ((sizeInt[0] | sizeInt[1] | sizeInt[2]) > 0xffffff) {
+			for (int k = 0; k < 3; k++) {
+				bitSizeInt[k] = sizeOfInt(sizeInt[k]);
+			}
+		}
+		else {
+			bitSize = sizeOfInts(3, sizeInt);
+		}
+
+		int smallIdx = readInt(frame + 84);
+		if (smallIdx < FIRSTIDX || smallIdx >= LASTIDX) {
+			return false;
+		}
+		int smaller = MAGICINTS[std::max(FIRSTIDX, smallIdx - 1)] / 2;
+		int smallNum = MAGICINTS[smallIdx] / 2;
+		unsigned sizeSmall[3];
+		sizeSmall[0] = sizeSmall[1] = sizeSmall[2] = unsigned(MAGICINTS[smallIdx]);
+
+		const quint64 byteCount = quint32(readInt(frame + 88));
+		if (COMPRESSED_HEADER_BYTES + byteCount > available) {
+			return false;
+		}
+		BitReader in(frame + COMPRESSED_HEADER_BYTES, size_t(byteCount));
+
+		const float invPrecision = 1.0f / precision;
+		float *out = dst;
+		const float *end = dst + nrAtoms * 3;
+
+		int run = 0;
+		size_t i = 0;
+		while (i < nrAtoms) {
+			int thisCoord[3];
+			if (bitSize == 0) {
+				for (int k = 0; k < 3; k++) {
+					thisCoord[k] = in.bits(bitSizeInt[k]);
+				}
+			}
+			else {
+				in.ints(bitSize, sizeInt, thisCoord);
+			}
+			i++;
+
+			int prevCoord[3];
+			for (int k = 0; k < 3; k++) {
+				thisCoord[k] += minInt[k];
+				prevCoord[k] = thisCoord[k];
+			}
+
+			// a run of small deltas follows, the run length is kept until the next flag
+			int isSmaller = 0;
+			if (in.bits(1) == 1) {
+				run = in.bits(5);
+				isSmaller = run % 3;
+				run -= isSmaller;
+				isSmaller--;
+			}
+
+			if (run > 0) {
+				if (out + run + 3 > end) {
+					return false;
+				}
+				for (int k = 0; k < run; k += 3) {
+					int small[3];
+					in.ints(smallIdx, sizeSmall, small);
+					i++;
+					for (int c = 0; c < 3; c++) {
+						small[c] += prevCoord[c] - smallNum;
+					}
+					if (k == 0) {
+						// the first two atoms are swapped for better compression of water molecules
+						std::swap(small[0], prevCoord[0]);
+						std::swap(small[1], prevCoord[1]);
+						std::swap(small[2], prevCoord[2]);
+						for (int c = 0; c < 3; c++) {
+							*out++ = float(prevCoord[c]) * invPrecision;
+						}
+					}
+					else {
+						std::copy(small, small + 3, prevCoord);
+					}
+					for (int c = 0; c < 3; c++) {
+						*out++ = float(small[c]) * invPrecision;
+					}
+				}
+			}
+			else {
+				if (out + 3 > end) {
+					return false;
+				}
+				for (int c = 0; c < 3; c++) {
+					*out++ = float(thisCoord[c]) * invPrecision;
+				}
+			}
+
+			smallIdx += isSmaller;
+			if (smallIdx < FIRSTIDX || smallIdx >= LASTIDX) {
+				return false;
+			}
+			if (isSmaller < 0) {
+				smallNum = smaller;
+				smaller = (smallIdx > FIRSTIDX) ? MAGICINTS[smallIdx - 1] / 2 : 0;
+			}
+			else if (isSmaller > 0) {
+				smaller = smallNum;
+				smallNum = MAGICINTS[smallIdx] / 2;
+			}
+			sizeSmall[0] = sizeSmall[1] = sizeSmall[2] = unsigned(MAGICINTS[smallIdx]);
+		}
+		return out == end;
+	}
+}
+
+XtcFrameSource::XtcFrameSource()
+	: m_data(nullptr), m_size(0), m_fileAtoms(0), m_nrFrames(0), m_nrAtoms(0)
+{
+}
+
+XtcFrameSource::~XtcFrameSource()
+{
+	close();
+}
+
+bool XtcFrameSource::isXtcFormat(const QString &path)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	uchar magic[4];
+	if (file.read(reinterpret_cast<char *>(magic), 4) != 4) {
+		return false;
+	}
+	return readInt(magic) == XTC_MAGIC;
+}
+
+bool XtcFrameSource::open(const QString &path, const FrameSelection &selection)
+{
+	close();
+
+	m_file.setFileName(path);
+	if (!m_file.open(QIODevice::ReadOnly)) {
+		qCritical() << "Error loading file: " << m_file.errorString();
+		return false;
+	}
+
+	m_size = m_file.size();
+	m_data = m_file.map(0, m_size);
+	if (!m_data) {
+		qCritical() << "Error mapping file: " << m_file.errorString();
+		close();
+		return false;
+	}
+
+	if (m_size < qint64(HEADER_BYTES) || readInt(m_data) != XTC_MAGIC) {
+		qCritical() << "Not an XTC trajectory: " << path;
+		close();
+		return false;
+	}
+	m_fileAtoms = size_t(readInt(m_data + 4));
+
+	QElapsedTimer timer;
+	timer.start();
+
+	const QString indexPath = path + ".idx";
+	if (!readIndex(indexPath, path)) {
+		if (!buildIndex()) {
+			qCritical() << "Not an XTC trajectory: " << path;
+			close();
+			return false;
+		}
+		qInfo() << "Indexed" << m_frameOffsets.size() << "XTC frames in" << timer.elapsed() << "ms";
+		writeIndex(indexPath, path);
+	}
+
+	m_selection = selection;
+	m_atomRuns = selection.atomRuns(m_fileAtoms);
+	m_nrFrames = selection.nrFrames(m_frameOffsets.size());
+	m_nrAtoms = selection.nrAtoms(m_fileAtoms);
+
+	qInfo() << "Mapped" << path << ":" << m_nrFrames << "frames," << m_nrAtoms << "atoms";
+	return true;
+}
+
+void XtcFrameSource::close()
+{
+	if (m_data) {
+		m_file.unmap(m_data);
+	}
+	m_file.close();
+	m_data = nullptr;
+	m_size = 0;
+	m_fileAtoms = m_nrFrames = m_nrAtoms = 0;
+	m_selection = FrameSelection();
+	m_atomRuns.clear();
+	std::vector<quint64>().swap(m_frameOffsets);
+}
+
+bool XtcFrameSource::buildIndex()
+{
+	// walks the frame headers, the compressed size is the only field needed per frame
+	const quint64 size = quint64(m_size);
+	quint64 offset = 0;
+	while (offset + HEADER_BYTES <= size) {
+		const uchar *frame = m_data + offset;
+		if (readInt(frame) != XTC_MAGIC || size_t(readInt(frame + 4)) != m_fileAtoms) {
+			qWarning() << "Invalid XTC frame at offset" << offset << ", ignoring the rest of the file";
+			break;
+		}
+
+		quint64 frameBytes = HEADER_BYTES + m_fileAtoms * 3 * sizeof(float);
+		if (m_fileAtoms > 9) {
+			if (offset + COMPRESSED_HEADER_BYTES > size) {
+				break;
+			}
+			frameBytes = COMPRESSED_HEADER_BYTES + pad4(quint32(readInt(frame + 88)));
+		}
+		if (offset + frameBytes > size) {
+			break; // incomplete last frame of a running simulation
+		}
+
+		m_frameOffsets.push_back(offset);
+		offset += frameBytes;
+	}
+	return !m_frameOffsets.empty();
+}
+
+bool XtcFrameSource::readIndex(const QString &indexPath, const QString &path)
+{
+	QFile file(indexPath);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+
+	IndexHeader header;
+	if (file.read(reinterpret_cast<char *>(&header), sizeof(header)) != qint64(sizeof(header)) ||
+		std::memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || header.version != INDEX_VERSION) {
+		return false;
+	}
+
+	QFileInfo info(path);
+	if (header.sourceSize != quint64(info.size()) || header.sourceModified != info.lastModified().toMSecsSinceEpoch() ||
+		header.nrAtoms != m_fileAtoms || header.nrFrames == 0) {
+		qInfo() << "XTC index is outdated: " << indexPath;
+		return false;
+	}
+
+	std::vector<quint64> offsets(header.nrFrames);
+	const qint64 bytes = qint64(offsets.size() * sizeof(quint64));
+	if (file.read(reinterpret_cast<char *>(offsets.data()), bytes) != bytes) {
+		return false;
+	}
+
+	// every offset has to point to a frame header inside the file
+	for (size_t f = 0; f < offsets.size(); f++) {
+		if (offsets[f] + HEADER_BYTES > quint64(m_size) || readInt(m_data + offsets[f]) != XTC_MAGIC) {
+			qWarning() << "Corrupt XTC index: " << indexPath;
+			return false;
+		}
+	}
+
+	m_frameOffsets.swap(offsets);
+	return true;
+}
+
+void XtcFrameSource::writeIndex(const QString &indexPath, const QString &path) const
+{
+	QFileInfo info(path);
+
+	IndexHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	header.version = INDEX_VERSION;
+	header.sourceSize = quint64(info.size());
+	header.sourceModified = info.lastModified().toMSecsSinceEpoch();
+	header.nrAtoms = m_fileAtoms;
+	header.nrFrames = m_frameOffsets.size();
+
+	QSaveFile file(indexPath);
+	const qint64 bytes = qint64(m_frameOffsets.size() * sizeof(quint64));
+	if (!file.open(QIODevice::WriteOnly) ||
+		file.write(reinterpret_cast<const char *>(&header), sizeof(header)) != qint64(sizeof(header)) ||
+		file.write(reinterpret_cast<const char *>(m_frameOffsets.data()), bytes) != bytes ||
+		!file.commit()) {
+		qWarning() << "Cannot write XTC index: " << file.errorString();
+	}
+}
+
+bool XtcFrameSource::readFrame(size_t frameNr, float *dst)
+{
+	return convertFrame(frameNr, dst, nullptr);
+}
+
+bool XtcFrameSource::readFramesAndBounds(size_t first, size_t count, float *dst, FrameBounds *bounds)
+{
+	for (size_t i = 0; i < count; i++) {
+		if (!convertFrame(first + i, dst + i * m_nrAtoms * 3, &bounds[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool XtcFrameSource::convertFrame(size_t frameNr, float *dst, FrameBounds *bounds)
+{
+	if (!isOpen() || frameNr >= m_nrFrames) {
+		return false;
+	}
+
+	const quint64 offset = m_frameOffsets[m_selection.fileFrame(frameNr)];
+	const uchar *frame = m_data + offset;
+	const quint64 available = quint64(m_size) - offset;
+
+	// all atoms are decoded, a subset is picked afterwards
+	const bool allAtoms = m_nrAtoms == m_fileAtoms;
+	std::vector<float> decoded;
+	float *positions = dst;
+	if (!allAtoms) {
+		decoded.resize(m_fileAtoms * 3);
+		positions = decoded.data();
+	}
+
+	if (m_fileAtoms <= 9) {
+		// small systems are stored uncompressed
+		SimdKernels::bigEndianToFloat(frame + HEADER_BYTES, positions, m_fileAtoms * 3);
+	}
+	else if (!decompress(frame, available, m_fileAtoms, positions)) {
+		qWarning() << "Corrupt XTC frame" << m_selection.fileFrame(frameNr);
+		return false;
+	}
+
+	if (!allAtoms) {
+		size_t atomOffset = 0;
+		for (size_t r = 0; r < m_atomRuns.size(); r++) {
+			std::memcpy(dst + atomOffset * 3, &decoded[m_atomRuns[r].first * 3], m_atomRuns[r].second * 3 * sizeof(float));
+			atomOffset += m_atomRuns[r].second;
+		}
+	}
+
+	// only the selected atoms are converted, their bounds are reduced in the same pass
+	if (bounds) {
+		for (size_t i = 0; i < m_nrAtoms; i++) {
+			for (int k = 0; k < 3; k++) {
+				const float value = dst[i * 3 + k] * NM_TO_ANGSTROM;
+				dst[i * 3 + k] = value;
+				bounds->min[k] = std::min(bounds->min[k], value);
+				bounds->max[k] = std::max(bounds->max[k], value);
+			}
+		}
+	}
+	else {
+		for (size_t i = 0; i < m_nrAtoms * 3; i++) {
+			dst[i] *= NM_TO_ANGSTROM;
+		}
+	}
+	return true;
+}
+
+bool XtcLoader::readData(QString &path, Trajectory &trajectory, LoadProgress *progress, size_t memoryBudget,
+    const FrameSelection &selection)
+{
+	XtcFrameSource *source = new XtcFrameSource();
+	if (!source->open(path, selection)) {
+		delete source;
+		return false;
+	}
+
+	// decoding is CPU bound: the rate of one core bounds streamed playback per prefetch thread,
+	// the latency of a random frame bounds scrubbing with the frame slider
+	const size_t nrSamples = std::min<size_t>(source->nrFrames(), 16);
+	if (nrSamples > 0) {
+		std::vector<float> frame(source->nrAtoms() * 3);
+		QElapsedTimer timer;
+
+		timer.start();
+		for (size_t f = 0; f < nrSamples; f++) {
+			source->readFrame(f, frame.data());
+		}
+		const double sequentialMs = timer.nsecsElapsed() * 1e-6 / nrSamples;
+
+		timer.restart();
+		for (size_t f = 0; f < nrSamples; f++) {
+			source->readFrame(size_t(f * 2654435761u) % source->nrFrames(), frame.data());
+		}
+		const double seekMs = timer.nsecsElapsed() * 1e-6 / nrSamples;
+
+		qInfo() << "XTC decoding" << 1000.0 / std::max(sequentialMs, 1e-3) << "frames/s per core,"
+			<< "seek latency" << seekMs << "ms";
+	}
+
+	// the XTC encoding is smaller than any cache, only the frame index is stored
+	return TrajectoryLoader::load(path, source, trajectory, progress, memoryBudget, selection, false);
+}
@@ -0,0 +1,82 @@
+/*
+* Copyright (C) 2016
+* Computer Graphics Group, The Institute of Computer Graphics and Algorithms, TU Wien
+* All rights reserved.
+*/
+
+#pragma once
+
+#include <utility>
+#include <vector>
+#include <QFile>
+#include <QString>
+
+#include "FrameSelection.h"
+#include "FrameSource.h"
+#include "LoadProgress.h"
+#include "Trajectory.h"
+
+// Reader for GROMACS XTC trajectories (xdr3d compressed coordinates). The file is memory
+// mapped and the file offset of every frame is found once by walking the frame headers,
+// the index is stored next to the file (<source>.idx) and reused while size and modification
+// time of the source match. Frames decode independently, so decoding is reentrant and the
+// loader and the prefetcher decode several frames in parallel.
+// Coordinates are converted from nm to Angstrom.
+class XtcFrameSource : public FrameSource
+{
+public:
+
+	XtcFrameSource();
+	~XtcFrameSource();
+
+	// true if the file starts with the XTC magic number
+	static bool isXtcFormat(const QString &path);
+
+	bool open(const QString &path, const FrameSelection &selection = FrameSelection());
+	void close();
+
+	bool isOpen() const { return m_data != nullptr; }
+
+	size_t nrFrames() const Q_DECL_OVERRIDE { return m_nrFrames; }
+	size_t nrAtoms() const Q_DECL_OVERRIDE { return m_nrAtoms; }
+
+	bool isReentrant() const Q_DECL_OVERRIDE { return true; }
+
+	// decompresses the frame, may be called from several threads at once
+	bool readFrame(size_t frameNr, float *dst) Q_DECL_OVERRIDE;
+
+	// the bounds are reduced while converting to Angstrom
+	bool readFramesAndBounds(size_t first, size_t count, float *dst, FrameBounds *bounds) Q_DECL_OVERRIDE;
+
+private:
+
+	// readFrame, also extends bounds unless it is null
+	bool convertFrame(size_t frameNr, float *dst, FrameBounds *bounds);
+
+	bool readIndex(const QString &indexPath, const QString &path);
+	bool buildIndex();
+	void writeIndex(const QString &indexPath, const QString &path) const;
+
+	QFile m_file;
+	uchar *m_data;
+	qint64 m_size;
+
+	size_t m_fileAtoms;
+	size_t m_nrFrames; // selected frames and atoms
+	size_t m_nrAtoms;
+
+	FrameSelection m_selection;
+	std::vector<std::pair<size_t, size_t> > m_atomRuns;
+
+	std::vector<quint64> m_frameOffsets; // of all frames in the file
+};
+
+class XtcLoader
+{
+	public:
+
+        // same storage modes as NetCDFLoader::readData, XTC files contain no topology;
+        // logs the per-core decode rate and the seek latency
+        static bool readData(QString &path, Trajectory &trajectory, LoadProgress *progress = nullptr, size_t memoryBudget = 0,
+            const FrameSelection &selection = FrameSelection());
+};
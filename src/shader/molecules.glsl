@@ -9,21 +9,25 @@
 #extension GL_ARB_explicit_attrib_location : enable
 
 // variables
-in vec3 atomPos;
+in vec3 atomPos; // normalized to [-1, 1] if quantized
 in vec3 inputColor;
 in float inputRadius;
+in mat4 instanceMatrix; // copy of an assembly, advanced per instance
 
 out vec4 vertexColor;
 out float vertexRadius;
 
 uniform mat4 view;
+uniform vec3 positionOffset; // center of the bounding box of quantized positions
+uniform float positionScale; // its largest half extent
 
 void main(void)
 {
 	vertexColor = vec4(inputColor,1.0);
 	vertexRadius = inputRadius;
 
-	gl_Position = view*vec4(atomPos,1.0f);
+	vec3 position = positionOffset + positionScale*atomPos;
+	gl_Position = view*instanceMatrix*vec4(position,1.0f);
 
 }
 